@@ -419,6 +419,7 @@ int do_action(struct action* a, struct sip_msg* msg)
 	int cmatch;
 	struct action *aitem;
 	struct action *adefault;
+	struct switch_jmp_table *jt;
 	pv_spec_t *spec;
 	pv_elem_p model;
 	pv_value_t val;
@@ -1816,6 +1817,15 @@ next_avp:
 			adefault = NULL;
 			aitem = (struct action*)a->elem[1].u.data;
 			cmatch=0;
+			if (a->elem[2].type==SWITCH_JT_ST) {
+				/* constant labels only - jump straight to the matching
+				 * case and fall through from there */
+				jt = (struct switch_jmp_table*)a->elem[2].u.data;
+				adefault = jt->def;
+				aitem = switch_jt_lookup(jt, &val);
+				if (aitem)
+					cmatch = 1;
+			}
 			while(aitem)
 			{
 				if((unsigned char)aitem->type==DEFAULT_T)
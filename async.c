@@ -23,7 +23,15 @@
  *  2014-10-15  created (bogdan)
  */
 
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <poll.h>
+
 #include "dprint.h"
+#include "mem/mem.h"
+#include "pt.h"
 #include "async.h"
 
 int async_status = ASYNC_NO_IO;
@@ -31,6 +39,22 @@ int async_status = ASYNC_NO_IO;
 async_start_function  *async_start_f  = NULL;
 async_resume_function *async_resume_f = NULL;
 
+void *async_op_handle = NULL;
+
+/* a job, as pushed through the pipes */
+struct async_job {
+	async_job_function *f;
+	void *param;
+};
+
+/* pipe shared by all the SIP workers */
+static int async_job_pipe[2];
+
+/* pipes of each process, for the jobs which must run in a given one */
+static int (*async_proc_pipes)[2] = NULL;
+
+int async_job_fd_out = -1;
+
 
 int register_async_handlers(async_start_function *f1, async_resume_function *f2)
 {
@@ -44,3 +68,193 @@ int register_async_handlers(async_start_function *f1, async_resume_function *f2)
 
 	return 0;
 }
+
+
+static int async_job_pipe_init(int *fds)
+{
+	int i, optval;
+
+	if ( pipe(fds)!=0 ) {
+		LM_ERR("failed to create async job pipe (%s)!\n",strerror(errno));
+		return -1;
+	}
+	/* both ends are non-blocking - the readers must not hang when another
+	 * worker got the job first, the writers must not hang when the
+	 * workers are too busy to drain the pipe */
+	for (i = 0; i < 2; i++) {
+		optval=fcntl(fds[i], F_GETFL);
+		if (optval==-1){
+			LM_ERR("fnctl failed: (%d) %s\n", errno, strerror(errno));
+			return -1;
+		}
+		if (fcntl(fds[i],F_SETFL,optval|O_NONBLOCK)==-1){
+			LM_ERR("set non-blocking failed: (%d) %s\n",
+				errno, strerror(errno));
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+
+/* ret 0 on success, <0 on error - to be called once the number of
+ * processes is known */
+int init_async_jobs(void)
+{
+	unsigned int i;
+
+	/* create the pipe for dispatching the jobs to any worker */
+	if (async_job_pipe_init(async_job_pipe)<0)
+		return -1;
+	/* make vizible the "read" part of the pipe */
+	async_job_fd_out = async_job_pipe[0];
+
+	/* and the per-process ones */
+	async_proc_pipes = pkg_malloc(counted_processes*sizeof *async_proc_pipes);
+	if (async_proc_pipes==NULL) {
+		LM_ERR("no more pkg memory\n");
+		return -1;
+	}
+	for (i = 0; i < counted_processes; i++)
+		if (async_job_pipe_init(async_proc_pipes[i])<0)
+			return -1;
+
+	return 0;
+}
+
+
+/* to be called in each new process - only keeps the read end of its
+ * own pipe; the write ends are all kept, as any process may complete an
+ * operation launched by any other one */
+void async_jobs_child_init(void)
+{
+	unsigned int i;
+
+	if (async_proc_pipes==NULL)
+		return;
+
+	for (i = 0; i < counted_processes; i++)
+		if (i!=process_no && async_proc_pipes[i][0]>=0) {
+			close(async_proc_pipes[i][0]);
+			async_proc_pipes[i][0] = -1;
+		}
+}
+
+
+int async_job_proc_fd(void)
+{
+	return async_proc_pipes ? async_proc_pipes[process_no][0] : -1;
+}
+
+
+static int write_async_job(int fd, async_job_function *f, void *param)
+{
+	struct async_job job;
+	struct pollfd pfd;
+	int waited = 0;
+
+	job.f = f;
+	job.param = param;
+
+	/* the write is atomic (less than PIPE_BUF), so the readers will
+	 * always get entire jobs */
+again:
+	if (write( fd, &job, sizeof(job))==-1) {
+		if (errno==EINTR)
+			goto again;
+		if (errno==EAGAIN || errno==EWOULDBLOCK) {
+			/* pipe full - a job (an async resume, most of the time) must
+			 * never be dropped, so wait for the reader to drain it */
+			pfd.fd = fd;
+			pfd.events = POLLOUT;
+			if (poll( &pfd, 1, 1000)==0)
+				LM_WARN("async job pipe full for %d sec, still waiting\n",
+					++waited);
+			goto again;
+		}
+		LM_ERR("writing failed:[%d] %s\n", errno, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+
+int dispatch_async_job(async_job_function *f, void *param)
+{
+	return write_async_job( async_job_pipe[1], f, param);
+}
+
+
+int dispatch_async_job_to(int proc, async_job_function *f, void *param)
+{
+	if (proc<0 || proc>=(int)counted_processes || async_proc_pipes==NULL) {
+		LM_CRIT("BUG - invalid process %d for async job\n", proc);
+		return -1;
+	}
+	return write_async_job( async_proc_pipes[proc][1], f, param);
+}
+
+
+void handle_async_job(int fd)
+{
+	struct async_job job;
+	ssize_t l;
+
+	/* read one job from the pipe (non-blocking) */
+	l = read( fd, &job, sizeof(job) );
+	if (l==-1) {
+		if (errno==EAGAIN || errno==EINTR || errno==EWOULDBLOCK )
+			return;
+		LM_ERR("read failed:[%d] %s\n", errno, strerror(errno));
+		return;
+	}
+
+	job.f( job.param );
+}
+
+
+static void async_op_resume_job(void *handle)
+{
+	async_resume_f( -1, handle);
+}
+
+
+void async_op_init(async_op_t *op)
+{
+	op->state = ASYNC_OP_LAUNCHING;
+	op->proc = process_no;
+}
+
+
+int async_op_suspend(async_op_t *op)
+{
+	/* fails if the operation was completed meanwhile */
+	return __sync_bool_compare_and_swap( &op->state,
+		ASYNC_OP_LAUNCHING, ASYNC_OP_SUSPENDED);
+}
+
+
+int async_op_done(void *handle)
+{
+	async_op_t *op = (async_op_t *)handle;
+
+	if (async_resume_f==NULL) {
+		LM_CRIT("BUG - async operation completed, but no async engine\n");
+		return -1;
+	}
+
+	/* completed while still being launched - nothing is queued, the
+	 * launching process resumes it right away (or drops it, if the
+	 * launch eventually failed) */
+	if (__sync_bool_compare_and_swap( &op->state,
+	ASYNC_OP_LAUNCHING, ASYNC_OP_DONE))
+		return 0;
+
+	/* the message processing context lives in the private memory of the
+	 * launching process (it holds pkg pointers set by the modules), so
+	 * the resume must be done there and cannot be taken over by another
+	 * worker */
+	return dispatch_async_job_to( op->proc, async_op_resume_job, handle);
+}
@@ -36,7 +36,8 @@
  * NOTE: all values in this enum must be negative
  */
 enum async_ret_code {
-	ASYNC_NO_IO = -5,
+	ASYNC_NO_FD = -6,
+	ASYNC_NO_IO,
 	ASYNC_SYNC,
 	ASYNC_CONTINUE,
 	ASYNC_DONE_CLOSE_FD,
@@ -69,6 +70,61 @@ extern async_resume_function *async_resume_f;
 int register_async_handlers(async_start_function *f1, async_resume_function *f2);
 
 
+/* jobs dispatched to the first available SIP worker (via a pipe shared by
+ * all of them) or to a given process (via its own pipe) - the param must
+ * be in shared memory, as the job is run by a different process */
+typedef void (async_job_function)(void *param);
+
+extern int async_job_fd_out;
+
+int init_async_jobs(void);
+
+/* closes, in a new process, the pipe ends of the other processes */
+void async_jobs_child_init(void);
+
+/* read end of the job pipe of the calling process */
+int async_job_proc_fd(void);
+
+int dispatch_async_job(async_job_function *f, void *param);
+
+int dispatch_async_job_to(int proc, async_job_function *f, void *param);
+
+void handle_async_job(int fd);
+
+
+/* header of the handle of an async operation without fd; the async
+ * engine keeps it at the beginning of its (shm) context */
+enum async_op_state {
+	ASYNC_OP_LAUNCHING = 0,
+	ASYNC_OP_SUSPENDED,
+	ASYNC_OP_DONE
+};
+
+typedef struct async_op {
+	volatile int state;
+	int proc;   /* the launching process, where the resume is done */
+} async_op_t;
+
+void async_op_init(async_op_t *op);
+
+/* marks the operation as suspended, once its launch is complete - returns
+ * 0 if it already completed meanwhile (and has to be resumed right away) */
+int async_op_suspend(async_op_t *op);
+
+/* handle of the async operation being launched; a module function which
+ * returns ASYNC_NO_FD (operation without fd to wait on) must keep it and
+ * pass it to async_op_done() when the operation completes - this may be
+ * done from any process and the resume function will be called (with
+ * fd -1) by the launching SIP worker. If the module function returns an
+ * error instead, the handle must not be used anymore.
+ * NOTE: the resume is never taken over by another (idle) worker - the
+ * processing context of the message is in the private memory of the
+ * launching worker, so a stalled worker also stalls its pending resumes */
+extern void *async_op_handle;
+
+int async_op_done(void *handle);
+
+
 /* async related functions to be used by the 
  * functions exported by modules */
 typedef int (async_resume_module)
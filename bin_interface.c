@@ -271,6 +271,23 @@ int bin_pop_int(void *info)
 	return 0;
 }
 
+/*
+ * bin_get_rcv_pos / bin_set_rcv_pos - save or move the parsing cursor of
+ * the received packet; the following pops will only consume the bytes
+ * between @pos and @end (e.g. the packets nested inside a larger one)
+ */
+void bin_get_rcv_pos(char **pos, char **end)
+{
+	*pos = cpos;
+	*end = rcv_end;
+}
+
+void bin_set_rcv_pos(char *pos, char *end)
+{
+	cpos = pos;
+	rcv_end = end;
+}
+
 /**
  * bin_send - computes the checksum of the current packet and then
  * sends the packet over UDP to the @dest destination
@@ -162,6 +162,15 @@ int bin_skip_int(int count);
  */
 int bin_skip_str(int count);
 
+/*
+ * saves/restores the parsing position inside a received binary packet;
+ * setting a narrower [pos, end) window allows nested packets to be popped
+ * with the usual functions
+ */
+void bin_get_rcv_pos(char **pos, char **end);
+
+void bin_set_rcv_pos(char *pos, char *end);
+
 /**
  * bin_send - computes the checksum of the current packet and then
  * sends the packet over UDP to the @dest destination
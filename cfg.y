@@ -304,6 +304,9 @@ extern char *finame;
 %token LOGSTDERROR
 %token LOGFACILITY
 %token LOGNAME
+%token LOGASYNC
+%token LOGASYNCRECORDS
+%token LOGJSON
 %token AVP_ALIASES
 %token LISTEN
 %token BIN_LISTEN
@@ -641,6 +644,12 @@ assign_stm: DEBUG EQUAL snumber {
 		| LOGFACILITY EQUAL error { yyerror("ID expected"); }
 		| LOGNAME EQUAL STRING { log_name=$3; }
 		| LOGNAME EQUAL error { yyerror("string value expected"); }
+		| LOGASYNC EQUAL NUMBER { log_async=$3; }
+		| LOGASYNC EQUAL error { yyerror("boolean value expected"); }
+		| LOGASYNCRECORDS EQUAL NUMBER { log_async_records=$3; }
+		| LOGASYNCRECORDS EQUAL error { yyerror("number expected"); }
+		| LOGJSON EQUAL NUMBER { log_json=$3; }
+		| LOGJSON EQUAL error { yyerror("boolean value expected"); }
 		| AVP_ALIASES EQUAL STRING {
 				yyerror("AVP_ALIASES shouldn't be used anymore\n");
 			}
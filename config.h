@@ -173,4 +173,12 @@
 
 #define OPENSER_OID   1,3,6,1,4,1,27483
 
+#define LOG_ASYNC_RECORDS     256	/*!< default size (in records) of the per-process async log ring */
+#define LOG_ASYNC_MSG_SIZE    1024	/*!< max length of an async log record, longer ones are truncated */
+#define LOG_ASYNC_BATCH       64	/*!< max records written by the async logger with one writev() */
+#define LOG_ASYNC_IDLE_US     5000	/*!< async logger sleep when there is nothing to write */
+
+#define RE_CACHE_SIZE       64		/*!< max regexps compiled at runtime and kept cached (per process) */
+#define RE_CACHE_HASH_SIZE  32		/*!< buckets of the runtime regexp cache (power of 2) */
+
 #endif
@@ -56,6 +56,8 @@ stat_var* err_rpls;
 stat_var* bad_URIs;
 stat_var* unsupported_methods;
 stat_var* bad_msg_hdr;
+stat_var* re_cache_hits;
+stat_var* re_cache_misses;
 
 
 stat_export_t core_stats[] = {
@@ -70,6 +72,9 @@ stat_export_t core_stats[] = {
 	{"bad_URIs_rcvd",         0,  &bad_URIs              },
 	{"unsupported_methods",   0,  &unsupported_methods   },
 	{"bad_msg_hdr",           0,  &bad_msg_hdr           },
+	{"re_cache_hits",         0,  &re_cache_hits         },
+	{"re_cache_misses",       0,  &re_cache_misses       },
+	{"log_dropped",  STAT_IS_FUNC, (stat_var**)log_async_dropped },
 	{"timestamp",  STAT_IS_FUNC, (stat_var**)get_ticks   }, {0,0,0}
 };
 
@@ -74,6 +74,12 @@ extern stat_var* unsupported_methods;
 /*! \brief Set in get_hdr_field(). */
 extern stat_var* bad_msg_hdr;
 
+/*! \brief Set in re_cache_get() */
+extern stat_var* re_cache_hits;
+
+/*! \brief Set in re_cache_get() */
+extern stat_var* re_cache_misses;
+
 #ifdef PKG_MALLOC
 int init_pkg_stats(int no_procs);
 
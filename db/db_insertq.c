@@ -135,8 +135,8 @@ void flush_query_list(void)
 			/* and let's insert the rows */
 			for (i=0;i<it->no_rows;i++)
 			{
-				if (it->dbf.insert(it->conn[process_no],it->cols,it->rows[i],
-							it->col_no) < 0)
+				if ((it->replace ? it->dbf.replace : it->dbf.insert)(
+				it->conn[process_no],it->cols,it->rows[i],it->col_no) < 0)
 					LM_ERR("failed to insert into DB\n");
 
 				shm_free(it->rows[i]);
@@ -53,6 +53,7 @@ typedef struct query_list {
 	gen_lock_t* lock;	/* lock for adding rows */
 	int no_rows;		/* number of rows in queue */
 	time_t oldest_query;	/* timestamp of oldest query in queue */
+	int replace;		/* flush the rows as replace queries */
 	struct query_list *next;
 	struct query_list *prev;
 } query_list_t;
@@ -208,7 +208,10 @@ int db_do_insert(const db_con_t* _h, const db_key_t* _k, const db_val_t* _v,
 	}
 
 build_query:
-	ret = snprintf(sql_buf, SQL_BUF_LEN, "insert into %.*s (", CON_TABLE(_h)->len, CON_TABLE(_h)->s);
+	/* the rows of some queues are meant to overwrite the existing ones */
+	ret = snprintf(sql_buf, SQL_BUF_LEN, "%s into %.*s (",
+		(CON_HAS_INSLIST(_h) && _h->ins_list->replace) ? "replace" : "insert",
+		CON_TABLE(_h)->len, CON_TABLE(_h)->s);
 	if (ret < 0 || ret >= SQL_BUF_LEN) goto error;
 	off = ret;
 
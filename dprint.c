@@ -28,11 +28,19 @@
 
 #include "dprint.h"
 #include "globals.h"
+#include "config.h"
 #include "pt.h"
+#include "mem/shm_mem.h"
 
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <strings.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/uio.h>
 
 static int debug_init = L_NOTICE;
 
@@ -117,3 +125,391 @@ void reset_proc_debug_level(void)
 {
 	*debug = *default_debug;
 }
+
+
+
+/*************************** async logging *********************************/
+
+/* core parameters */
+int log_async = 0;
+int log_async_records = LOG_ASYNC_RECORDS;
+int log_json = 0;
+
+int log_async_active = 0;
+
+struct log_record {
+	int level;
+	int facility;
+	int raw;          /* no "time [pid]" prefix on stderr (LM_GEN) */
+	int pid;
+	time_t ts;
+	int len;
+	char text[LOG_ASYNC_MSG_SIZE];
+};
+
+/* single producer (the owner process), single consumer (the logger) */
+struct log_ring {
+	volatile unsigned int head;       /* next record to be written */
+	volatile unsigned int tail;       /* next record to be consumed */
+	volatile unsigned long dropped;   /* records lost as the ring was full */
+	unsigned long reported;           /* dropped records already reported */
+	struct log_record *recs;
+};
+
+static struct log_ring *log_rings = NULL;
+static unsigned int log_rings_no = 0;
+static int log_in_progress = 0;
+static volatile int log_async_exit = 0;
+
+
+int log_async_count_procs(void)
+{
+	return (log_async && !dont_fork) ? 1 : 0;
+}
+
+
+/* must be called after init_multi_proc_support(), before forking */
+int init_log_async(void)
+{
+	struct log_record *recs;
+	unsigned int i;
+
+	if (!log_async)
+		return 0;
+
+	if (dont_fork) {
+		LM_WARN("async logging not supported in no-fork mode, disabling\n");
+		log_async = 0;
+		return 0;
+	}
+
+	if (log_async_records<=0 || (log_async_records&(log_async_records-1))) {
+		LM_ERR("log_async_records (%d) must be a power of 2\n",
+			log_async_records);
+		return -1;
+	}
+
+	log_rings = shm_malloc(counted_processes * (sizeof(struct log_ring) +
+		log_async_records * sizeof(struct log_record)));
+	if (log_rings==NULL) {
+		LM_ERR("no more shm mem for %d async log records\n",
+			counted_processes * log_async_records);
+		return -1;
+	}
+	log_rings_no = counted_processes;
+
+	recs = (struct log_record*)(log_rings + log_rings_no);
+	for (i=0; i<log_rings_no; i++) {
+		memset(&log_rings[i], 0, sizeof(struct log_ring));
+		log_rings[i].recs = recs + i*log_async_records;
+	}
+
+	return 0;
+}
+
+
+/* called by each forked process to start pushing its logs to the ring */
+void log_async_attach(void)
+{
+	log_async_active = (log_rings && process_no<log_rings_no) ? 1 : 0;
+}
+
+
+unsigned long log_async_dropped(unsigned short foo)
+{
+	unsigned long n = 0;
+	unsigned int i;
+
+	for (i=0; i<log_rings_no; i++)
+		n += log_rings[i].dropped;
+	return n;
+}
+
+
+static int log_level_prio(int lev)
+{
+	switch (lev) {
+		case L_ALERT:  return LOG_ALERT;
+		case L_CRIT:   return LOG_CRIT;
+		case L_ERR:    return LOG_ERR;
+		case L_WARN:   return LOG_WARNING;
+		case L_NOTICE: return LOG_NOTICE;
+		case L_INFO:   return LOG_INFO;
+		case L_DBG:    return LOG_DEBUG;
+	}
+	return -1;
+}
+
+static void dp_sync_log(int lev, int facility, int raw,
+												const char *format, va_list ap)
+{
+	int prio;
+
+	if (log_stderr) {
+		if (!raw)
+			fprintf(stderr, "%s [%d] ", dp_time(), dp_my_pid());
+		vfprintf(stderr, format, ap);
+		fflush(stderr);
+	} else if ((prio=log_level_prio(lev))>=0) {
+		vsyslog(prio|facility, format, ap);
+	}
+}
+
+
+void dp_async_log(int lev, int facility, int raw, const char *format, ...)
+{
+	struct log_ring *ring;
+	struct log_record *rec;
+	unsigned int head;
+	va_list ap;
+	int n;
+
+	va_start(ap, format);
+
+	/* re-entered from a signal handler while logging - the pending
+	 * record is not published yet, so do not touch the ring */
+	if (log_in_progress) {
+		dp_sync_log(lev, facility, raw, format, ap);
+		va_end(ap);
+		return;
+	}
+	log_in_progress = 1;
+
+	ring = &log_rings[process_no];
+	head = ring->head;
+	if (head - ring->tail >= (unsigned int)log_async_records) {
+		ring->dropped++;
+		goto done;
+	}
+
+	rec = &ring->recs[head & (log_async_records-1)];
+	n = vsnprintf(rec->text, LOG_ASYNC_MSG_SIZE, format, ap);
+	if (n<0)
+		n = 0;
+	else if (n>=LOG_ASYNC_MSG_SIZE)
+		n = LOG_ASYNC_MSG_SIZE-1; /* truncated */
+	rec->len = n;
+	rec->level = lev;
+	rec->facility = facility;
+	rec->raw = raw;
+	rec->pid = dp_my_pid();
+	rec->ts = time(NULL);
+
+	/* the record must be complete before the logger can see it */
+	__sync_synchronize();
+	ring->head = head + 1;
+
+done:
+	log_in_progress = 0;
+	va_end(ap);
+}
+
+
+static char *log_level_name(int lev)
+{
+	switch (lev) {
+		case L_ALERT:  return "ALERT";
+		case L_CRIT:   return "CRITICAL";
+		case L_ERR:    return "ERROR";
+		case L_WARN:   return "WARNING";
+		case L_NOTICE: return "NOTICE";
+		case L_INFO:   return "INFO";
+		case L_DBG:    return "DBG";
+	}
+	return "UNKNOWN";
+}
+
+static char *log_facility_name(int facility)
+{
+	int i;
+
+	for (i=0; str_fac[i]; i++)
+		if (int_fac[i]==facility)
+			return str_fac[i];
+	return "UNKNOWN";
+}
+
+
+/* renders the record as a JSON object into buf (with a trailing '\n') */
+static int log_json_print(struct log_record *rec, char *buf, int size)
+{
+	char tbuf[32];
+	char *p, *end;
+	int i, n, len;
+
+	ctime_r(&rec->ts, tbuf);
+	tbuf[19] = 0;
+
+	/* drop the line terminator of the message */
+	for (len=rec->len; len>0 && (rec->text[len-1]=='\n' ||
+	rec->text[len-1]=='\r'); len--);
+
+	n = snprintf(buf, size, "{\"time\":\"%s\",\"pid\":%d,\"level\":\"%s\","
+		"\"facility\":\"%s\",\"msg\":\"", tbuf+4, rec->pid,
+		log_level_name(rec->level), log_facility_name(rec->facility));
+	if (n<0 || n>=size)
+		return 0;
+
+	p = buf + n;
+	end = buf + size - 4; /* room for an escape, "}\n */
+	for (i=0; i<len && p<end-6; i++) {
+		switch (rec->text[i]) {
+			case '"':  *p++='\\'; *p++='"';  break;
+			case '\\': *p++='\\'; *p++='\\'; break;
+			case '\n': *p++='\\'; *p++='n';  break;
+			case '\r': *p++='\\'; *p++='r';  break;
+			case '\t': *p++='\\'; *p++='t';  break;
+			default:
+				if ((unsigned char)rec->text[i]<0x20)
+					p += sprintf(p, "\\u%04x", (unsigned char)rec->text[i]);
+				else
+					*p++ = rec->text[i];
+		}
+	}
+	*p++ = '"';
+	*p++ = '}';
+	*p++ = '\n';
+
+	return p - buf;
+}
+
+
+/* prefix and JSON buffers for one batch of stderr records */
+static char log_prefix_buf[LOG_ASYNC_BATCH][64];
+static char log_json_buf[LOG_ASYNC_BATCH][2*LOG_ASYNC_MSG_SIZE];
+
+static void log_flush_stderr(struct iovec *iov, int cnt)
+{
+	int n;
+
+	while (cnt>0) {
+		n = writev(STDERR_FILENO, iov, cnt);
+		if (n<0) {
+			if (errno==EINTR)
+				continue;
+			return;
+		}
+		/* skip over what was written, retry with the rest */
+		for (; cnt && (size_t)n>=iov->iov_len; n-=iov->iov_len, iov++, cnt--);
+		if (cnt) {
+			iov->iov_base = (char*)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+}
+
+/* writes up to LOG_ASYNC_BATCH records of the ring
+ * \return the number of consumed records */
+static int log_drain_ring(struct log_ring *ring)
+{
+	static struct iovec iov[2*LOG_ASYNC_BATCH];
+	struct log_record *rec;
+	unsigned int head, tail;
+	char tbuf[32];
+	int n, k, len, prio;
+
+	head = ring->head;
+	/* read the records only after reading head */
+	__sync_synchronize();
+
+	for (n=0, k=0, tail=ring->tail; tail!=head && n<LOG_ASYNC_BATCH;
+	tail++, n++) {
+		rec = &ring->recs[tail & (log_async_records-1)];
+
+		if (!log_stderr) {
+			if ((prio=log_level_prio(rec->level))<0)
+				continue;
+			if (log_json) {
+				len = log_json_print(rec, log_json_buf[n],
+					sizeof(log_json_buf[n]));
+				syslog(prio|rec->facility, "%.*s", len-1, log_json_buf[n]);
+			} else {
+				syslog(prio|rec->facility, "%.*s", rec->len, rec->text);
+			}
+			continue;
+		}
+
+		if (log_json) {
+			iov[k].iov_base = log_json_buf[n];
+			iov[k].iov_len = log_json_print(rec, log_json_buf[n],
+				sizeof(log_json_buf[n]));
+		} else {
+			if (!rec->raw) {
+				ctime_r(&rec->ts, tbuf);
+				tbuf[19] = 0;
+				iov[k].iov_base = log_prefix_buf[n];
+				iov[k].iov_len = snprintf(log_prefix_buf[n],
+					sizeof(log_prefix_buf[n]), "%s [%d] ", tbuf+4, rec->pid);
+				k++;
+			}
+			iov[k].iov_base = rec->text;
+			iov[k].iov_len = rec->len;
+		}
+		k++;
+	}
+
+	if (k)
+		log_flush_stderr(iov, k);
+
+	/* the slots may be reused only after they were written out */
+	__sync_synchronize();
+	ring->tail = tail;
+
+	return n;
+}
+
+static void log_async_sig(int signo)
+{
+	log_async_exit = 1;
+}
+
+static void log_async_loop(void)
+{
+	unsigned int i;
+	int n;
+
+	/* the logger writes its own logs directly */
+	log_async_active = 0;
+
+	signal(SIGTERM, log_async_sig);
+	signal(SIGINT, log_async_sig);
+
+	for (;;) {
+		for (i=0, n=0; i<log_rings_no; i++) {
+			n += log_drain_ring(&log_rings[i]);
+
+			if (log_rings[i].dropped != log_rings[i].reported) {
+				LM_WARN("%lu log records of process %d were dropped (log "
+					"ring full)\n", log_rings[i].dropped-log_rings[i].reported,
+					pt[i].pid);
+				log_rings[i].reported = log_rings[i].dropped;
+			}
+		}
+
+		if (n==0) {
+			/* drained everything there was at termination time */
+			if (log_async_exit)
+				exit(0);
+			usleep(LOG_ASYNC_IDLE_US);
+		}
+	}
+}
+
+
+int start_log_async_process(void)
+{
+	pid_t pid;
+
+	if (!log_rings)
+		return 0;
+
+	if ( (pid=internal_fork("async logger"))<0 ) {
+		LM_CRIT("cannot fork async logger process\n");
+		return -1;
+	} else if (pid==0) {
+		log_async_loop();
+		exit(-1);
+	}
+
+	return 0;
+}
@@ -103,6 +103,12 @@ extern int log_facility;
 extern char* log_name;
 extern char ctime_buf[];
 
+extern int log_async;
+extern int log_async_records;
+extern int log_json;
+/* set in the processes pushing their logs to the async logger */
+extern int log_async_active;
+
 /*
  * must be called after init_multi_proc_support()
  * must be called once for each OpenSIPS process
@@ -118,6 +124,24 @@ void dprint (char* format, ...);
 
 int str2facility(char *s);
 
+/*
+ * asynchronous logging: each process formats its log lines into a
+ * lock-free ring in shared memory and a dedicated logger process
+ * writes them to syslog / stderr
+ */
+int init_log_async(void);
+int log_async_count_procs(void);
+int start_log_async_process(void);
+void log_async_attach(void);
+unsigned long log_async_dropped(unsigned short foo);
+
+#if defined __GNUC__
+void dp_async_log(int lev, int facility, int raw, const char *format, ...)
+	__attribute__ ((format (printf, 4, 5)));
+#else
+void dp_async_log(int lev, int facility, int raw, const char *format, ...);
+#endif
+
 /*
  * set the (default) log level of a given process
  *
@@ -213,13 +237,18 @@ static inline char* dp_time(void)
 				syslog( (_log_level)|log_facility, \
 							LOG_PREFIX __VA_ARGS__);\
 
+		#define MY_ASYNC_LOG( _lev, ...) \
+				dp_async_log( _lev, log_facility, 0, LOG_PREFIX __VA_ARGS__)
+
 		#define LM_GEN1(_lev, ...) \
 			LM_GEN2( log_facility, _lev, __VA_ARGS__)
 
 		#define LM_GEN2( _facility, _lev, ...) \
 			do { \
 				if (is_printable(_lev)){ \
-					if (log_stderr) dprint (__VA_ARGS__); \
+					if (log_async_active) \
+						dp_async_log( _lev, _facility, 1, __VA_ARGS__); \
+					else if (log_stderr) dprint (__VA_ARGS__); \
 					else { \
 						switch(_lev){ \
 							case L_CRIT: \
@@ -251,7 +280,9 @@ static inline char* dp_time(void)
 		#define LM_ALERT( ...) \
 			do { \
 				if (is_printable(L_ALERT)){ \
-					if (log_stderr)\
+					if (log_async_active)\
+						MY_ASYNC_LOG( L_ALERT, DP_ALERT_TEXT __VA_ARGS__);\
+					else if (log_stderr)\
 						MY_DPRINT( DP_ALERT_PREFIX __VA_ARGS__);\
 					else \
 						MY_SYSLOG( LOG_ALERT, DP_ALERT_TEXT __VA_ARGS__);\
@@ -261,7 +292,9 @@ static inline char* dp_time(void)
 		#define LM_CRIT( ...) \
 			do { \
 				if (is_printable(L_CRIT)){ \
-					if (log_stderr)\
+					if (log_async_active)\
+						MY_ASYNC_LOG( L_CRIT, DP_CRIT_TEXT __VA_ARGS__);\
+					else if (log_stderr)\
 						MY_DPRINT( DP_CRIT_PREFIX __VA_ARGS__);\
 					else \
 						MY_SYSLOG( LOG_CRIT, DP_CRIT_TEXT __VA_ARGS__);\
@@ -271,7 +304,9 @@ static inline char* dp_time(void)
 		#define LM_ERR( ...) \
 			do { \
 				if (is_printable(L_ERR)){ \
-					if (log_stderr)\
+					if (log_async_active)\
+						MY_ASYNC_LOG( L_ERR, DP_ERR_TEXT __VA_ARGS__);\
+					else if (log_stderr)\
 						MY_DPRINT( DP_ERR_PREFIX __VA_ARGS__);\
 					else \
 						MY_SYSLOG( LOG_ERR, DP_ERR_TEXT __VA_ARGS__);\
@@ -281,7 +316,9 @@ static inline char* dp_time(void)
 		#define LM_WARN( ...) \
 			do { \
 				if (is_printable(L_WARN)){ \
-					if (log_stderr)\
+					if (log_async_active)\
+						MY_ASYNC_LOG( L_WARN, DP_WARN_TEXT __VA_ARGS__);\
+					else if (log_stderr)\
 						MY_DPRINT( DP_WARN_PREFIX __VA_ARGS__);\
 					else \
 						MY_SYSLOG( LOG_WARNING, DP_WARN_TEXT __VA_ARGS__);\
@@ -291,7 +328,9 @@ static inline char* dp_time(void)
 		#define LM_NOTICE( ...) \
 			do { \
 				if (is_printable(L_NOTICE)){ \
-					if (log_stderr)\
+					if (log_async_active)\
+						MY_ASYNC_LOG( L_NOTICE, DP_NOTICE_TEXT __VA_ARGS__);\
+					else if (log_stderr)\
 						MY_DPRINT( DP_NOTICE_PREFIX __VA_ARGS__);\
 					else \
 						MY_SYSLOG( LOG_NOTICE, DP_NOTICE_TEXT __VA_ARGS__);\
@@ -301,7 +340,9 @@ static inline char* dp_time(void)
 		#define LM_INFO( ...) \
 			do { \
 				if (is_printable(L_INFO)){ \
-					if (log_stderr)\
+					if (log_async_active)\
+						MY_ASYNC_LOG( L_INFO, DP_INFO_TEXT __VA_ARGS__);\
+					else if (log_stderr)\
 						MY_DPRINT( DP_INFO_PREFIX __VA_ARGS__);\
 					else \
 						MY_SYSLOG( LOG_INFO, DP_INFO_TEXT __VA_ARGS__);\
@@ -314,7 +355,9 @@ static inline char* dp_time(void)
 			#define LM_DBG( ...) \
 				do { \
 					if (is_printable(L_DBG)){ \
-						if (log_stderr)\
+						if (log_async_active)\
+							MY_ASYNC_LOG( L_DBG, DP_DBG_TEXT __VA_ARGS__);\
+						else if (log_stderr)\
 							MY_DPRINT( DP_DBG_PREFIX __VA_ARGS__);\
 						else \
 							MY_SYSLOG( LOG_DEBUG, DP_DBG_TEXT __VA_ARGS__);\
@@ -334,13 +377,19 @@ static inline char* dp_time(void)
 				syslog( (_log_level)|log_facility, \
 							_prefix LOG_PREFIX _fmt, __DP_FUNC, ##args);\
 
+		#define MY_ASYNC_LOG( _lev, _prefix, _fmt, args...) \
+				dp_async_log( _lev, log_facility, 0, \
+							_prefix LOG_PREFIX _fmt, __DP_FUNC, ##args)
+
 		#define LM_GEN1(_lev, args...) \
 			LM_GEN2( log_facility, _lev, ##args)
 
 		#define LM_GEN2( _facility, _lev, fmt, args...) \
 			do { \
 				if (is_printable(_lev)){ \
-					if (log_stderr) dprint ( fmt, ## args); \
+					if (log_async_active) \
+						dp_async_log( _lev, _facility, 1, fmt, ##args); \
+					else if (log_stderr) dprint ( fmt, ## args); \
 					else { \
 						switch(_lev){ \
 							case L_CRIT: \
@@ -372,7 +421,9 @@ static inline char* dp_time(void)
 		#define LM_ALERT( fmt, args...) \
 			do { \
 				if (is_printable(L_ALERT)){ \
-					if (log_stderr)\
+					if (log_async_active)\
+						MY_ASYNC_LOG( L_ALERT, DP_ALERT_TEXT, fmt, ##args);\
+					else if (log_stderr)\
 						MY_DPRINT( DP_ALERT_PREFIX, fmt, ##args);\
 					else \
 						MY_SYSLOG( LOG_ALERT, DP_ALERT_TEXT, fmt, ##args);\
@@ -382,7 +433,9 @@ static inline char* dp_time(void)
 		#define LM_CRIT( fmt, args...) \
 			do { \
 				if (is_printable(L_CRIT)){ \
-					if (log_stderr)\
+					if (log_async_active)\
+						MY_ASYNC_LOG( L_CRIT, DP_CRIT_TEXT, fmt, ##args);\
+					else if (log_stderr)\
 						MY_DPRINT( DP_CRIT_PREFIX, fmt, ##args);\
 					else \
 						MY_SYSLOG( LOG_CRIT, DP_CRIT_TEXT, fmt, ##args);\
@@ -392,7 +445,9 @@ static inline char* dp_time(void)
 		#define LM_ERR( fmt, args...) \
 			do { \
 				if (is_printable(L_ERR)){ \
-					if (log_stderr)\
+					if (log_async_active)\
+						MY_ASYNC_LOG( L_ERR, DP_ERR_TEXT, fmt, ##args);\
+					else if (log_stderr)\
 						MY_DPRINT( DP_ERR_PREFIX, fmt, ##args);\
 					else \
 						MY_SYSLOG( LOG_ERR, DP_ERR_TEXT, fmt, ##args);\
@@ -402,7 +457,9 @@ static inline char* dp_time(void)
 		#define LM_WARN( fmt, args...) \
 			do { \
 				if (is_printable(L_WARN)){ \
-					if (log_stderr)\
+					if (log_async_active)\
+						MY_ASYNC_LOG( L_WARN, DP_WARN_TEXT, fmt, ##args);\
+					else if (log_stderr)\
 						MY_DPRINT( DP_WARN_PREFIX, fmt, ##args);\
 					else \
 						MY_SYSLOG( LOG_WARNING, DP_WARN_TEXT, fmt, ##args);\
@@ -412,7 +469,9 @@ static inline char* dp_time(void)
 		#define LM_NOTICE( fmt, args...) \
 			do { \
 				if (is_printable(L_NOTICE)){ \
-					if (log_stderr)\
+					if (log_async_active)\
+						MY_ASYNC_LOG( L_NOTICE, DP_NOTICE_TEXT, fmt, ##args);\
+					else if (log_stderr)\
 						MY_DPRINT( DP_NOTICE_PREFIX, fmt, ##args);\
 					else \
 						MY_SYSLOG( LOG_NOTICE, DP_NOTICE_TEXT, fmt, ##args);\
@@ -422,7 +481,9 @@ static inline char* dp_time(void)
 		#define LM_INFO( fmt, args...) \
 			do { \
 				if (is_printable(L_INFO)){ \
-					if (log_stderr)\
+					if (log_async_active)\
+						MY_ASYNC_LOG( L_INFO, DP_INFO_TEXT, fmt, ##args);\
+					else if (log_stderr)\
 						MY_DPRINT( DP_INFO_PREFIX, fmt, ##args);\
 					else \
 						MY_SYSLOG( LOG_INFO, DP_INFO_TEXT, fmt, ##args);\
@@ -435,7 +496,9 @@ static inline char* dp_time(void)
 			#define LM_DBG( fmt, args...) \
 				do { \
 					if (is_printable(L_DBG)){ \
-						if (log_stderr)\
+						if (log_async_active)\
+							MY_ASYNC_LOG( L_DBG, DP_DBG_TEXT, fmt, ##args);\
+						else if (log_stderr)\
 							MY_DPRINT( DP_DBG_PREFIX, fmt, ##args);\
 						else \
 							MY_SYSLOG( LOG_DEBUG, DP_DBG_TEXT, fmt, ##args);\
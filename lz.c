@@ -0,0 +1,156 @@
+/*
+ * Minimal LZ77 codec, for the replication frames
+ *
+ * Copyright (C) 2013 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <string.h>
+
+#include "lz.h"
+
+#define LZ_HLOG		13
+#define LZ_HSIZE	(1 << LZ_HLOG)
+#define LZ_MAX_OFF	(1 << 13)
+#define LZ_MAX_LIT	(1 << 5)
+#define LZ_MAX_REF	((1 << 8) + (1 << 3))
+
+#define LZ_HASH(_p) \
+	((((unsigned int)(_p)[0] << 16 | (_p)[1] << 8 | (_p)[2]) * 2654435761u) \
+		>> (32 - LZ_HLOG))
+
+/* the frames are compressed one at a time by each process */
+static const unsigned char *lz_htab[LZ_HSIZE];
+
+int lz_compress(const unsigned char *in, int in_len,
+		unsigned char *out, int out_len)
+{
+	const unsigned char *ip = in, *in_end = in + in_len, *ref;
+	unsigned char *op = out, *out_end = out + out_len;
+	unsigned char *lit_ctrl;
+	unsigned int h, off, len, maxlen;
+	int lit = 0;
+
+	if (in_len <= 0 || out_len < 2)
+		return 0;
+
+	memset(lz_htab, 0, sizeof(lz_htab));
+
+	/* always keep a control byte ready for the next literals */
+	lit_ctrl = op++;
+
+	while (ip < in_end) {
+		if (ip + 2 < in_end) {
+			h = LZ_HASH(ip);
+			ref = lz_htab[h];
+			lz_htab[h] = ip;
+
+			if (ref && (off = ip - ref - 1) < LZ_MAX_OFF &&
+			ref[0] == ip[0] && ref[1] == ip[1] && ref[2] == ip[2]) {
+				maxlen = in_end - ip;
+				if (maxlen > LZ_MAX_REF)
+					maxlen = LZ_MAX_REF;
+				for (len = 3; len < maxlen && ref[len] == ip[len]; len++);
+
+				/* close the pending literal run */
+				if (lit)
+					*lit_ctrl = lit - 1;
+				else
+					op--;
+
+				if (op + 4 > out_end)
+					return 0;
+
+				if (len - 2 < 7) {
+					*op++ = ((len - 2) << 5) | (off >> 8);
+				} else {
+					*op++ = (7 << 5) | (off >> 8);
+					*op++ = len - 2 - 7;
+				}
+				*op++ = off & 0xff;
+
+				ip += len;
+				lit = 0;
+				lit_ctrl = op++;
+				continue;
+			}
+		}
+
+		if (op >= out_end)
+			return 0;
+		*op++ = *ip++;
+
+		if (++lit == LZ_MAX_LIT) {
+			*lit_ctrl = lit - 1;
+			lit = 0;
+			if (op >= out_end)
+				return 0;
+			lit_ctrl = op++;
+		}
+	}
+
+	if (lit)
+		*lit_ctrl = lit - 1;
+	else
+		op--;
+
+	return op - out;
+}
+
+int lz_decompress(const unsigned char *in, int in_len,
+		unsigned char *out, int out_len)
+{
+	const unsigned char *ip = in, *in_end = in + in_len;
+	unsigned char *op = out, *out_end = out + out_len, *ref;
+	unsigned int c, len;
+
+	while (ip < in_end) {
+		c = *ip++;
+
+		if (c < LZ_MAX_LIT) {
+			c++;
+			if (ip + c > in_end || op + c > out_end)
+				return -1;
+			memcpy(op, ip, c);
+			op += c;
+			ip += c;
+			continue;
+		}
+
+		len = c >> 5;
+		if (len == 7) {
+			if (ip >= in_end)
+				return -1;
+			len += *ip++;
+		}
+		if (ip >= in_end)
+			return -1;
+
+		ref = op - (((c & 0x1f) << 8) | *ip++) - 1;
+		len += 2;
+		if (ref < out || op + len > out_end)
+			return -1;
+
+		/* the areas may overlap, so copy byte by byte */
+		do {
+			*op++ = *ref++;
+		} while (--len);
+	}
+
+	return op - out;
+}
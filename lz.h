@@ -0,0 +1,47 @@
+/*
+ * Minimal LZ77 codec, for the replication frames
+ *
+ * Copyright (C) 2013 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _LZ_H_
+#define _LZ_H_
+
+/*
+ * Minimal LZ77 (LZF-like) codec used for the batched replication frames.
+ * The replicated events are full of repeated URIs, tags and socket strings,
+ * so even this cheap byte-oriented scheme shrinks the frames considerably.
+ *
+ * Encoding - a sequence of chunks, each starting with a control byte:
+ *   000LLLLL <L+1 literal bytes>
+ *   LLLooooo oooooooo            back-reference of L+2 bytes (L < 7)
+ *   111ooooo LLLLLLLL oooooooo   back-reference of L+9 bytes
+ * where the 13 bit offset is the distance to the reference, minus one.
+ */
+
+/* returns the compressed length or 0 if the output did not fit */
+int lz_compress(const unsigned char *in, int in_len,
+		unsigned char *out, int out_len);
+
+/* returns the decompressed length or -1 if the input is malformed or
+ * the output did not fit */
+int lz_decompress(const unsigned char *in, int in_len,
+		unsigned char *out, int out_len);
+
+#endif /* _LZ_H_ */
@@ -687,6 +687,12 @@ static int main_loop(void)
 		 * so we open all first*/
 		if (do_suid(uid, gid)==-1) goto error; /* try to drop privileges */
 
+		/* the async logger goes first, to collect the logs of all others */
+		if (start_log_async_process()!=0) {
+			LM_CRIT("cannot start the async logger process\n");
+			goto error;
+		}
+
 		if (start_module_procs()!=0) {
 			LM_ERR("failed to fork module processes\n");
 			goto error;
@@ -1219,6 +1225,18 @@ try_again:
 		goto error;
 	}
 
+	/* init the dispatching of async jobs to the SIP workers */
+	if (init_async_jobs()<0){
+		LM_CRIT("could not initialize async jobs, exiting...\n");
+		goto error;
+	}
+
+	/* init the async logging rings, before any process is forked */
+	if (init_log_async()!=0) {
+		LM_ERR("failed to init async logging\n");
+		goto error;
+	}
+
 	#ifdef PKG_MALLOC
 	/* init stats support for pkg mem */
 	if (init_pkg_stats(counted_processes)!=0) {
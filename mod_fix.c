@@ -32,6 +32,7 @@
 #include "ut.h"
 #include "error.h"
 #include "pvar.h"
+#include "re.h"
 #include "mod_fix.h"
 
 /*!
@@ -387,13 +388,10 @@ int fixup_regexp_dynamic_null(void** param, int param_no)
 	return fixup_regexp_dynamic(param, 0);
 }
 
-static char *re_buff=NULL;
-static int re_buff_len = 0;
 regex_t* fixup_get_regex(struct sip_msg* msg, gparam_p gp,int *do_free)
 {
 	pv_value_t value;
 	str val;
-	regex_t* ret_re;
 
 	if(gp->type==GPARAM_TYPE_REGEX) {
 		/* pre-allocated at startup - just return it */
@@ -421,33 +419,10 @@ regex_t* fixup_get_regex(struct sip_msg* msg, gparam_p gp,int *do_free)
 	return NULL;
 
 build_re:
-	if (val.len + 1 > re_buff_len) {
-		re_buff = pkg_realloc(re_buff,val.len + 1);
-		if (re_buff == NULL) {
-			LM_ERR("No more pkg \n");
-			return NULL;
-		}
-
-		re_buff_len = val.len + 1;
-	}
-
-	memcpy(re_buff,val.s,val.len);
-	re_buff[val.len] = 0;
-
-	if ((ret_re=pkg_malloc(sizeof(regex_t)))==0) {
-		LM_ERR("no more pkg memory\n");
-		return NULL;
-	}
-
-	if (regcomp(ret_re, re_buff, (REG_EXTENDED|REG_ICASE|REG_NEWLINE))) {
-		pkg_free(ret_re);
-		LM_ERR("bad re %s\n", re_buff);
-		return NULL;
-	}
-	
+	/* the runtime regexps are owned by the core regexp cache */
 	if (do_free)
-		*do_free=1;
-	return ret_re;
+		*do_free=0;
+	return re_cache_get(&val, REG_EXTENDED|REG_ICASE|REG_NEWLINE);
 }
 
 /*! \brief
@@ -2290,10 +2290,10 @@ void b2b_tm_cback(struct cell *t, b2b_table htable, struct tmcb_params *ps)
 				{
 					memset(&auth_nc_cnonce, 0,
 							sizeof(struct authenticate_nc_cnonce));
-					uac_auth_api._do_uac_auth(&t->method, &t->uac[0].uri, crd,
+					uac_auth_api._do_uac_auth(&t->method, &t->uac[0]->uri, crd,
 							auth, &auth_nc_cnonce, response);
 					new_hdr = uac_auth_api._build_authorization_hdr(statuscode,
-							&t->uac[0].uri, crd, auth,
+							&t->uac[0]->uri, crd, auth,
 							&auth_nc_cnonce, response);
 					if (!new_hdr)
 					{
@@ -2304,11 +2304,11 @@ void b2b_tm_cback(struct cell *t, b2b_table htable, struct tmcb_params *ps)
 					}
 					LM_DBG("[%.*s]\n", new_hdr->len, new_hdr->s);
 					LM_DBG("uri [%.*s] with extra_hdrs [%.*s]\n",
-						t->uac[0].uri.len, t->uac[0].uri.s,
-						t->uac[0].extra_headers.len,
-						t->uac[0].extra_headers.s);
+						t->uac[0]->uri.len, t->uac[0]->uri.s,
+						t->uac[0]->extra_headers.len,
+						t->uac[0]->extra_headers.s);
 					extra_headers.s = (char*)pkg_malloc(new_hdr->len +
-								t->uac[0].extra_headers.len);
+								t->uac[0]->extra_headers.len);
 					if (extra_headers.s == NULL)
 					{
 						LM_ERR("No more private memory\n");
@@ -2318,16 +2318,16 @@ void b2b_tm_cback(struct cell *t, b2b_table htable, struct tmcb_params *ps)
 					}
 					memcpy(extra_headers.s, new_hdr->s, new_hdr->len);
 					memcpy(extra_headers.s + new_hdr->len,
-						t->uac[0].extra_headers.s,
-						t->uac[0].extra_headers.len);
+						t->uac[0]->extra_headers.s,
+						t->uac[0]->extra_headers.len);
 					extra_headers.len = new_hdr->len +
-								t->uac[0].extra_headers.len;
+								t->uac[0]->extra_headers.len;
 					LM_DBG("[%.*s]\n", extra_headers.len, extra_headers.s);
 					pkg_free(new_hdr->s);
 					new_hdr->s = NULL; new_hdr->len = 0;
 
 					b2b_send_indlg_req(dlg, B2B_CLIENT, b2b_key, &t->method,
-							&extra_headers, &t->uac[0].body, 0);
+							&extra_headers, &t->uac[0]->body, 0);
 					pkg_free(extra_headers.s);
 
 					dlg->state = B2B_NEW_AUTH;
@@ -2335,7 +2335,7 @@ void b2b_tm_cback(struct cell *t, b2b_table htable, struct tmcb_params *ps)
 
 					/* run the b2b route */
 					if(reply_routeid > 0) {
-						msg->flags = t->uac[0].br_flags;
+						msg->flags = t->uac[0]->br_flags;
 						run_top_route(rlist[reply_routeid].a, msg);
 						b2b_apply_lumps(msg);
 					}
@@ -2370,7 +2370,7 @@ dummy_reply:
 			memset(&cseq, 0, sizeof(struct hdr_field));
 			cb.method = t->method;
 
-			dummy_msg.rcv.bind_address = t->uac[0].request.dst.send_sock;
+			dummy_msg.rcv.bind_address = t->uac[0]->request.dst.send_sock;
 			dummy_msg.rcv.proto = dummy_msg.rcv.bind_address->proto;
 			dummy_msg.rcv.src_port = dummy_msg.rcv.dst_port
 				= dummy_msg.rcv.bind_address->port_no;
@@ -2675,7 +2675,7 @@ done:
 done1:
 	/* run the b2b route */
 	if(reply_routeid > 0) {
-		msg->flags = t->uac[0].br_flags;
+		msg->flags = t->uac[0]->br_flags;
 		run_top_route(rlist[reply_routeid].a, msg);
 		if (msg != FAKED_REPLY) b2b_apply_lumps(msg);
 	}
@@ -270,8 +270,8 @@ void wrap_tm_compact(struct cell*t, int type, struct tmcb_params* p)
 
 void wrap_tm_func(struct cell* t, int type, struct tmcb_params* p)
 {
-	char* buf = t->uac[p->code].request.buffer.s;
-	int olen = t->uac[p->code].request.buffer.len;
+	char* buf = t->uac[p->code]->request.buffer.s;
+	int olen = t->uac[p->code]->request.buffer.len;
 	void* args;
 
 	switch (type) {
@@ -306,8 +306,8 @@ void wrap_tm_func(struct cell* t, int type, struct tmcb_params* p)
 			return;
 	}
 
-	t->uac[p->code].request.buffer.s = buf;
-	t->uac[p->code].request.buffer.len = olen;
+	t->uac[p->code]->request.buffer.s = buf;
+	t->uac[p->code]->request.buffer.len = olen;
 }
 
 int wrap_msg_compress(str* buf, struct sip_msg* p_msg) {
@@ -80,6 +80,7 @@ static int dlg_hash_size = 4096;
 static str timeout_spec = {NULL, 0};
 static int default_timeout = 60 * 60 * 12;  /* 12 hours */
 static int ping_interval = 30; /* seconds */
+static int ping_slots = 0; /* 0 - one slot per second of the interval */
 static char* profiles_wv_s = NULL;
 static char* profiles_nv_s = NULL;
 
@@ -92,6 +93,7 @@ int dlg_enable_stats = 1;
 int active_dlgs_cnt = 0;
 int early_dlgs_cnt = 0;
 int db_flush_vp = 0;
+int db_flush_batch = 0;
 stat_var *active_dlgs = 0;
 stat_var *processed_dlgs = 0;
 stat_var *expired_dlgs = 0;
@@ -103,6 +105,12 @@ stat_var *delete_sent  = 0;
 stat_var *create_recv  = 0;
 stat_var *update_recv  = 0;
 stat_var *delete_recv  = 0;
+stat_var *db_flush_time = 0;
+stat_var *db_flush_rows = 0;
+stat_var *db_flush_queries = 0;
+stat_var *callid_lookups = 0;
+stat_var *callid_probes = 0;
+stat_var *callid_collisions = 0;
 
 struct tm_binds d_tmb;
 struct rr_binds d_rrb;
@@ -226,6 +234,7 @@ static param_export_t mod_params[]={
 	{ "rr_param",              STR_PARAM, &rr_param.s               },
 	{ "default_timeout",       INT_PARAM, &default_timeout          },
 	{ "ping_interval",         INT_PARAM, &ping_interval            },
+	{ "ping_slots",            INT_PARAM, &ping_slots               },
 	{ "dlg_extra_hdrs",        STR_PARAM, &dlg_extra_hdrs.s         },
 	{ "dlg_match_mode",        INT_PARAM, &seq_match_mode           },
 	{ "db_url",                STR_PARAM, &db_url.s                 },
@@ -258,6 +267,7 @@ static param_export_t mod_params[]={
 	{ "profiles_no_value",     STR_PARAM, &profiles_nv_s            },
 	{ "db_flush_vals_profiles",INT_PARAM, &db_flush_vp              },
 	{ "timer_bulk_del_no",     INT_PARAM, &dlg_bulk_del_no          },
+	{ "db_flush_batch",        INT_PARAM, &db_flush_batch           },
 	/* distributed profiles stuff */
 	{ "cachedb_url",           STR_PARAM, &cdb_url.s                },
 	{ "profile_value_prefix",    STR_PARAM, &cdb_val_prefix.s       },
@@ -268,6 +278,9 @@ static param_export_t mod_params[]={
 	{ "accept_replicated_dialogs",INT_PARAM, &accept_replicated_dlg },
 	{ "replicate_dialogs_to",     STR_PARAM|USE_FUNC_PARAM,
 								(void *)add_replication_dest        },
+	{ "replicate_dialogs_batch",  INT_PARAM, &dlg_repl_batch_size       },
+	{ "replicate_dialogs_batch_window", INT_PARAM, &dlg_repl_batch_window },
+	{ "replicate_dialogs_compress", INT_PARAM, &dlg_repl_compress       },
 	{ "accept_replicated_profiles",INT_PARAM, &accept_repl_profiles },
 	{ "replicate_profiles_timer", INT_PARAM, &repl_prof_utimer      },
 	{ "replicate_profiles_check", INT_PARAM, &repl_prof_timer_check },
@@ -291,6 +304,12 @@ static stat_export_t mod_stats[] = {
 	{"create_recv",         0,              &create_recv       },
 	{"update_recv",         0,              &update_recv       },
 	{"delete_recv",         0,              &delete_recv       },
+	{"db_flush_time",       0,              &db_flush_time     },
+	{"db_flush_rows",       0,              &db_flush_rows     },
+	{"db_flush_queries",    0,              &db_flush_queries  },
+	{"callid_lookups",      0,              &callid_lookups    },
+	{"callid_probes",       0,              &callid_probes     },
+	{"callid_collisions",   0,              &callid_collisions },
 	{0,0,0}
 };
 
@@ -307,6 +326,8 @@ static mi_export_t mi_cmds[] = {
 	{ "list_all_profiles",  0, mi_list_all_profiles,  0,  0,  0},
 	{ "profile_bin_status", 0, mi_profiles_bin_status,
 		MI_NO_INPUT_FLAG,  0,  0},
+	{ "dlg_repl_status",    0, mi_dlg_repl_status,
+		MI_NO_INPUT_FLAG,  0,  0},
 	{ 0, 0, 0, 0, 0, 0}
 };
 
@@ -739,6 +760,17 @@ static int mod_init(void)
 		return -1;
 	}
 
+	if (ping_slots<0) {
+		LM_ERR("Negative number of ping slots not accepted!!\n");
+		return -1;
+	} else if (ping_slots==0) {
+		ping_slots = ping_interval;
+	} else if ((utime_t)ping_interval*1000000/ping_slots < UTIMER_TICK) {
+		ping_slots = (utime_t)ping_interval*1000000/UTIMER_TICK;
+		LM_WARN("too many ping slots for a %ds interval, using %d\n",
+			ping_interval, ping_slots);
+	}
+
 	/* update the len of the extra headers */
 	if (dlg_extra_hdrs.s)
 		dlg_extra_hdrs.len = strlen(dlg_extra_hdrs.s);
@@ -831,8 +863,8 @@ static int mod_init(void)
 		return -1;
 	}
 
-	if ( register_timer( "dlg-pinger", dlg_ping_routine, NULL,
-	ping_interval, TIMER_FLAG_DELAY_ON_DELAY)<0) {
+	if ( register_utimer( "dlg-pinger", dlg_ping_routine, NULL,
+	(utime_t)ping_interval*1000000/ping_slots, TIMER_FLAG_DELAY_ON_DELAY)<0) {
 		LM_ERR("failed to register timer 2\n");
 		return -1;
 	}
@@ -846,7 +878,7 @@ static int mod_init(void)
 		return -1;
 	}
 
-	if (init_dlg_ping_timer()!=0) {
+	if (init_dlg_ping_timer(ping_slots)!=0) {
 		LM_ERR("cannot init ping timer\n");
 		return -1;
 	}
@@ -874,6 +906,11 @@ static int mod_init(void)
 		return -1;
 	}
 
+	if (dlg_repl_batch_init() < 0) {
+		LM_ERR("cannot initialize dialog replication batching\n");
+		return -1;
+	}
+
 	/* if a database should be used to store the dialogs' information */
 	if (dlg_db_mode==DB_MODE_NONE) {
 		db_url.s = 0; db_url.len = 0;
@@ -932,6 +969,9 @@ static int child_init(int rank)
 
 static void mod_destroy(void)
 {
+	/* push out the still queued replication events */
+	dlg_repl_batch_flush();
+
 	if (dlg_db_mode != DB_MODE_NONE) {
 		dialog_update_db(0, 0);
 		destroy_dlg_db();
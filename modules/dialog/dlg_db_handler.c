@@ -1254,6 +1254,116 @@ static inline void set_final_update_cols(db_val_t *vals, struct dlg_cell *cell,
 
 
 
+/* sets the full row of a dialog, as inserted by the timer */
+static inline void set_dlg_timer_row(db_val_t *values, struct dlg_cell *cell,
+		int callee_leg, int full_update)
+{
+	int i;
+
+	for (i = 0; i < DIALOG_TABLE_TOTAL_COL_NO; i++)
+		VAL_NULL(values+i) = 0;
+
+	SET_BIGINT_VALUE(values, (((long long)cell->h_entry << 32) |
+					 cell->h_id));
+	SET_STR_VALUE(values+1, cell->callid);
+	SET_STR_VALUE(values+2, cell->from_uri);
+
+	SET_STR_VALUE(values+3, cell->legs[DLG_CALLER_LEG].tag);
+	SET_STR_VALUE(values+4, cell->to_uri);
+	SET_STR_VALUE(values+5, cell->legs[callee_leg].tag);
+
+	SET_STR_VALUE(values+6,
+		cell->legs[DLG_CALLER_LEG].bind_addr->sock_str);
+	if (cell->legs[callee_leg].bind_addr) {
+		SET_STR_VALUE(values+7,
+			cell->legs[callee_leg].bind_addr->sock_str);
+	} else {
+		VAL_NULL(values+7) = 1;
+	}
+
+	SET_INT_VALUE(values+8,  cell->start_ts);
+
+	SET_STR_VALUE(values+9, cell->legs[DLG_CALLER_LEG].route_set);
+	SET_STR_VALUE(values+10,
+		cell->legs[callee_leg].route_set);
+	SET_STR_VALUE(values+11, cell->legs[DLG_CALLER_LEG].contact);
+	SET_STR_VALUE(values+12,
+		cell->legs[callee_leg].contact);
+
+
+	SET_STR_VALUE(values+13,cell->legs[callee_leg].from_uri);
+	SET_STR_VALUE(values+14,cell->legs[callee_leg].to_uri);
+
+	SET_INT_VALUE(values+15, cell->state);
+	SET_INT_VALUE(values+16, (unsigned int)((unsigned int)time(0)
+		+ cell->tl.timeout - get_ticks()) );
+
+	SET_STR_VALUE(values+17, cell->legs[DLG_CALLER_LEG].r_cseq);
+	SET_STR_VALUE(values+18, cell->legs[callee_leg].r_cseq);
+
+	SET_INT_VALUE(values+19, cell->legs[DLG_CALLER_LEG].last_gen_cseq);
+	SET_INT_VALUE(values+20, cell->legs[callee_leg].last_gen_cseq);
+
+	set_final_update_cols(values+21, cell, full_update);
+	SET_INT_VALUE(values+25, cell->flags & ~(DLG_FLAG_NEW|DLG_FLAG_CHANGED|
+		DLG_FLAG_VP_CHANGED|DLG_FLAG_DB_QUEUED));
+}
+
+/* attaches the insert queue of the dialog rows to the DB connection - in
+ * batch mode the queued rows are flushed as replace queries, so the rows
+ * of the changed dialogs are overwritten in place */
+static inline void dlg_set_inslist(query_list_t **ins_list,
+		db_key_t *insert_keys, int batch)
+{
+	if (con_set_inslist(&dialog_dbf,dialog_db_handle,
+	ins_list,insert_keys,DIALOG_TABLE_TOTAL_COL_NO) < 0 )
+		CON_RESET_INSLIST(dialog_db_handle);
+	else if (batch && *ins_list)
+		(*ins_list)->replace = 1;
+}
+
+/* releases the dialogs queued by the current timer run, once the queue
+ * was flushed - if the rows did not make it to the DB, the dialogs are
+ * marked as changed again, to be written by the next run */
+static void dlg_queued_done(int failed)
+{
+	struct dlg_entry *entry;
+	struct dlg_cell *cell;
+	int index;
+
+	for(index = 0; index< d_table->size; index++){
+		entry = &((d_table->entries)[index]);
+		dlg_lock( d_table, entry);
+
+		for(cell = entry->first; cell != NULL; cell = cell->next){
+			if (!(cell->flags & DLG_FLAG_DB_QUEUED))
+				continue;
+			cell->flags &= ~DLG_FLAG_DB_QUEUED;
+
+			if (failed)
+				cell->flags |= DLG_FLAG_CHANGED;
+			else
+				run_dlg_callbacks( DLGCB_SAVED, cell, 0, DLG_DIR_NONE, 0);
+		}
+		dlg_unlock( d_table, entry);
+	}
+}
+
+static inline void dlg_db_flush_stats(struct timeval *start, int rows,
+		int queries)
+{
+	struct timeval end;
+
+	if (!dlg_enable_stats)
+		return;
+
+	gettimeofday(&end, NULL);
+	update_stat(db_flush_time, (end.tv_sec - start->tv_sec) * 1000 +
+		(end.tv_usec - start->tv_usec) / 1000);
+	update_stat(db_flush_rows, rows);
+	update_stat(db_flush_queries, queries);
+}
+
 void dialog_update_db(unsigned int ticks, void * param)
 {
 	static db_ps_t my_ps_update = NULL;
@@ -1265,6 +1375,8 @@ void dialog_update_db(unsigned int ticks, void * param)
 	struct dlg_cell  * cell,*next_cell;
 	unsigned char on_shutdown;
 	int callee_leg,ins_done=0;
+	int batch, queued = 0, failed = 0, rows = 0, queries = 0;
+	struct timeval start;
 	static query_list_t *ins_list = NULL;
 
 	db_key_t insert_keys[DIALOG_TABLE_TOTAL_COL_NO] = {
@@ -1284,6 +1396,13 @@ void dialog_update_db(unsigned int ticks, void * param)
 
 	on_shutdown = (ticks==0);
 
+	gettimeofday(&start, NULL);
+
+	/* the changed dialogs can be written as multi-row replaces only if
+	 * the back-end is able to buffer the inserts and to replace rows */
+	batch = db_flush_batch && query_buffer_size > 1 &&
+		DB_CAPABILITY(dialog_dbf, DB_CAP_MULTIPLE_INSERT|DB_CAP_REPLACE);
+
 	/*save the current dialogs information*/
 	VAL_TYPE(values) = DB_BIGINT;
 	VAL_TYPE(values+8) =
@@ -1329,55 +1448,11 @@ void dialog_update_db(unsigned int ticks, void * param)
 				}
 				LM_DBG("inserting new dialog %p\n",cell);
 
-				SET_BIGINT_VALUE(values, (((long long)cell->h_entry << 32) |
-								 cell->h_id));
-				SET_STR_VALUE(values+1, cell->callid);
-				SET_STR_VALUE(values+2, cell->from_uri);
-
-				SET_STR_VALUE(values+3, cell->legs[DLG_CALLER_LEG].tag);
-				SET_STR_VALUE(values+4, cell->to_uri);
-				SET_STR_VALUE(values+5, cell->legs[callee_leg].tag);
-
-				SET_STR_VALUE(values+6,
-					cell->legs[DLG_CALLER_LEG].bind_addr->sock_str);
-				if (cell->legs[callee_leg].bind_addr) {
-					SET_STR_VALUE(values+7,
-						cell->legs[callee_leg].bind_addr->sock_str);
-				} else {
-					VAL_NULL(values+7) = 1;
-				}
-
-				SET_INT_VALUE(values+8,  cell->start_ts);
-
-				SET_STR_VALUE(values+9, cell->legs[DLG_CALLER_LEG].route_set);
-				SET_STR_VALUE(values+10,
-					cell->legs[callee_leg].route_set);
-				SET_STR_VALUE(values+11, cell->legs[DLG_CALLER_LEG].contact);
-				SET_STR_VALUE(values+12,
-					cell->legs[callee_leg].contact);
-
-
-				SET_STR_VALUE(values+13,cell->legs[callee_leg].from_uri);
-				SET_STR_VALUE(values+14,cell->legs[callee_leg].to_uri);
-
-				SET_INT_VALUE(values+15, cell->state);
-				SET_INT_VALUE(values+16, (unsigned int)((unsigned int)time(0)
-					+ cell->tl.timeout - get_ticks()) );
-
-				SET_STR_VALUE(values+17, cell->legs[DLG_CALLER_LEG].r_cseq);
-				SET_STR_VALUE(values+18, cell->legs[callee_leg].r_cseq);
-
-				SET_INT_VALUE(values+19, cell->legs[DLG_CALLER_LEG].last_gen_cseq);
-				SET_INT_VALUE(values+20, cell->legs[callee_leg].last_gen_cseq);
-
-				set_final_update_cols(values+21, cell,
-					(on_shutdown) || (cell->flags&DLG_FLAG_CHANGED)  );
-				SET_INT_VALUE(values+25, cell->flags & ~(DLG_FLAG_NEW|DLG_FLAG_CHANGED|DLG_FLAG_VP_CHANGED));
+				set_dlg_timer_row(values, cell, callee_leg,
+					(on_shutdown) || (cell->flags&DLG_FLAG_CHANGED));
 
 				CON_PS_REFERENCE(dialog_db_handle) = &my_ps_insert;
-				if (con_set_inslist(&dialog_dbf,dialog_db_handle,
-				&ins_list,insert_keys,DIALOG_TABLE_TOTAL_COL_NO) < 0 )
-					CON_RESET_INSLIST(dialog_db_handle);
+				dlg_set_inslist(&ins_list, insert_keys, batch);
 
 				if((dialog_dbf.insert(dialog_db_handle, insert_keys,
 				values, DIALOG_TABLE_TOTAL_COL_NO)) !=0){
@@ -1387,12 +1462,19 @@ void dialog_update_db(unsigned int ticks, void * param)
 
 				if (ins_done==0)
 					ins_done=1;
-
-				/* dialog saved */
-				run_dlg_callbacks( DLGCB_SAVED, cell, 0, DLG_DIR_NONE, 0);
+				rows++;
 
 				cell->flags &= ~(DLG_FLAG_NEW |DLG_FLAG_CHANGED|DLG_FLAG_VP_CHANGED);
 
+				if (batch) {
+					/* written (replaced) again if the flush fails */
+					cell->flags |= DLG_FLAG_DB_QUEUED;
+					queued++;
+				} else {
+					/* dialog saved */
+					run_dlg_callbacks( DLGCB_SAVED, cell, 0, DLG_DIR_NONE, 0);
+				}
+
 			} else if (cell->state == DLG_STATE_DELETED &&
 					   !(cell->flags & DLG_FLAG_DB_DELETED)) {
 				/* save pointer to next dialog
@@ -1401,6 +1483,31 @@ void dialog_update_db(unsigned int ticks, void * param)
 				dlg_timer_remove_from_db(cell);
 				cell=next_cell;
 				continue;
+			} else if (batch && ((cell->flags & DLG_FLAG_CHANGED)!=0 ||
+			on_shutdown || (db_flush_vp && (cell->flags & DLG_FLAG_VP_CHANGED)))) {
+				/* queue the whole row - it replaces the old one, in bulk
+				 * together with the other changed and new dialogs */
+				LM_DBG("replacing changed dialog %p\n",cell);
+
+				set_dlg_timer_row(values, cell, callee_leg, 1);
+
+				CON_PS_REFERENCE(dialog_db_handle) = &my_ps_insert;
+				dlg_set_inslist(&ins_list, insert_keys, batch);
+
+				if((dialog_dbf.insert(dialog_db_handle, insert_keys,
+				values, DIALOG_TABLE_TOTAL_COL_NO)) !=0){
+					LM_ERR("could not replace dialog %p in db\n", cell);
+					goto error;
+				}
+
+				ins_done = 1;
+				rows++;
+
+				/* any change from now on is written by the next run, the
+				 * flags are restored by dlg_queued_done() on failure */
+				cell->flags &= ~(DLG_FLAG_CHANGED|DLG_FLAG_VP_CHANGED);
+				cell->flags |= DLG_FLAG_DB_QUEUED;
+				queued++;
 			} else if ( (cell->flags & DLG_FLAG_CHANGED)!=0 || on_shutdown ){
 				LM_DBG("updating existing dialog %p\n",cell);
 
@@ -1425,6 +1532,8 @@ void dialog_update_db(unsigned int ticks, void * param)
 					LM_ERR("could not update database info\n");
 					goto error;
 				}
+				rows++;
+				queries++;
 
 				/* dialog saved */
 				run_dlg_callbacks( DLGCB_SAVED, cell, 0, DLG_DIR_NONE, 0);
@@ -1444,6 +1553,8 @@ void dialog_update_db(unsigned int ticks, void * param)
 					LM_ERR("could not update database info\n");
 					goto error;
 				}
+				rows++;
+				queries++;
 
 				run_dlg_callbacks( DLGCB_SAVED, cell, 0, DLG_DIR_NONE, 0);
 
@@ -1460,17 +1571,31 @@ void dialog_update_db(unsigned int ticks, void * param)
 		/* flush everything to DB
 		 * so that next-time timer fires
 		 * we are sure that DB updates will be succesful */
-		if (ql_flush_rows(&dialog_dbf,dialog_db_handle,ins_list) < 0)
+		if (ql_flush_rows(&dialog_dbf,dialog_db_handle,ins_list) < 0) {
 			LM_ERR("failed to flush rows to DB\n");
+			failed = 1;
+		}
+		/* all the rows not written by UPDATEs went out in batches */
+		queries += (rows - queries + query_buffer_size - 1) /
+			query_buffer_size;
 	}
 
+	if (queued)
+		dlg_queued_done(failed);
 
+	dlg_db_flush_stats(&start, rows, queries);
 
 	dlg_timer_flush_del();
 	return;
 
 error:
 	dlg_unlock( d_table, entry);
+	/* the rows queued so far may still be written, but the dialogs are
+	 * marked as changed again anyway - replacing a row is idempotent */
+	if (ins_done && ql_flush_rows(&dialog_dbf,dialog_db_handle,ins_list) < 0)
+		LM_ERR("failed to flush rows to DB\n");
+	if (queued)
+		dlg_queued_done(1);
 	dlg_timer_flush_del();
 }
 
@@ -28,6 +28,7 @@
 
 #include "../../str.h"
 #include "../../db/db.h"
+#include "../../statistics.h"
 
 #define DLG_ID_COL				"dlg_id"
 #define CALL_ID_COL				"callid"
@@ -99,6 +100,11 @@ extern str th_column;
 extern str dialog_table_name;
 extern int dlg_db_mode;
 extern int db_flush_vp;
+extern int db_flush_batch;
+extern int dlg_enable_stats;
+extern stat_var *db_flush_time;
+extern stat_var *db_flush_rows;
+extern stat_var *db_flush_queries;
 
 
 #define should_remove_dlg_db() (dlg_db_mode==DB_MODE_REALTIME)
@@ -294,7 +294,8 @@ struct dlg_cell* build_new_dlg( str *callid, str *from_uri, str *to_uri,
 	memset( dlg, 0, len);
 	dlg->state = DLG_STATE_UNCONFIRMED;
 
-	dlg->h_entry = dlg_hash( callid);
+	dlg->callid_hash = dlg_callid_hash( callid);
+	dlg->h_entry = dlg_hash_entry( dlg->callid_hash);
 
 	LM_DBG("new dialog %p (c=%.*s,f=%.*s,t=%.*s,ft=%.*s) on hash %u\n",
 		dlg, callid->len,callid->s, from_uri->len, from_uri->s,
@@ -613,9 +614,11 @@ struct dlg_cell* get_dlg( str *callid, str *ftag, str *ttag,
 {
 	struct dlg_cell *dlg;
 	struct dlg_entry *d_entry;
-	unsigned int h_entry;
+	unsigned int h_entry, h;
+	int probes = 0, collisions = 0;
 
-	h_entry = dlg_hash(callid);
+	h = dlg_callid_hash(callid);
+	h_entry = dlg_hash_entry(h);
 	d_entry = &(d_table->entries[h_entry]);
 
 	dlg_lock( d_table, d_entry);
@@ -638,6 +641,15 @@ struct dlg_cell* get_dlg( str *callid, str *ftag, str *ttag,
 			dlg->legs[DLG_CALLER_LEG].contact.len,
 				dlg->legs[DLG_CALLER_LEG].contact.len);
 #endif
+		/* cheap pre-check, before comparing any string */
+		if (dlg->callid_hash != h)
+			continue;
+		probes++;
+		if (dlg->callid.len != callid->len ||
+		memcmp(dlg->callid.s, callid->s, callid->len) != 0) {
+			collisions++;
+			continue;
+		}
 		if (match_dialog( dlg, callid, ftag, ttag, dir, dst_leg)==1) {
 			if (dlg->state==DLG_STATE_DELETED)
 				/* even if matched, skip the deleted dialogs as they may be
@@ -650,11 +662,13 @@ struct dlg_cell* get_dlg( str *callid, str *ftag, str *ttag,
 			dlg_unlock( d_table, d_entry);
 			LM_DBG("dialog callid='%.*s' found\n on entry %u, dir=%d\n",
 				callid->len, callid->s,h_entry,*dir);
+			dlg_lookup_stats(probes, collisions);
 			return dlg;
 		}
 	}
 
 	dlg_unlock( d_table, d_entry);
+	dlg_lookup_stats(probes, collisions);
 
 	LM_DBG("no dialog callid='%.*s' found\n", callid->len, callid->s);
 	return 0;
@@ -1336,7 +1350,7 @@ static inline struct mi_root* process_mi_params(struct mi_root *cmd_tree,
 	struct dlg_cell *dlg;
 	str *p1;
 	str *p2;
-	unsigned int h_entry;
+	unsigned int h_entry, h;
 
 	node = cmd_tree->node.kids;
 	if (node == NULL) {
@@ -1372,12 +1386,15 @@ static inline struct mi_root* process_mi_params(struct mi_root *cmd_tree,
         if (!p1->s)
                 return init_mi_tree( 400, "Invalid Call-ID specified", 25);
 
-	h_entry = dlg_hash( p1/*callid*/ );
+	h = dlg_callid_hash( p1/*callid*/ );
+	h_entry = dlg_hash_entry( h );
 
 	d_entry = &(d_table->entries[h_entry]);
 	dlg_lock( d_table, d_entry);
 
 	for( dlg = d_entry->first ; dlg ; dlg = dlg->next ) {
+		if (dlg->callid_hash != h)
+			continue;
 		if (match_downstream_dialog( dlg, p1/*callid*/, p2/*from_tag*/)==1) {
 			if (dlg->state==DLG_STATE_DELETED) {
 				*dlg_p = NULL;
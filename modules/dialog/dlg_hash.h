@@ -42,6 +42,7 @@
 #include "../../locking.h"
 #include "../../context.h"
 #include "../../mi/mi.h"
+#include "../../statistics.h"
 #include "dlg_timer.h"
 #include "dlg_cb.h"
 #include "dlg_vals.h"
@@ -72,6 +73,7 @@
 #define DLG_FLAG_TOPHIDING		(1<<7)
 #define DLG_FLAG_VP_CHANGED		(1<<8)
 #define DLG_FLAG_DB_DELETED		(1<<9)
+#define DLG_FLAG_DB_QUEUED		(1<<10)
 
 #define DLG_CALLER_LEG         0
 #define DLG_FIRST_CALLEE_LEG   1
@@ -118,6 +120,8 @@ struct dlg_cell
 	struct dlg_cell      *prev;
 	unsigned int         h_id;
 	unsigned int         h_entry;
+	unsigned int         callid_hash; /* full hash of the callid, h_entry
+	                                   * being its masked value */
 	unsigned int         state;
 	unsigned int         lifetime;
 	unsigned int         lifetime_dirty; /* 1 if lifetime timer should be updated */
@@ -178,6 +182,27 @@ extern int ctx_dlg_idx;
 struct dlg_cell *get_current_dialog();
 
 #define dlg_hash(_callid) core_hash(_callid, 0, d_table->size)
+#define dlg_callid_hash(_callid) core_hash(_callid, 0, 0)
+#define dlg_hash_entry(_h) ((_h) & (d_table->size - 1))
+
+extern int dlg_enable_stats;
+extern stat_var *callid_lookups;
+extern stat_var *callid_probes;
+extern stat_var *callid_collisions;
+
+/* accounts a Call-ID based lookup: @probes dialogs had the same callid
+ * hash, out of which @collisions had a different callid */
+static inline void dlg_lookup_stats(int probes, int collisions)
+{
+	if (!dlg_enable_stats)
+		return;
+
+	update_stat(callid_lookups, 1);
+	if (probes)
+		update_stat(callid_probes, probes);
+	if (collisions)
+		update_stat(callid_collisions, collisions);
+}
 
 #define dlg_lock(_table, _entry) \
 		lock_set_get( (_table)->locks, (_entry)->lock_idx);
@@ -585,11 +585,14 @@ void destroy_linkers(struct dlg_profile_link *linker, char is_replicated)
 						/* XXX: we should queue these */
 						repl_prof_remove(&l->profile->name, &l->value);
 						map_remove(entry,l->value );
+						dlg_prof_count_add(l->profile->values_no, -1);
 					}
 				}
 			}
-			else
+			else {
 				l->profile->counts[l->hash_idx]--;
+				dlg_prof_count_add(l->profile->noval_count, -1);
+			}
 
 			lock_set_release( l->profile->locks, l->hash_idx  );
 		} else if (!is_replicated) {
@@ -685,12 +688,17 @@ static void link_dlg_profile(struct dlg_profile_link *linker,
 		{
 			p_entry = linker->profile->entries[hash];
 			dest = map_get( p_entry, linker->value );
+			/* a new value has just been added to the map */
+			if (*dest == NULL)
+				dlg_prof_count_add(linker->profile->values_no, 1);
 			/* if we accept replicated stuff, we have to allocate the
 			 * structure for it and treat the counter differently */
 			repl_prof_inc(dest);
 		}
-		else
+		else {
 			linker->profile->counts[hash]++;
+			dlg_prof_count_add(linker->profile->noval_count, 1);
+		}
 
 		lock_set_release( linker->profile->locks,hash );
 	} else if (!is_replicated) {
@@ -876,20 +884,10 @@ unsigned int get_profile_size(struct dlg_profile_table *profile, str *value)
 			}
 
 		} else {
-
-			for( i=0; i<profile->size; i++ )
-			{
-
-				lock_set_get( profile->locks, i);
-
-				n += profile->counts[i];
-
-				lock_set_release( profile->locks, i);
-
-			}
-
+			n = dlg_prof_count_get(profile->noval_count);
 		}
-		n += replicate_profiles_count(profile->repl);
+		if (profile->repl)
+			n += dlg_prof_count_get(profile->repl->total);
 
 	} else {
 
@@ -905,17 +903,7 @@ unsigned int get_profile_size(struct dlg_profile_table *profile, str *value)
 				}
 
 			} else {
-
-				for( i=0; i<profile->size; i++ )
-				{
-
-					lock_set_get( profile->locks, i);
-
-					n += map_size(profile->entries[i]);
-
-					lock_set_release( profile->locks, i);
-
-				}
+				n = dlg_prof_count_get(profile->values_no);
 			}
 
 
@@ -1114,14 +1102,7 @@ struct mi_root * mi_get_profile_values(struct mi_root *cmd_tree, void *param )
 	}
 	else
 	{
-		n = 0;
-
-		for( i=0; i<profile->size; i++ )
-		{
-			lock_set_get( profile->locks, i);
-			n += profile->counts[i];
-			lock_set_release( profile->locks, i);
-		}
+		n = dlg_prof_count_get(profile->noval_count);
 
 		tmp.s = "WITHOUT VALUE";
 		tmp.len = sizeof("WITHOUT VALUE")-1;
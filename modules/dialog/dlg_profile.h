@@ -75,6 +75,15 @@ struct dlg_profile_table {
 
 	int * counts;
 
+	/*
+	 * aggregated sizes, maintained on link/unlink so that size queries
+	 * do not have to walk (and lock) all the buckets: the sum of all the
+	 * counts[] for profiles without values, respectively the number of
+	 * distinct values for profiles with values
+	 */
+	volatile int noval_count;
+	volatile int values_no;
+
 	/*
 	 * information used for profile replication without values
 	 */
@@ -83,6 +92,11 @@ struct dlg_profile_table {
 	struct dlg_profile_table *next;
 };
 
+#define dlg_prof_count_add(_cnt, _val) \
+	__sync_fetch_and_add(&(_cnt), (_val))
+#define dlg_prof_count_get(_cnt) \
+	__sync_fetch_and_add(&(_cnt), 0)
+
 typedef int (*set_dlg_profile_f)(struct dlg_cell *dlg, str *value,
                         struct dlg_profile_table *profile, char is_replicated);
 
@@ -39,6 +39,9 @@ typedef struct repl_prof_count {
 
 typedef struct repl_prof_novalue {
 	gen_lock_t lock;
+	/* sum of the dsts[] counters, kept in sync under the lock but
+	 * readable without it */
+	volatile int total;
 	struct repl_prof_count dsts[0];
 } repl_prof_novalue_t;
 
@@ -32,6 +32,7 @@
 #include "dlg_repl_profile.h"
 
 #include "../../resolve.h"
+#include "../../repl_batch.h"
 
 extern int active_dlgs_cnt;
 extern int early_dlgs_cnt;
@@ -49,6 +50,7 @@ extern stat_var *update_recv;
 extern stat_var *delete_recv;
 
 static void dlg_replicated_profiles(struct receive_info *ri);
+static void dlg_repl_send(int type);
 
 static struct socket_info * fetch_socket_info(str *addr)
 {
@@ -444,7 +446,6 @@ int dlg_replicated_delete(void)
  */
 void replicate_dialog_created(struct dlg_cell *dlg)
 {
-	struct replication_dest *d;
 	static str module_name = str_init("dialog");
 	int callee_leg;
 	str *vars, *profiles;
@@ -495,8 +496,7 @@ void replicate_dialog_created(struct dlg_cell *dlg)
 	bin_push_int(dlg->legs[DLG_CALLER_LEG].last_gen_cseq);
 	bin_push_int(dlg->legs[callee_leg].last_gen_cseq);
 
-	for (d = replication_dests; d; d = d->next)
-		bin_send(&d->to);
+	dlg_repl_send(REPLICATION_DLG_CREATED);
 
 	if_update_stat(dlg_enable_stats,create_sent,1);
 	return;
@@ -511,7 +511,6 @@ error:
  */
 void replicate_dialog_updated(struct dlg_cell *dlg)
 {
-	struct replication_dest *d;
 	static str module_name = str_init("dialog");
 	int callee_leg;
 	str *vars, *profiles;
@@ -562,8 +561,7 @@ void replicate_dialog_updated(struct dlg_cell *dlg)
 	bin_push_int(dlg->legs[DLG_CALLER_LEG].last_gen_cseq);
 	bin_push_int(dlg->legs[callee_leg].last_gen_cseq);
 
-	for (d = replication_dests; d; d = d->next)
-		bin_send(&d->to);
+	dlg_repl_send(REPLICATION_DLG_UPDATED);
 
 	if_update_stat(dlg_enable_stats,update_sent,1);
 	return;
@@ -578,7 +576,6 @@ error:
  */
 void replicate_dialog_deleted(struct dlg_cell *dlg)
 {
-	struct replication_dest *d;
 	static str module_name = str_init("dialog");
 
 	if (bin_init(&module_name, REPLICATION_DLG_DELETED) != 0)
@@ -588,8 +585,7 @@ void replicate_dialog_deleted(struct dlg_cell *dlg)
 	bin_push_str(&dlg->legs[DLG_CALLER_LEG].tag);
 	bin_push_str(&dlg->legs[callee_idx(dlg)].tag);
 
-	for (d = replication_dests; d; d = d->next)
-		bin_send(&d->to);
+	dlg_repl_send(REPLICATION_DLG_DELETED);
 
 	if_update_stat(dlg_enable_stats,delete_sent,1);
 	return;
@@ -598,29 +594,169 @@ error:
 }
 
 /**
- * receive_binary_packet (callback) - receives a cmd_type, specifying the
- * purpose of the data encoded in the received UDP packet
+ * Batched replication: the events are coalesced by the core replication
+ * batch into frames which are sent to all the destinations when they get
+ * full or when their oldest event exceeds 'replicate_dialogs_batch_window'
+ *
+ * Frame body: flags, raw length, number of events and the (optionally
+ * compressed) events, each one as LEN | TYPE | <event fields>
  */
-void receive_binary_packet(int packet_type, struct receive_info *ri)
+
+int dlg_repl_batch_size = 0;
+int dlg_repl_batch_window = 10;
+int dlg_repl_compress = 0;
+
+static struct repl_batch *repl_batch;
+
+static void dlg_repl_send_frame(struct repl_frame *f);
+static void dlg_repl_send_event(void);
+
+int dlg_repl_batch_init(void)
 {
-	int rc;
-	char *ip;
-	unsigned short port;
+	struct replication_dest *d;
 
-	LM_DBG("Received a binary packet!\n");
+	for (d = replication_dests; d; d = d->next) {
+		d->stats = shm_malloc(sizeof *d->stats);
+		if (!d->stats) {
+			LM_ERR("no more shm memory for replication stats\n");
+			return -1;
+		}
+		memset(d->stats, 0, sizeof *d->stats);
+	}
 
-	if (accept_repl_profiles && packet_type == REPLICATION_DLG_PROFILE) {
-		/* TODO: handle this */
-		dlg_replicated_profiles(ri);
+	if (!replication_dests || dlg_repl_batch_size <= 0)
+		return 0;
+
+	repl_batch = repl_batch_new("dialog-repl-batch", dlg_repl_batch_size,
+		dlg_repl_batch_window, dlg_repl_compress, dlg_repl_send_frame,
+		dlg_repl_send_event);
+
+	return repl_batch ? 0 : -1;
+}
+
+static inline void dlg_repl_dst_update(struct replication_dest *d, int rc,
+		int events, int len, unsigned long delay)
+{
+	unsigned long max;
+
+	if (!d->stats)
+		return;
+
+	if (rc < 0) {
+		__sync_fetch_and_add(&d->stats->errors, 1);
 		return;
 	}
-	if (!accept_replicated_dlg) {
-		get_su_info(&ri->src_su.s, ip, port);
-		LM_WARN("Unwanted dialog packet received from %s:%hu (type=%d)\n",
-				ip, port, packet_type);
+
+	__sync_fetch_and_add(&d->stats->frames, 1);
+	__sync_fetch_and_add(&d->stats->events, events);
+	__sync_fetch_and_add(&d->stats->bytes, len);
+	__sync_fetch_and_add(&d->stats->total_delay, delay * events);
+
+	max = d->stats->max_delay;
+	while (delay > max &&
+			!__sync_bool_compare_and_swap(&d->stats->max_delay, max, delay))
+		max = d->stats->max_delay;
+}
+
+static void dlg_repl_send_frame(struct repl_frame *f)
+{
+	static str module_name = str_init("dialog");
+	struct replication_dest *d;
+	unsigned long delay;
+	int rc;
+
+	if (bin_init(&module_name, REPLICATION_DLG_BATCH) != 0 ||
+			bin_push_int(f->flags) < 0 || bin_push_int(f->raw_len) < 0 ||
+			bin_push_int(f->events) < 0 || bin_push_str(&f->data) < 0) {
+		LM_ERR("failed to build replication frame (%d events lost)\n",
+			f->events);
 		return;
 	}
 
+	delay = get_uticks() - f->first;
+
+	for (d = replication_dests; d; d = d->next) {
+		rc = bin_send(&d->to);
+		dlg_repl_dst_update(d, rc, f->events, rc, delay);
+	}
+}
+
+/* sends the event currently built in the bin buffer, unbatched */
+static void dlg_repl_send_event(void)
+{
+	struct replication_dest *d;
+	int rc;
+
+	for (d = replication_dests; d; d = d->next) {
+		rc = bin_send(&d->to);
+		dlg_repl_dst_update(d, rc, 1, rc, 0);
+	}
+}
+
+/**
+ * sends the event currently built in the bin buffer to all the
+ * replication destinations, or queues it in the current batch
+ */
+static void dlg_repl_send(int type)
+{
+	if (repl_batch)
+		repl_batch_queue(repl_batch, type);
+	else
+		dlg_repl_send_event();
+}
+
+void dlg_repl_batch_flush(void)
+{
+	repl_batch_flush(repl_batch);
+}
+
+struct mi_root *mi_dlg_repl_status(struct mi_root *cmd_tree, void *param)
+{
+	struct mi_root *rpl_tree;
+	struct mi_node *node;
+	struct replication_dest *d;
+	struct dlg_repl_dst_stats *st;
+	unsigned short port;
+	char *ip;
+
+	rpl_tree = init_mi_tree(200, MI_OK_S, MI_OK_LEN);
+	if (rpl_tree==0)
+		return 0;
+	rpl_tree->node.flags |= MI_IS_ARRAY;
+
+	if (repl_batch && (!addf_mi_node_child(&rpl_tree->node, 0, "Queue", 5,
+			"%d events, %d bytes", repl_batch->events, repl_batch->len)))
+		goto error;
+
+	for (d = replication_dests; d; d = d->next) {
+		if (!(st = d->stats))
+			continue;
+		get_su_info(&d->to.s, ip, port);
+		node = addf_mi_node_child(&rpl_tree->node, 0, "Destination", 11,
+				"%s:%hu", ip, port);
+		if (!node)
+			goto error;
+		if (!addf_mi_attr(node, 0, "frames", 6, "%lu", st->frames) ||
+		!addf_mi_attr(node, 0, "events", 6, "%lu", st->events) ||
+		!addf_mi_attr(node, 0, "bytes", 5, "%lu", st->bytes) ||
+		!addf_mi_attr(node, 0, "errors", 6, "%lu", st->errors) ||
+		!addf_mi_attr(node, 0, "avg_delay", 9, "%lu",
+			st->events ? st->total_delay / st->events : 0) ||
+		!addf_mi_attr(node, 0, "max_delay", 9, "%lu", st->max_delay))
+			goto error;
+	}
+
+	return rpl_tree;
+error:
+	free_mi_tree(rpl_tree);
+	return 0;
+}
+
+static int dlg_replicated_event(int packet_type, struct receive_info *ri)
+{
+	int rc;
+	char *ip;
+	unsigned short port;
 
 	switch (packet_type) {
 	case REPLICATION_DLG_CREATED:
@@ -645,6 +781,79 @@ void receive_binary_packet(int packet_type, struct receive_info *ri)
 				packet_type, ip, port);
 	}
 
+	return rc;
+}
+
+/**
+ * processes, one by one, the events carried by a batched frame
+ */
+static int dlg_replicated_batch(struct receive_info *ri)
+{
+	int flags, raw_len, events, type, rc = 0, n;
+	char *p, *end, *pos, *rcv_end;
+	str data, ev;
+
+	if (bin_pop_int(&flags) != 0 || bin_pop_int(&raw_len) != 0 ||
+			bin_pop_int(&events) != 0 || bin_pop_str(&data) != 0) {
+		LM_ERR("malformed dialog replication frame\n");
+		return -1;
+	}
+
+	if (repl_frame_unpack(flags, raw_len, &data) != 0)
+		return -1;
+
+	LM_DBG("received a frame of %d dialog events\n", events);
+
+	bin_get_rcv_pos(&pos, &rcv_end);
+
+	for (p = data.s, end = data.s + data.len;
+			(n = repl_frame_next(&p, end, &ev)) != 0;) {
+		if (n < 0) {
+			rc = -1;
+			break;
+		}
+
+		/* each event is popped as if it was received on its own */
+		bin_set_rcv_pos(ev.s, ev.s + ev.len);
+		bin_pop_int(&type);
+		if (dlg_replicated_event(type, ri) != 0)
+			rc = -1;
+	}
+
+	bin_set_rcv_pos(pos, rcv_end);
+	return rc;
+}
+
+/**
+ * receive_binary_packet (callback) - receives a cmd_type, specifying the
+ * purpose of the data encoded in the received UDP packet
+ */
+void receive_binary_packet(int packet_type, struct receive_info *ri)
+{
+	int rc;
+	char *ip;
+	unsigned short port;
+
+	LM_DBG("Received a binary packet!\n");
+
+	if (accept_repl_profiles && packet_type == REPLICATION_DLG_PROFILE) {
+		/* TODO: handle this */
+		dlg_replicated_profiles(ri);
+		return;
+	}
+	if (!accept_replicated_dlg) {
+		get_su_info(&ri->src_su.s, ip, port);
+		LM_WARN("Unwanted dialog packet received from %s:%hu (type=%d)\n",
+				ip, port, packet_type);
+		return;
+	}
+
+
+	if (packet_type == REPLICATION_DLG_BATCH)
+		rc = dlg_replicated_batch(ri);
+	else
+		rc = dlg_replicated_event(packet_type, ri);
+
 	if (rc != 0)
 		LM_ERR("Failed to process a binary packet!\n");
 }
@@ -864,6 +1073,8 @@ static void dlg_replicated_profiles(struct receive_info *ri)
 		if (profile) {
 			if (!profile->has_value) {
 				lock_get(&profile->repl->lock);
+				dlg_prof_count_add(profile->repl->total,
+						counter - profile->repl->dsts[index].counter);
 				profile->repl->dsts[index].counter = counter;
 				profile->repl->dsts[index].update = now;
 				lock_release(&profile->repl->lock);
@@ -887,13 +1098,16 @@ static void dlg_replicated_profiles(struct receive_info *ri)
 					}
 					memset(rp, 0, sizeof(repl_prof_value_t));
 					*dst = rp;
+					dlg_prof_count_add(profile->values_no, 1);
 				} else {
 					rp = (repl_prof_value_t *)*dst;
 				}
 				if (!rp->noval)
 					rp->noval = repl_prof_allocate();
 				if (rp->noval) {
-					lock_release(&rp->noval->lock);
+					lock_get(&rp->noval->lock);
+					dlg_prof_count_add(rp->noval->total,
+							counter - rp->noval->dsts[index].counter);
 					rp->noval->dsts[index].counter = counter;
 					rp->noval->dsts[index].update = now;
 					lock_release(&rp->noval->lock);
@@ -955,8 +1169,11 @@ int replicate_profiles_count(repl_prof_novalue_t *rp)
 	lock_get(&rp->lock);
 	for (i = 0; i < repl_prof_dests_nr; i++) {
 		/* if the replication expired, reset its counter */
-		if ((rp->dsts[i].update + repl_prof_timer_expire) < now)
+		if ((rp->dsts[i].update + repl_prof_timer_expire) < now &&
+				rp->dsts[i].counter) {
+			dlg_prof_count_add(rp->total, -rp->dsts[i].counter);
 			rp->dsts[i].counter = 0;
+		}
 		counter += rp->dsts[i].counter;
 	}
 	lock_release(&rp->lock);
@@ -973,8 +1190,13 @@ static void repl_prof_timer_f(unsigned int ticks, void *param)
 	int i;
 
 	for (profile = profiles; profile; profile = profile->next) {
-		if (!profile->has_value)
+		if (!profile->has_value) {
+			/* the size queries only read the aggregated counter, so
+			 * the expired destinations have to be dropped from here */
+			if (profile->repl)
+				replicate_profiles_count(profile->repl);
 			continue;
+		}
 		for (i = 0; i < profile->size; i++) {
 			lock_set_get(profile->locks, i);
 			if (map_first(profile->entries[i], &it) < 0) {
@@ -993,6 +1215,7 @@ static void repl_prof_timer_f(unsigned int ticks, void *param)
 					if (iterator_next(&it) < 0)
 						LM_DBG("cannot find next iterator\n");
 					rp = (repl_prof_value_t *)iterator_delete(&del);
+					dlg_prof_count_add(profile->values_no, -1);
 					if (rp) {
 						if (rp->noval)
 							shm_free(rp->noval);
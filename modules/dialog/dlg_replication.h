@@ -28,6 +28,7 @@
 #include "../../bin_interface.h"
 #include "../../socket_info.h"
 #include "../../timer.h"
+#include "../../mi/mi.h"
 
 #ifndef _DIALOG_DLG_REPLICATION_H_
 #define _DIALOG_DLG_REPLICATION_H_
@@ -35,15 +36,36 @@
 #define REPLICATION_DLG_CREATED		1
 #define REPLICATION_DLG_UPDATED		2
 #define REPLICATION_DLG_DELETED		3
+/* 4 is used by the profiles replication */
+#define REPLICATION_DLG_BATCH		5
 
 extern int accept_replicated_dlg;
 extern struct replication_dest *replication_dests;
+extern int dlg_repl_batch_size;
+extern int dlg_repl_batch_window;
+extern int dlg_repl_compress;
+
+/* per destination counters, in shared memory */
+struct dlg_repl_dst_stats {
+	unsigned long frames;
+	unsigned long events;
+	unsigned long bytes;
+	unsigned long errors;
+	/* time spent by the events in the batch queue, in microseconds */
+	unsigned long total_delay;
+	unsigned long max_delay;
+};
 
 struct replication_dest {
 	union sockaddr_union to;
+	struct dlg_repl_dst_stats *stats;
 	struct replication_dest *next;
 };
 
+int dlg_repl_batch_init(void);
+void dlg_repl_batch_flush(void);
+struct mi_root *mi_dlg_repl_status(struct mi_root *cmd_tree, void *param);
+
 void replicate_dialog_created(struct dlg_cell *dlg);
 void replicate_dialog_updated(struct dlg_cell *dlg);
 void replicate_dialog_deleted(struct dlg_cell *dlg);
@@ -25,6 +25,9 @@
  */
 
 
+#include <stdlib.h>
+
+#include "../../mem/mem.h"
 #include "../../mem/shm_mem.h"
 #include "../../timer.h"
 #include "dlg_timer.h"
@@ -37,6 +40,10 @@ dlg_timer_handler timer_hdl = 0;
 struct dlg_ping_timer *ping_timer=0;
 str options_str=str_init("OPTIONS");
 
+/* dialogs to be pinged in the current slot - used only by the pinger */
+static struct dlg_cell **ping_batch = NULL;
+static unsigned int ping_batch_size = 0;
+
 /* for the dlg timer, there are 3 possible states :
  * prev=next=0 -> dialog not in timer list
  * prev=0 -> dialog expired
@@ -144,15 +151,20 @@ void debug_main_timer_list(void)
 
 #endif
 
-int init_dlg_ping_timer(void)
+int init_dlg_ping_timer(unsigned int slots)
 {
-	ping_timer = (struct dlg_ping_timer*)shm_malloc(sizeof(struct dlg_timer));
+	ping_timer = (struct dlg_ping_timer*)shm_malloc(
+		sizeof(struct dlg_ping_timer) + slots*sizeof(struct dlg_ping_list*));
 	if (ping_timer==0) {
 		LM_ERR("no more shm mem\n");
 		return -1;
 	}
 
-	memset(ping_timer,0,sizeof(struct dlg_ping_timer));
+	memset(ping_timer,0,sizeof(struct dlg_ping_timer) +
+		slots*sizeof(struct dlg_ping_list*));
+	ping_timer->slots = (struct dlg_ping_list**)(ping_timer+1);
+	ping_timer->slots_no = slots;
+
 	ping_timer->lock = lock_alloc();
 	if (ping_timer->lock == 0) {
 		LM_ERR("failed to alloc lock\n");
@@ -257,17 +269,21 @@ int insert_ping_timer(struct dlg_cell* dlg)
 	node->dlg = dlg;
 	node->next = 0;
 	node->prev = 0;
+	/* the Call-ID hash spreads the dialogs evenly over the slots, while
+	 * the random part keeps the nodes sharing the same dialogs from
+	 * pinging them in sync */
+	node->slot = (dlg->callid_hash + rand()) % ping_timer->slots_no;
 
 	lock_get( ping_timer->lock );
 
 	dlg->pl = node;
 
-	if (ping_timer->first == 0)
-		ping_timer->first = node;
+	if (ping_timer->slots[node->slot] == 0)
+		ping_timer->slots[node->slot] = node;
 	else {
-		node->next = ping_timer->first;
-		ping_timer->first->prev = node;
-		ping_timer->first = node;
+		node->next = ping_timer->slots[node->slot];
+		ping_timer->slots[node->slot]->prev = node;
+		ping_timer->slots[node->slot] = node;
 	}
 
 	dlg->legs[DLG_CALLER_LEG].reply_received = 1;
@@ -338,13 +354,13 @@ static inline void detach_node_unsafe(struct dlg_ping_list *it)
 	}
 	else if (it->next) {
 		it->next->prev = 0;
-		ping_timer->first = it->next;
+		ping_timer->slots[it->slot] = it->next;
 	}
 	else if (it->prev) {
 		it->prev->next = 0;
 	}
 	else
-		ping_timer->first = 0;
+		ping_timer->slots[it->slot] = 0;
 
 	it->next = it->prev = 0;
 }
@@ -468,18 +484,40 @@ void dlg_timer_routine(unsigned int ticks , void * attr)
 	}
 }
 
-/* removes expired dlgs from main ping_timer list
- * and links them back into a new list */
-void get_timeout_dlgs(struct dlg_ping_list **expired,
-					struct dlg_ping_list **to_be_deleted)
+static inline int ping_batch_add(struct dlg_cell *dlg, unsigned int n)
+{
+	struct dlg_cell **batch;
+	unsigned int size;
+
+	if (n == ping_batch_size) {
+		size = ping_batch_size ? 2 * ping_batch_size : 64;
+		batch = pkg_realloc(ping_batch, size * sizeof(struct dlg_cell*));
+		if (!batch) {
+			LM_ERR("no more pkg mem - dialog %p not pinged this time\n", dlg);
+			return -1;
+		}
+		ping_batch = batch;
+		ping_batch_size = size;
+	}
+
+	ping_batch[n] = dlg;
+	return 0;
+}
+
+/* removes the expired dlgs of a ping slot from the ping_timer list and
+ * links them back into a new list; the dialogs still alive are gathered
+ * in the ping batch, returning their number */
+unsigned int get_timeout_dlgs(unsigned int slot,
+		struct dlg_ping_list **expired, struct dlg_ping_list **to_be_deleted)
 {
 	struct dlg_ping_list *exp = NULL,*del=NULL,*it=NULL,*next=NULL;
 	struct dlg_cell *current;
+	unsigned int n = 0;
 	int detached;
 
 	lock_get(ping_timer->lock);
 
-	for (it=ping_timer->first;it;it=next) {
+	for (it=ping_timer->slots[slot];it;it=next) {
 		current = it->dlg;
 		next = it->next;
 		detached = 0;
@@ -527,15 +565,23 @@ void get_timeout_dlgs(struct dlg_ping_list **expired,
 						it->next = exp;
 						exp = it;
 					}
+					detached = 1;
 				}
 			}
 		}
+
+		/* the list keeps its reference until the pinger itself detaches
+		 * the node, so the dialog can be safely used outside the lock */
+		if (detached == 0 && ping_batch_add(current, n) == 0)
+			n++;
 	}
 
 	lock_release(ping_timer->lock);
 
 	*to_be_deleted = del;
 	*expired = exp;
+
+	return n;
 }
 
 void reply_from_caller(struct cell* t, int type, struct tmcb_params* ps)
@@ -636,12 +682,17 @@ void unref_dlg_cb(void *dlg)
 	unref_dlg((struct dlg_cell*)dlg,1);
 }
 
-void dlg_ping_routine(unsigned int ticks , void * attr)
+void dlg_ping_routine(utime_t ticks , void * attr)
 {
 	struct dlg_ping_list *expired,*to_be_deleted,*it,*curr;
 	struct dlg_cell *dlg;
+	unsigned int slot, n, i;
+
+	/* only the pinger moves the current slot */
+	slot = ping_timer->curr;
+	ping_timer->curr = (slot + 1) % ping_timer->slots_no;
 
-	get_timeout_dlgs(&expired,&to_be_deleted);
+	n = get_timeout_dlgs(slot, &expired, &to_be_deleted);
 
 	it = expired;
 	while (it) {
@@ -672,36 +723,39 @@ void dlg_ping_routine(unsigned int ticks , void * attr)
 		it = curr;
 	}
 
+	if (n == 0)
+		return;
+
+	LM_DBG("pinging %u dialogs from slot %u\n", n, slot);
+
 	tcp_no_new_conn = 1;
 
-	/* ping_timer->first now contains all active dialogs */
-	it = ping_timer->first;
-	while (it) {
-		dlg = it->dlg;
+	/* the batch now contains all active dialogs of this slot */
+	for (i = 0; i < n; i++) {
+		dlg = ping_batch[i];
 
-		/* do not ping ended dialogs - we might have missed them earlier or
-		 * might have terminated in the mean time - we'll clean them up on
-		 * our next iteration */
-		if (dlg->state != DLG_STATE_DELETED) {
-			if (dlg->flags & DLG_FLAG_PING_CALLER) {
-				ref_dlg(dlg,1);
-				if (send_leg_msg(dlg,&options_str,callee_idx(dlg),
-				DLG_CALLER_LEG,0,0,reply_from_caller,dlg,unref_dlg_cb) < 0) {
-					LM_ERR("failed to ping caller\n");
-					unref_dlg(dlg,1);
-				}
+		/* do not ping ended dialogs - they might have terminated in the
+		 * mean time - we'll clean them up on the next run of their slot */
+		if (dlg->state == DLG_STATE_DELETED)
+			continue;
+
+		if (dlg->flags & DLG_FLAG_PING_CALLER) {
+			ref_dlg(dlg,1);
+			if (send_leg_msg(dlg,&options_str,callee_idx(dlg),
+			DLG_CALLER_LEG,0,0,reply_from_caller,dlg,unref_dlg_cb) < 0) {
+				LM_ERR("failed to ping caller\n");
+				unref_dlg(dlg,1);
 			}
+		}
 
-			if (dlg->flags & DLG_FLAG_PING_CALLEE) {
-				ref_dlg(dlg,1);
-				if (send_leg_msg(dlg,&options_str,DLG_CALLER_LEG,
-				callee_idx(dlg),0,0,reply_from_callee,dlg,unref_dlg_cb) < 0) {
-					LM_ERR("failed to ping callee\n");
-					unref_dlg(dlg,1);
-				}
+		if (dlg->flags & DLG_FLAG_PING_CALLEE) {
+			ref_dlg(dlg,1);
+			if (send_leg_msg(dlg,&options_str,DLG_CALLER_LEG,
+			callee_idx(dlg),0,0,reply_from_callee,dlg,unref_dlg_cb) < 0) {
+				LM_ERR("failed to ping callee\n");
+				unref_dlg(dlg,1);
 			}
 		}
-		it = it->next;
 	}
 
 	tcp_no_new_conn = 0;
@@ -28,6 +28,7 @@
 
 
 #include "../../locking.h"
+#include "../../timer.h"
 
 
 struct dlg_tl
@@ -52,11 +53,16 @@ struct dlg_ping_list
 	struct dlg_cell* dlg;
 	struct dlg_ping_list *next;
 	struct dlg_ping_list *prev;
+	unsigned int slot;
 };
 
+/* the ping interval is split in slots and each dialog is pinged only when
+ * its slot comes up, so the pings do not all go out in the same tick */
 struct dlg_ping_timer
 {
-	struct dlg_ping_list *first;
+	struct dlg_ping_list **slots;
+	unsigned int slots_no;
+	unsigned int curr;
 	gen_lock_t *lock;
 };
 
@@ -64,7 +70,7 @@ typedef void (*dlg_timer_handler)(struct dlg_tl *);
 
 int init_dlg_timer( dlg_timer_handler );
 
-int init_dlg_ping_timer();
+int init_dlg_ping_timer(unsigned int slots);
 
 void destroy_dlg_timer();
 
@@ -82,6 +88,6 @@ int update_dlg_timer( struct dlg_tl *tl, int timeout );
 
 void dlg_timer_routine(unsigned int ticks , void * attr);
 
-void dlg_ping_routine(unsigned int ticks , void * attr);
+void dlg_ping_routine(utime_t ticks , void * attr);
 
 #endif
@@ -63,10 +63,38 @@ typedef struct dpl_index{
 
 }dpl_index_t, *dpl_index_p;
 
+/* node of the trie of the literal prefixes of the regexp rules */
+typedef struct dpl_trie_node{
+	int child, sibling;		/*first child / next sibling, -1 if none*/
+	int rules, rules_no;	/*slice of the rules ending in this node*/
+	char c;
+}dpl_trie_node_t;
+
+/* prefilter of the regexp rules: an input can only match the rules whose
+   literal prefix (the trie path leading to their node) it starts with;
+   the rules with no usable prefix hang from the root */
+typedef struct dpl_prefilter{
+	int rules_no;
+	dpl_node_t ** rules;	/*the regexp rules, in priority order*/
+	int nodes_no;
+	dpl_trie_node_t * nodes;
+	int * node_rules;		/*indexes in rules, ascending for each node*/
+}dpl_prefilter_t;
+
+#define DP_MAX_PREFIX 64
+
+/* iterator over the candidate regexp rules of an input */
+typedef struct dpl_regex_iter{
+	dpl_prefilter_t *pf;
+	int slices_no;
+	int *pos[DP_MAX_PREFIX+1], *end[DP_MAX_PREFIX+1];
+}dpl_regex_iter_t;
+
 /*For every DPID*/
 typedef struct dpl_id{
 	int dp_id;
 	dpl_index_t* rule_hash;/*fast access :string rules are hashed*/
+	dpl_prefilter_t *regex_pf;/*candidate regexp rules for an input*/
 	struct dpl_id * next;
 }dpl_id_t,*dpl_id_p;
 
@@ -120,6 +148,10 @@ void repl_expr_free(struct subst_expr *se);
 int translate(struct sip_msg *msg, str user_name, str* repl_user, dpl_id_p idp, str *);
 int rule_translate(struct sip_msg *msg, str , dpl_node_t * rule,  str *);
 int test_match(str string, pcre * exp, int * out, int out_max);
+int dp_build_prefilter(dpl_id_p idp);
+void dp_regex_iter_init(dpl_prefilter_t *pf, str *input,
+		dpl_regex_iter_t *it);
+dpl_node_p dp_regex_iter_next(dpl_regex_iter_t *it);
 
 
 typedef void * (*func_malloc)(size_t );
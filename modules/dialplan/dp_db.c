@@ -24,6 +24,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 
 #include "../../dprint.h"
 #include "../../ut.h"
@@ -238,6 +239,7 @@ int dp_load_db(dp_connection_list_p dp_conn)
 	db_val_t cond_val[1];
 
 	dpl_node_t *rule;
+	dpl_id_p crt_idp;
 	int no_rows = 10;
 
 
@@ -335,7 +337,12 @@ int dp_load_db(dp_connection_list_p dp_conn)
 
 
 end:
-
+	/* index the regexp rules by their literal prefixes */
+	for (crt_idp = dp_conn->hash[dp_conn->next_index]; crt_idp;
+	crt_idp = crt_idp->next)
+		if (dp_build_prefilter(crt_idp) != 0)
+			LM_WARN("no prefilter for the regexp rules of dpid %d, "
+				"testing them all\n", crt_idp->dp_id);
 
 	/*update data*/
 	lock_start_write( dp_conn->ref_lock );
@@ -679,6 +686,8 @@ void destroy_hash(dpl_id_t **rules_hash)
 		}
 		*rules_hash = crt_idp->next;
 
+		if (crt_idp->regex_pf)
+			shm_free(crt_idp->regex_pf);
 		shm_free(crt_idp);
 		crt_idp = NULL;
 	}
@@ -0,0 +1,259 @@
+/*
+ * Prefilter of the dialplan regexp rules by their literal prefixes
+ *
+ * Copyright (C) 2013 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "../../dprint.h"
+#include "../../mem/mem.h"
+#include "../../mem/shm_mem.h"
+#include "dialplan.h"
+
+/* extracts the literal prefix that any input matching the regexp starts
+ * with - returns its length, 0 if none (not anchored, alternations at
+ * the top level, case insensitive letters, ...) */
+static int dp_regex_prefix(str *exp, int flags, char *buf)
+{
+	char *p, *q, *end = exp->s + exp->len;
+	int n = 0, depth = 0, len;
+	char c;
+
+	/* an alternation at the top level may not have the prefix */
+	for (q = exp->s; q < end; q++) {
+		if (*q == '\\') {
+			q++;
+		} else if (*q == '[') {
+			/* skip the class - ']' right after '[' or '[^' is a literal */
+			q++;
+			if (q < end && *q == '^')
+				q++;
+			if (q < end && *q == ']')
+				q++;
+			for (; q < end && *q != ']'; q++)
+				if (*q == '\\')
+					q++;
+		} else if (*q == '(') {
+			depth++;
+		} else if (*q == ')') {
+			depth--;
+		} else if (*q == '|' && depth == 0) {
+			return 0;
+		}
+	}
+
+	if (exp->len == 0 || exp->s[0] != '^')
+		return 0;
+
+	for (p = exp->s + 1; p < end && n < DP_MAX_PREFIX; p += len) {
+		c = *p;
+		len = 1;
+		if (c == '\\') {
+			/* only the escaped punctuation chars are literals */
+			if (p + 1 >= end || isalnum((unsigned char)p[1]))
+				break;
+			c = p[1];
+			len = 2;
+		} else if (strchr("[](){}.*+?|^$", c)) {
+			break;
+		}
+
+		if ((flags & DP_CASE_INSENSITIVE) && isalpha((unsigned char)c))
+			break;
+
+		/* a quantifier may make the char optional */
+		if (p + len < end) {
+			if (p[len] == '?' || p[len] == '*' || p[len] == '{')
+				break;
+			if (p[len] == '+') {
+				buf[n++] = c;
+				break;
+			}
+		}
+
+		buf[n++] = c;
+	}
+
+	return n;
+}
+
+/* builds the prefix trie of the regexp rules of a dpid (in pkg memory),
+ * then moves it into a single shm block */
+int dp_build_prefilter(dpl_id_p idp)
+{
+	dpl_trie_node_t *nodes = NULL, *tmp;
+	dpl_prefilter_t *pf;
+	dpl_node_p rulep;
+	int *rule_node = NULL;
+	int rules_no = 0, nodes_no = 1, nodes_size = 64;
+	int i, k, n, node, ch, size;
+	char prefix[DP_MAX_PREFIX];
+
+	for (rulep = idp->rule_hash[DP_INDEX_HASH_SIZE].first_rule; rulep;
+	rulep = rulep->next)
+		rules_no++;
+
+	if (rules_no == 0)
+		return 0;
+
+	rule_node = pkg_malloc(rules_no * sizeof *rule_node);
+	nodes = pkg_malloc(nodes_size * sizeof *nodes);
+	if (!rule_node || !nodes) {
+		LM_ERR("no more pkg memory\n");
+		goto error;
+	}
+	memset(&nodes[0], 0, sizeof *nodes);
+	nodes[0].child = nodes[0].sibling = -1;
+
+	/* insert the prefix of each rule */
+	for (i = 0, rulep = idp->rule_hash[DP_INDEX_HASH_SIZE].first_rule; rulep;
+	i++, rulep = rulep->next) {
+		n = dp_regex_prefix(&rulep->match_exp, rulep->match_flags, prefix);
+
+		for (k = 0, node = 0; k < n; k++, node = ch) {
+			for (ch = nodes[node].child; ch != -1; ch = nodes[ch].sibling)
+				if (nodes[ch].c == prefix[k])
+					break;
+			if (ch != -1)
+				continue;
+
+			if (nodes_no == nodes_size) {
+				tmp = pkg_realloc(nodes, 2 * nodes_size * sizeof *nodes);
+				if (!tmp) {
+					LM_ERR("no more pkg memory\n");
+					goto error;
+				}
+				nodes = tmp;
+				nodes_size *= 2;
+			}
+			ch = nodes_no++;
+			memset(&nodes[ch], 0, sizeof *nodes);
+			nodes[ch].c = prefix[k];
+			nodes[ch].child = -1;
+			nodes[ch].sibling = nodes[node].child;
+			nodes[node].child = ch;
+		}
+
+		rule_node[i] = node;
+		nodes[node].rules_no++;
+	}
+
+	size = sizeof *pf + rules_no * sizeof(dpl_node_p) +
+		nodes_no * sizeof *nodes + rules_no * sizeof(int);
+	pf = shm_malloc(size);
+	if (!pf) {
+		LM_ERR("no more shm memory\n");
+		goto error;
+	}
+
+	pf->rules_no = rules_no;
+	pf->rules = (dpl_node_p *)(pf + 1);
+	pf->nodes_no = nodes_no;
+	pf->nodes = (dpl_trie_node_t *)(pf->rules + rules_no);
+	pf->node_rules = (int *)(pf->nodes + nodes_no);
+
+	/* slice the rules array between the nodes, then fill in the slices in
+	 * the priority order of the rules */
+	for (node = 0, n = 0; node < nodes_no; node++) {
+		nodes[node].rules = n;
+		n += nodes[node].rules_no;
+		nodes[node].rules_no = 0;
+	}
+	for (i = 0, rulep = idp->rule_hash[DP_INDEX_HASH_SIZE].first_rule; rulep;
+	i++, rulep = rulep->next) {
+		pf->rules[i] = rulep;
+		node = rule_node[i];
+		pf->node_rules[nodes[node].rules + nodes[node].rules_no++] = i;
+	}
+	memcpy(pf->nodes, nodes, nodes_no * sizeof *nodes);
+
+	LM_DBG("dpid %d: %d regexp rules, %d trie nodes, %d rules with no "
+		"prefix\n", idp->dp_id, rules_no, nodes_no, nodes[0].rules_no);
+
+	pkg_free(nodes);
+	pkg_free(rule_node);
+
+	idp->regex_pf = pf;
+	return 0;
+
+error:
+	if (nodes)
+		pkg_free(nodes);
+	if (rule_node)
+		pkg_free(rule_node);
+	return -1;
+}
+
+
+/* walks the prefix trie along the input and keeps the slices of rules
+ * of the nodes on the way - all the rules which may match the input */
+void dp_regex_iter_init(dpl_prefilter_t *pf, str *input,
+		dpl_regex_iter_t *it)
+{
+	dpl_trie_node_t *nodes = pf->nodes;
+	int node, ch, k;
+
+	it->pf = pf;
+	it->slices_no = 0;
+
+	for (k = 0, node = 0; ; ) {
+		if (nodes[node].rules_no) {
+			it->pos[it->slices_no] = pf->node_rules + nodes[node].rules;
+			it->end[it->slices_no] = it->pos[it->slices_no] +
+				nodes[node].rules_no;
+			it->slices_no++;
+		}
+
+		if (k == input->len)
+			break;
+		for (ch = nodes[node].child; ch != -1; ch = nodes[ch].sibling)
+			if (nodes[ch].c == input->s[k])
+				break;
+		if (ch == -1)
+			break;
+		node = ch;
+		k++;
+	}
+}
+
+/* the next candidate rule, in priority order - the slices are sorted,
+ * so they are merged on the fly, as the rules are tested (the first
+ * match usually comes long before the end of the candidates) */
+dpl_node_p dp_regex_iter_next(dpl_regex_iter_t *it)
+{
+	int i, min = -1;
+
+	for (i = 0; i < it->slices_no; i++)
+		if (min < 0 || *it->pos[i] < *it->pos[min])
+			min = i;
+
+	if (min < 0)
+		return NULL;
+
+	i = *it->pos[min]++;
+	if (it->pos[min] == it->end[min]) {
+		it->slices_no--;
+		it->pos[min] = it->pos[it->slices_no];
+		it->end[min] = it->end[it->slices_no];
+	}
+
+	return it->pf->rules[i];
+}
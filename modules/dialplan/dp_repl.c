@@ -361,10 +361,19 @@ static inline int check_time(tmrec_t *time_rec) {
 
 #define DP_MAX_ATTRS_LEN	32
 static char dp_attrs_buf[DP_MAX_ATTRS_LEN+1];
+
+/* the regexp rule to test after @rule - the next candidate, if any */
+static inline dpl_node_p dp_next_regex(dpl_id_p idp, dpl_node_p rule,
+		dpl_regex_iter_t *it)
+{
+	return idp->regex_pf ? dp_regex_iter_next(it) : rule->next;
+}
+
 int translate(struct sip_msg *msg, str input, str * output, dpl_id_p idp, str * attrs) {
 
 	dpl_node_p rulep, rrulep;
 	int string_res = -1, regexp_res = -1, bucket;
+	dpl_regex_iter_t it;
 
 	if(!input.s || !input.len) {
 		LM_ERR("invalid input string\n");
@@ -407,7 +416,15 @@ int translate(struct sip_msg *msg, str input, str * output, dpl_id_p idp, str *
 	}
 
 	/* try to match the input in the regexp bucket */
-	for (rrulep = idp->rule_hash[DP_INDEX_HASH_SIZE].first_rule; rrulep; rrulep=rrulep->next) {
+	if (idp->regex_pf) {
+		dp_regex_iter_init(idp->regex_pf, &input, &it);
+		rrulep = dp_regex_iter_next(&it);
+	} else {
+		/* no prefilter - test all the rules */
+		rrulep = idp->rule_hash[DP_INDEX_HASH_SIZE].first_rule;
+	}
+
+	for ( ; rrulep; rrulep = dp_next_regex(idp, rrulep, &it)) {
 
 		// Check for Time Period if Set
 		if(rrulep->parsed_timerec) {
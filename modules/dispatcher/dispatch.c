@@ -46,6 +46,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <ctype.h>
 
 #include "../../ut.h"
 #include "../../trim.h"
@@ -65,6 +66,7 @@
 #include "../../db/db_res.h"
 #include "../../str.h"
 #include "../../rw_locking.h"
+#include "../../hash_func.h"
 
 #include "dispatch.h"
 #include "ds_bl.h"
@@ -125,9 +127,18 @@ static void ds_destroy_data_set( ds_data_t *d)
 			}while(dest);
 			shm_free(sp_curr->dlist);
 		}
+		if (sp_curr->ring)
+			shm_free(sp_curr->ring);
 		shm_free(sp_curr);
 	}
 
+	if (d->sets_idx)
+		shm_free(d->sets_idx);
+	if (d->ip_buckets)
+		shm_free(d->ip_buckets);
+	if (d->ip_entries)
+		shm_free(d->ip_entries);
+
 	/* free the data holder */
 	shm_free(d);
 }
@@ -362,6 +373,100 @@ static inline void re_calculate_active_dsts(ds_set_p sp)
 }
 
 
+/* spreads the bits of a hash value (murmur3 finalizer) */
+static inline unsigned int ds_ch_mix(unsigned int h)
+{
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
+static int ds_ch_point_cmp(const void *a, const void *b)
+{
+	const ds_ch_point_t *pa = a, *pb = b;
+
+	if (pa->hash != pb->hash)
+		return pa->hash < pb->hash ? -1 : 1;
+	/* same hash - keep the ring stable across reloads */
+	return pa->idx - pb->idx;
+}
+
+/* builds the consistent hashing ring of the set - each destination gets
+ * a number of points proportional to its weight, placed based on its
+ * URI only, so adding or removing a destination moves only its share */
+static int ds_build_ring(ds_set_p sp)
+{
+	unsigned int max_w = 0, h;
+	int i, j, n, points;
+
+	for (i = 0; i < sp->nr; i++)
+		if (sp->dlist[i].weight > max_w)
+			max_w = sp->dlist[i].weight;
+
+	for (i = 0, n = 0; i < sp->nr; i++)
+		n += max_w ? (DS_CH_POINTS * sp->dlist[i].weight + max_w - 1) / max_w
+			: DS_CH_POINTS;
+
+	sp->ring_len = 0;
+	if (n == 0)
+		return 0;
+
+	sp->ring = shm_malloc(n * sizeof *sp->ring);
+	if (!sp->ring) {
+		LM_ERR("no more shm memory for the hashing ring\n");
+		return -1;
+	}
+
+	for (i = 0, n = 0; i < sp->nr; i++) {
+		points = max_w ?
+			(DS_CH_POINTS * sp->dlist[i].weight + max_w - 1) / max_w :
+			DS_CH_POINTS;
+		h = core_hash(&sp->dlist[i].dst_uri, NULL, 0);
+		for (j = 0; j < points; j++, n++) {
+			sp->ring[n].hash = ds_ch_mix(h + j * 0x9e3779b9);
+			sp->ring[n].idx = i;
+		}
+	}
+
+	qsort(sp->ring, n, sizeof *sp->ring, ds_ch_point_cmp);
+	sp->ring_len = n;
+
+	return 0;
+}
+
+/* returns the first active destination (out of the first set_size ones)
+ * following the hash on the ring, or -1 if none */
+static int ds_ch_lookup(ds_set_p sp, unsigned int hash, int set_size)
+{
+	int lo, hi, mid, i, idx;
+
+	if (sp->ring_len == 0)
+		return -1;
+
+	hash = ds_ch_mix(hash);
+
+	/* the first point with a hash >= the looked up one */
+	for (lo = 0, hi = sp->ring_len; lo < hi; ) {
+		mid = (lo + hi) / 2;
+		if (sp->ring[mid].hash < hash)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (i = 0; i < sp->ring_len; i++) {
+		idx = sp->ring[(lo + i) % sp->ring_len].idx;
+		if (idx < set_size && dst_is_active(sp->dlist[idx]))
+			return idx;
+	}
+
+	return -1;
+}
+
+
 /* compact destinations from sets for fast access */
 int reindex_dests( ds_data_t *d_data)
 {
@@ -404,6 +509,9 @@ int reindex_dests( ds_data_t *d_data)
 
 		re_calculate_active_dsts(sp);
 
+		if (ds_build_ring(sp) != 0)
+			goto err1;
+
 	}
 
 	LM_DBG("found [%d] dest sets\n", d_data->sets_no);
@@ -644,6 +752,10 @@ static void ds_inherit_state( ds_data_t *old_data , ds_data_t *new_data)
 					LM_DBG("DST <%.*s> found in old set, copying state\n",
 						new_ds->uri.len,new_ds->uri.s);
 					new_ds->flags = old_ds->flags;
+					new_ds->latency = old_ds->latency;
+					/* the requests in flight still complete on it */
+					new_ds->inflight = old_ds->inflight;
+					new_ds->next_probe = old_ds->next_probe;
 					break;
 				}
 			}
@@ -720,7 +832,157 @@ void ds_flusher_routine(unsigned int ticks, void* param)
 }
 
 
+static inline unsigned int ds_ip_hash(struct ip_addr *ip, unsigned int size)
+{
+	str key;
+
+	key.s = (char *)ip->u.addr;
+	key.len = ip->len;
+
+	return core_hash(&key, NULL, size);
+}
+
+static int ds_set_id_cmp(const void *a, const void *b)
+{
+	const ds_set_p sa = *(const ds_set_p *)a, sb = *(const ds_set_p *)b;
+
+	return sa->id < sb->id ? -1 : (sa->id > sb->id);
+}
+
+/* builds the lookup indexes of the loaded data: the sets sorted by id and
+ * the hash of the destination IPs; they are part of the data, so they get
+ * swapped together with it on reload */
+static int ds_index_data(ds_data_t *d_data)
+{
+	ds_set_p sp;
+	unsigned int n = 0, size, h, i;
+	int j, k;
+
+	if (d_data->sets_no == 0)
+		return 0;
+
+	d_data->sets_idx = shm_malloc(d_data->sets_no * sizeof(ds_set_p));
+	if (d_data->sets_idx == NULL) {
+		LM_ERR("no more shm memory for the sets index\n");
+		return -1;
+	}
+	/* the sets in the list order, for now */
+	for (sp = d_data->sets, i = 0; sp; sp = sp->next) {
+		d_data->sets_idx[i++] = sp;
+		for (j = 0; j < sp->nr; j++)
+			n += sp->dlist[j].ips_cnt;
+	}
+
+	if (n) {
+		for (size = 16; size < n; size <<= 1);
+
+		d_data->ip_buckets = shm_malloc((size + 1) * sizeof(unsigned int));
+		d_data->ip_entries = shm_malloc(n * sizeof(ds_ip_entry_t));
+		if (d_data->ip_buckets == NULL || d_data->ip_entries == NULL) {
+			LM_ERR("no more shm memory for the IPs index\n");
+			return -1;
+		}
+		memset(d_data->ip_buckets, 0, (size + 1) * sizeof(unsigned int));
+		d_data->ip_hash_size = size;
+
+		/* count the entries of each bucket, then turn the counters into
+		 * the end offsets of the buckets */
+		for (sp = d_data->sets; sp; sp = sp->next)
+			for (j = 0; j < sp->nr; j++)
+				for (k = 0; k < sp->dlist[j].ips_cnt; k++)
+					d_data->ip_buckets[ds_ip_hash(&sp->dlist[j].ips[k], size)]++;
+		for (i = 1; i <= size; i++)
+			d_data->ip_buckets[i] += d_data->ip_buckets[i-1];
+
+		/* fill in the buckets backwards (ending up with their start
+		 * offsets), so the entries keep the order of the sets list */
+		for (i = d_data->sets_no; i > 0; i--) {
+			sp = d_data->sets_idx[i-1];
+			for (j = sp->nr - 1; j >= 0; j--)
+				for (k = sp->dlist[j].ips_cnt - 1; k >= 0; k--) {
+					h = ds_ip_hash(&sp->dlist[j].ips[k], size);
+					n = --d_data->ip_buckets[h];
+					d_data->ip_entries[n].set = sp;
+					d_data->ip_entries[n].dst = j;
+					d_data->ip_entries[n].ip = k;
+				}
+		}
+	}
+
+	qsort(d_data->sets_idx, d_data->sets_no, sizeof(ds_set_p), ds_set_id_cmp);
+
+	return 0;
+}
+
+
 /*load groups of destinations from DB*/
+static unsigned long ds_get_probe_rtt(void *rtt)
+{
+	return *(volatile unsigned int *)rtt;
+}
+
+/* links each destination to the holder of its probe RTT, exported as
+ * the ds_probe_rtt_PARTITION_SET_URI statistic. The statistics cannot be
+ * removed, so the holder is found by the name of the statistic and kept
+ * (with its value) across the reloads */
+static void ds_register_probe_rtts(ds_partition_t *partition,
+		ds_data_t *d_data)
+{
+	static char buf[256];
+	ds_set_p set;
+	ds_dest_p dst;
+	stat_var *stat;
+	unsigned int *rtt;
+	str name;
+	char *p;
+	int len, i, j;
+
+	for (set = d_data->sets; set; set = set->next) {
+		for (j = 0; j < set->nr; j++) {
+			dst = &set->dlist[j];
+
+			p = int2str(set->id, &len);
+			name.len = snprintf(buf, sizeof buf, "ds_probe_rtt_%.*s_%.*s_%.*s",
+				partition->name.len, partition->name.s, len, p,
+				dst->dst_uri.len, dst->dst_uri.s);
+			if (name.len >= (int)sizeof buf)
+				name.len = sizeof buf - 1;
+			buf[name.len] = 0;
+			name.s = buf;
+			/* only keep the chars allowed in a statistic name */
+			for (i = 0; i < name.len; i++)
+				if (!isalnum((unsigned char)buf[i]))
+					buf[i] = '_';
+
+			if ((stat = get_stat(&name)) != NULL) {
+				if ((stat->flags & STAT_IS_FUNC) &&
+				stat->u.f == ds_get_probe_rtt)
+					dst->probe_rtt = (unsigned int *)stat->context;
+				else
+					LM_ERR("statistic <%s> already in use\n", buf);
+				continue;
+			}
+
+			rtt = shm_malloc(sizeof *rtt);
+			if (rtt == NULL) {
+				LM_ERR("no more shm memory for the probe RTT\n");
+				continue;
+			}
+			*rtt = 0;
+
+			if (register_stat2(DYNAMIC_MODULE_NAME, buf,
+			(stat_var **)ds_get_probe_rtt, STAT_IS_FUNC|STAT_NO_RESET,
+			rtt, 0) != 0) {
+				LM_ERR("failed to register statistic <%s>\n", buf);
+				shm_free(rtt);
+				continue;
+			}
+			dst->probe_rtt = rtt;
+		}
+	}
+}
+
+
 static ds_data_t* ds_load_data(ds_partition_t *partition, int use_state_col)
 {
 	ds_data_t *d_data;
@@ -849,6 +1111,11 @@ static ds_data_t* ds_load_data(ds_partition_t *partition, int use_state_col)
 			LM_ERR("error on reindex\n");
 			goto error2;
 		}
+		if(ds_index_data( d_data )!=0) {
+			LM_ERR("error on indexing\n");
+			goto error2;
+		}
+		ds_register_probe_rtts(partition, d_data);
 	}
 
 load_done:
@@ -882,15 +1149,17 @@ int ds_reload_db(ds_partition_t *partition)
 	old_data = *partition->data;
 	*partition->data = new_data;
 
+	/* copy the state of the destinations from the old set (for the
+	 * matching ids) before any reader can update the new one - the
+	 * in-flight counters would drift otherwise */
+	if (old_data)
+		ds_inherit_state( old_data, new_data);
+
 	lock_stop_write( partition->lock );
 
 	/* destroy old data */
-	if (old_data) {
-		/* copy the state of the destinations from the old set
-		 * (for the matching ids) */
-		ds_inherit_state( old_data, new_data);
+	if (old_data)
 		ds_destroy_data_set( old_data );
-	}
 
 	/* update the Black Lists with the new gateways */
 	populate_ds_bls( new_data->sets, partition->name);
@@ -1241,26 +1510,28 @@ int ds_hash_pvar(struct sip_msg *msg, unsigned int *hash)
 
 static inline int ds_get_index(int group, ds_set_p *index, ds_partition_t *partition)
 {
-	ds_set_p si = NULL;
+	ds_data_t *d = *partition->data;
+	int lo, hi, mid;
 
-	if(index==NULL || group<0 || (*partition->data)->sets==NULL)
+	if(index==NULL || group<0 || d->sets==NULL)
 		return -1;
 
-	/* get the index of the set */
-	for ( si=(*partition->data)->sets ; si ; si = si->next ) {
-		if(si->id == group) {
-			*index = si;
-			break;
+	/* binary search through the sets, sorted by id */
+	for (lo = 0, hi = d->sets_no; lo < hi; ) {
+		mid = (lo + hi) / 2;
+		if (d->sets_idx[mid]->id < group) {
+			lo = mid + 1;
+		} else if (d->sets_idx[mid]->id > group) {
+			hi = mid;
+		} else {
+			*index = d->sets_idx[mid];
+			return 0;
 		}
 	}
 
-	if(si==NULL) {
-		LM_ERR("destination set [%d] not found in partition [%.*s]\n", group,
-				partition->name.len, partition->name.s);
-		return -1;
-	}
-
-	return 0;
+	LM_ERR("destination set [%d] not found in partition [%.*s]\n", group,
+			partition->name.len, partition->name.s);
+	return -1;
 }
 
 
@@ -1352,6 +1623,203 @@ static inline int push_ds_2_avps( ds_dest_t *ds, ds_partition_t *partition )
 }
 
 
+int ds_latency_weight = 20;
+
+typedef struct _ds_latency_param
+{
+	ds_partition_t *partition;
+	int set_id;
+	str uri;
+	struct timeval sent;
+	int branch;		/* the branch the request was sent on */
+	int replied;	/* the response time was sampled */
+	int done;		/* the request is no longer in flight */
+} ds_latency_param_t;
+
+/* accounts a response time sample (if @sent is given, for a probe if
+ * @probe) and a change of the in-flight requests for a destination */
+static void ds_update_latency(ds_partition_t *partition, int set_id,
+		str *uri, struct timeval *sent, int inflight, int probe)
+{
+	struct timeval now;
+	ds_set_p idx = NULL;
+	ds_dest_p dst;
+	long sample;
+	int i;
+
+	if (sent) {
+		gettimeofday(&now, NULL);
+		sample = (now.tv_sec - sent->tv_sec) * 1000000 +
+			(now.tv_usec - sent->tv_usec);
+		if (sample < 0)
+			sample = 0;
+	} else {
+		sample = 0;
+	}
+
+	lock_start_read( partition->lock );
+
+	/* the destination may be gone with a reload in the meantime */
+	if ((*partition->data)->sets==NULL ||
+	ds_get_index(set_id, &idx, partition)!=0)
+		goto done;
+
+	for (i = 0; i < idx->nr; i++) {
+		dst = &idx->dlist[i];
+		if (dst->uri.len != uri->len ||
+		strncasecmp(dst->uri.s, uri->s, uri->len))
+			continue;
+
+		if (sent) {
+			/* no lock - a lost sample now and then does not matter */
+			if (dst->latency == 0)
+				dst->latency = sample ? sample : 1;
+			else
+				dst->latency += (sample - (long)dst->latency) *
+					ds_latency_weight / 100;
+		}
+		if (inflight)
+			__sync_fetch_and_add(&dst->inflight, inflight);
+		if (probe && sent && dst->probe_rtt)
+			*dst->probe_rtt = sample / 1000;
+		break;
+	}
+
+done:
+	lock_stop_read( partition->lock );
+}
+
+static void ds_latency_callback(struct cell *t, int type,
+		struct tmcb_params *ps)
+{
+	ds_latency_param_t *p = (ds_latency_param_t *)*ps->param;
+
+	/* the replies of the other branches (serial forking, failover to
+	 * other destinations) are not about this destination */
+	if (ps->extra1 && *(int *)ps->extra1 != p->branch)
+		return;
+
+	if (!p->replied) {
+		p->replied = 1;
+		ds_update_latency(p->partition, p->set_id, &p->uri, &p->sent,
+			ps->code >= 200 ? -1 : 0, 0);
+		if (ps->code >= 200)
+			p->done = 1;
+	} else if (ps->code >= 200 && !p->done) {
+		p->done = 1;
+		ds_update_latency(p->partition, p->set_id, &p->uri, NULL, -1, 0);
+	}
+}
+
+static void ds_latency_release(void *param)
+{
+	ds_latency_param_t *p = (ds_latency_param_t *)param;
+
+	/* no reply at all (timeout) counts as a response time too */
+	if (!p->done)
+		ds_update_latency(p->partition, p->set_id, &p->uri,
+			p->replied ? NULL : &p->sent, -1, 0);
+
+	shm_free(p);
+}
+
+/* follows the transaction of the request sent to @dst, to measure the
+ * response time of the destination - the destination is looked up again
+ * when the reply comes, as it may be freed by a reload in the meantime */
+static int ds_track_latency(struct sip_msg *msg, ds_partition_t *partition,
+		int set_id, ds_dest_p dst)
+{
+	ds_latency_param_t *p;
+	struct cell *t;
+
+	if (!tmb.register_tmcb)
+		return -1;
+
+	p = shm_malloc(sizeof *p + dst->uri.len);
+	if (!p) {
+		LM_ERR("no more shm memory\n");
+		return -1;
+	}
+	memset(p, 0, sizeof *p);
+	p->partition = partition;
+	p->set_id = set_id;
+	p->uri.s = (char *)(p + 1);
+	p->uri.len = dst->uri.len;
+	memcpy(p->uri.s, dst->uri.s, dst->uri.len);
+	gettimeofday(&p->sent, NULL);
+	/* the request goes out on the next branch of the transaction (the
+	 * first one, if not created yet) */
+	t = tmb.t_gett();
+	p->branch = (t && t!=T_UNDEFINED) ? t->nr_of_outgoings : 0;
+
+	if (tmb.register_tmcb(msg, 0, TMCB_RESPONSE_IN, ds_latency_callback,
+	p, ds_latency_release) <= 0) {
+		LM_ERR("failed to register the TM callback\n");
+		shm_free(p);
+		return -1;
+	}
+
+	__sync_fetch_and_add(&dst->inflight, 1);
+	return 0;
+}
+
+/* the cost of sending one more request to a destination */
+static inline unsigned long ds_latency_cost(ds_dest_p dst)
+{
+	int inflight = dst->inflight;
+
+	/* never trust the counter blindly, a lost update must not make a
+	 * destination look free (or overloaded) forever */
+	return (unsigned long)dst->latency * ((inflight > 0 ? inflight : 0) + 1);
+}
+
+/* picks a random active destination, based on the weights if any */
+static inline int ds_random_active(ds_set_p idx, int set_size)
+{
+	unsigned int r;
+	int i, j;
+
+	if (idx->dlist[set_size-1].active_running_weight) {
+		r = rand() % idx->dlist[set_size-1].active_running_weight;
+		for (i = 0; i < set_size; i++)
+			if (dst_is_active(idx->dlist[i]) &&
+			r < idx->dlist[i].active_running_weight)
+				return i;
+		return -1;
+	}
+
+	for (i = 0, j = 0; i < set_size; i++)
+		if (dst_is_active(idx->dlist[i]))
+			j++;
+	if (j == 0)
+		return -1;
+
+	j = rand() % j;
+	for (i = 0; i < set_size; i++)
+		if (dst_is_active(idx->dlist[i]) && j-- == 0)
+			return i;
+	return -1;
+}
+
+/* power of two choices: out of two random active destinations, the one
+ * with the lower latency (weighted by its requests in flight) is used */
+static int ds_latency_algo(ds_set_p idx, int set_size)
+{
+	int a, b;
+
+	a = ds_random_active(idx, set_size);
+	if (a < 0)
+		return -1;
+
+	b = ds_random_active(idx, set_size);
+	if (b < 0 || b == a)
+		return a;
+
+	return ds_latency_cost(&idx->dlist[b]) < ds_latency_cost(&idx->dlist[a]) ?
+		b : a;
+}
+
+
 /**
  *
  */
@@ -1491,6 +1959,16 @@ int ds_select_dst(struct sip_msg *msg, ds_select_ctl_p ds_select_ctl, ds_selecte
 		case 8:
 			ds_id = 0;
 		break;
+		case DS_ALG_LATENCY:
+			ds_id = ds_latency_algo(idx, set_size);
+			if (ds_id == -1) {
+				if (!(ds_flags&DS_USE_DEFAULT) ||
+				!dst_is_active(idx->dlist[idx->nr-1]))
+					goto error;
+				ds_id = idx->nr-1;
+			}
+			selected = &idx->dlist[ds_id];
+		break;
 		case 9:
 			if (!ds_has_pattern && ds_pattern_prefix.len == 0 ) {
 				LM_WARN("no pattern specified - using first entry...\n");
@@ -1511,6 +1989,20 @@ int ds_select_dst(struct sip_msg *msg, ds_select_ctl_p ds_select_ctl, ds_selecte
 			ds_id = 0;
 	}
 
+	/* hash based algorithms may map the hash over the ring of the set,
+	 * so only the flows of a failed destination are moved elsewhere */
+	if (selected==NULL && ds_id==-1 && (ds_flags&DS_CONSISTENT_HASH)) {
+		ds_id = ds_ch_lookup(idx, ds_hash, set_size);
+		if (ds_id==-1) {
+			if (!(ds_flags&DS_USE_DEFAULT) ||
+			!dst_is_active(idx->dlist[idx->nr-1]))
+				goto error;
+			ds_id = idx->nr-1;
+		}
+		LM_DBG("hash [%u], ring candidate [%d]\n", ds_hash, ds_id);
+		selected = &idx->dlist[ds_id];
+	}
+
 	/* any destination selected yet? */
 	if (selected==NULL) {
 
@@ -1603,6 +2095,9 @@ int ds_select_dst(struct sip_msg *msg, ds_select_ctl_p ds_select_ctl, ds_selecte
 		LM_DBG("aici_intrat [%hu]\n", selected->chosen_count);
 	}
 
+	if (ds_select_ctl->alg == DS_ALG_LATENCY)
+		ds_track_latency(msg, ds_select_ctl->partition, idx->id, selected);
+
 
 	/* Save the selected destination for multilist failover */
 	if (selected_dst->uri.s != NULL) {
@@ -1945,11 +2440,14 @@ int ds_is_in_list(struct sip_msg *_m, gparam_t *gp_ip, gparam_t *gp_port,
 					int set, int active_only, ds_partition_t *partition)
 {
 	pv_value_t val;
+	ds_data_t *d;
 	ds_set_p list;
+	ds_dest_p dst;
+	ds_ip_entry_t *e;
 	struct ip_addr *ip;
 	int_str avp_val;
+	unsigned int h;
 	int port;
-	int j,k;
 
 	/* get the address to test */
 	if (fixup_get_svalue(_m, gp_ip, &val.rs) != 0) {
@@ -1980,39 +2478,42 @@ int ds_is_in_list(struct sip_msg *_m, gparam_t *gp_ip, gparam_t *gp_port,
 	/* access ds data under reader's lock */
 	lock_start_read( partition->lock );
 
-	for(list = (*partition->data)->sets ; list!= NULL; list= list->next) {
-		if ((set == -1) || (set == list->id)) {
-			/* interate through all elements/destinations in the list */
-			for(j=0; j<list->nr; j++) {
-				/* interate through all IPs of each destination */
-				for(k=0 ; k<list->dlist[j].ips_cnt ; k++ ) {
-					if ( (list->dlist[j].ports[k]==0 || port==0
-					|| port==list->dlist[j].ports[k]) &&
-					ip_addr_cmp( ip, &list->dlist[j].ips[k]) ) {
-						/* matching destination */
-						if (active_only && !dst_is_active(list->dlist[j]) )
-							continue;
-						if(set==-1 && ds_setid_pvname.s!=0) {
-							val.ri = list->id;
-							if(pv_set_value(_m, &ds_setid_pv,
-									(int)EQ_T, &val)<0)
-							{
-								LM_ERR("setting PV failed\n");
-								goto error;
-							}
-						}
-						if (partition->attrs_avp_name>= 0) {
-							avp_val.s = list->dlist[j].attrs;
-							if(add_avp(AVP_VAL_STR|partition->attrs_avp_type,
-										partition->attrs_avp_name,avp_val)!=0)
-								goto error;
-						}
+	d = *partition->data;
+	if (d->ip_hash_size == 0)
+		goto error;
 
-						lock_stop_read( partition->lock );
-						return 1;
-					}
+	/* only the IP is hashed, as the ports may be wildcards (0) */
+	h = ds_ip_hash(ip, d->ip_hash_size);
+	for (e = d->ip_entries + d->ip_buckets[h];
+	e < d->ip_entries + d->ip_buckets[h+1]; e++) {
+		list = e->set;
+		dst = &list->dlist[e->dst];
+		if ((set != -1) && (set != list->id))
+			continue;
+		if ( (dst->ports[e->ip]==0 || port==0
+		|| port==dst->ports[e->ip]) &&
+		ip_addr_cmp( ip, &dst->ips[e->ip]) ) {
+			/* matching destination */
+			if (active_only && !dst_is_active(*dst) )
+				continue;
+			if(set==-1 && ds_setid_pvname.s!=0) {
+				val.ri = list->id;
+				if(pv_set_value(_m, &ds_setid_pv,
+						(int)EQ_T, &val)<0)
+				{
+					LM_ERR("setting PV failed\n");
+					goto error;
 				}
 			}
+			if (partition->attrs_avp_name>= 0) {
+				avp_val.s = dst->attrs;
+				if(add_avp(AVP_VAL_STR|partition->attrs_avp_type,
+							partition->attrs_avp_name,avp_val)!=0)
+					goto error;
+			}
+
+			lock_stop_read( partition->lock );
+			return 1;
 		}
 	}
 
@@ -2069,6 +2570,16 @@ int ds_print_mi_list(struct mi_node* rpl, ds_partition_t *partition)
 			if(attr == NULL)
 				goto error;
 
+			p = int2str(list->dlist[j].latency, &len);
+			attr = add_mi_attr (node, MI_DUP_VALUE, "latency",7, p, len);
+			if(attr == NULL)
+				goto error;
+
+			p = int2str(list->dlist[j].inflight, &len);
+			attr = add_mi_attr (node, MI_DUP_VALUE, "inflight",8, p, len);
+			if(attr == NULL)
+				goto error;
+
 			if (list->dlist[j].sock)
 			{
 				p = socket2str(list->dlist[j].sock, NULL, &len, 0);
@@ -2132,6 +2643,11 @@ static void ds_options_callback( struct cell *t, int type,
 	LM_DBG("OPTIONS-Request was finished with code %d (to %.*s, group %d)\n",
 			ps->code, uri.len, uri.s, cb_param->set_id);
 
+	/* the probes feed the response times too */
+	if (ps->code != 408)
+		ds_update_latency(cb_param->partition, cb_param->set_id, &uri,
+			&cb_param->sent, 0, 1);
+
 	/* ps->code contains the result-code of the request;
 	 * We accept "200 OK" by default and the custom codes
 	 * defined in options_reply_codes parameter*/
@@ -2168,6 +2684,41 @@ void shm_free_cb_param(void *param)
 	shm_free(param);
 }
 
+int ds_probing_interval = 0;
+
+/* spreads the probes of the nodes running with the same destinations */
+static unsigned int ds_probe_seed;
+
+/* checks if it is time to probe the destination - each destination is
+ * probed every ds_ping_interval seconds (ds_probing_interval while in
+ * probing state), starting at its own phase within the interval, so the
+ * probes are spread over the whole interval instead of going out in a
+ * burst */
+static inline int ds_probe_due(ds_dest_p dst, unsigned int ticks)
+{
+	unsigned int interval;
+
+	interval = (dst->flags&DS_PROBING_DST) ?
+		ds_probing_interval : ds_ping_interval;
+
+	if (!ds_probe_seed)
+		ds_probe_seed = rand() | 1;
+
+	if (dst->next_probe == 0) {
+		dst->next_probe = ticks + 1 +
+			(core_hash(&dst->uri, NULL, 0) ^ ds_probe_seed) % interval;
+	} else if (dst->next_probe > ticks + interval) {
+		/* just moved into probing - do not wait for the long interval */
+		dst->next_probe = ticks + interval;
+	}
+
+	if (ticks < dst->next_probe)
+		return 0;
+
+	dst->next_probe = ticks + interval;
+	return 1;
+}
+
 /*
  * Timer for checking inactive destinations
  *
@@ -2198,6 +2749,9 @@ void ds_check_timer(unsigned int ticks, void* param)
 				if ( ((list->dlist[j].flags&DS_INACTIVE_DST)==0) &&
 				(ds_probing_mode==1 || (list->dlist[j].flags&DS_PROBING_DST)!=0) )
 				{
+					if (!ds_probe_due(&list->dlist[j], ticks))
+						continue;
+
 					LM_DBG("probing set #%d, URI %.*s\n", list->id,
 							list->dlist[j].uri.len, list->dlist[j].uri.s);
 
@@ -2221,6 +2775,7 @@ void ds_check_timer(unsigned int ticks, void* param)
 					}
 					cb_param->partition = partition;
 					cb_param->set_id = list->id;
+					gettimeofday(&cb_param->sent, NULL);
 					if (tmb.t_request_within(&ds_ping_method,
 							NULL,
 							NULL,
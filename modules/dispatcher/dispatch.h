@@ -38,18 +38,21 @@
 #define _DISPATCH_H_
 
 #include <stdio.h>
+#include <sys/time.h>
 #include "../../pvar.h"
 #include "../../mod_fix.h"
 #include "../../parser/msg_parser.h"
 #include "../tm/tm_load.h"
 #include "../../db/db.h"
 #include "../../rw_locking.h"
+#include "../../statistics.h"
 
 #define DS_HASH_USER_ONLY	1  /* use only the uri user part for hashing */
 #define DS_FAILOVER_ON		2  /* store the other dest in avps */
 #define DS_USE_DEFAULT		4  /* use last address in destination set as last option */
 #define DS_FORCE_DST		8  /* if not set it will force overwriting the destination address
 					if already set */
+#define DS_CONSISTENT_HASH	16 /* map the hash over a consistent hashing ring */
 
 #define DS_INACTIVE_DST		1  /* inactive destination */
 #define DS_PROBING_DST		2  /* checking destination */
@@ -62,6 +65,13 @@
 
 #define DS_MAX_IPS  32
 
+/* the latency aware algorithm */
+#define DS_ALG_LATENCY 10
+
+/* points of a destination on the consistent hashing ring (for the
+ * highest weight of the set) */
+#define DS_CH_POINTS 100
+
 #define DS_COUNT_ACTIVE     1
 #define DS_COUNT_INACTIVE   2
 #define DS_COUNT_PROBING    4
@@ -87,10 +97,20 @@ typedef struct _ds_dest
 	unsigned short ips_cnt;
 	unsigned short failure_count;
 	unsigned short chosen_count;
+	unsigned int latency;	/* EWMA of the response times, in microseconds */
+	int inflight;			/* requests sent and not completed yet */
+	unsigned int next_probe;	/* when to probe it next, in ticks */
+	unsigned int *probe_rtt;	/* RTT of the last probe (ms), in shm */
 	void *param;
 	struct _ds_dest *next;
 } ds_dest_t, *ds_dest_p;
 
+typedef struct _ds_ch_point
+{
+	unsigned int hash;
+	int idx;			/* index of the destination in the set */
+} ds_ch_point_t;
+
 typedef struct _ds_set
 {
 	int id;				/* id of dst set */
@@ -98,13 +118,31 @@ typedef struct _ds_set
 	int active_nr;		/* number of active items in dst set */
 	int last;			/* last used item in dst set */
 	ds_dest_p dlist;
+	ds_ch_point_t *ring;	/* consistent hashing ring, sorted by hash */
+	int ring_len;
 	struct _ds_set *next;
 } ds_set_t, *ds_set_p;
 
+/* a destination IP, as indexed for ds_is_in_list() */
+typedef struct _ds_ip_entry
+{
+	ds_set_p set;
+	int dst;			/* index of the destination in the set */
+	int ip;				/* index of the IP of the destination */
+} ds_ip_entry_t;
+
 typedef struct _ds_data
 {
 	ds_set_t *sets;
 	unsigned int sets_no;
+	/* the sets, sorted by id */
+	ds_set_p *sets_idx;
+	/* hash of all the destination IPs - the entries of bucket i are
+	 * ip_entries[ip_buckets[i] .. ip_buckets[i+1]-1], in the order of
+	 * the sets list */
+	unsigned int ip_hash_size;
+	unsigned int *ip_buckets;
+	ds_ip_entry_t *ip_entries;
 } ds_data_t;
 
 typedef struct _ds_pvar_param
@@ -160,6 +198,7 @@ typedef struct
 {
 	ds_partition_t *partition;
 	int set_id;
+	struct timeval sent;
 } ds_options_callback_param_t;
 
 typedef struct _ds_selected_dst
@@ -188,6 +227,9 @@ extern str ds_ping_from;
 extern int probing_threshhold; /* number of failed requests,
 						before a destination is taken into probing */
 extern int ds_probing_mode;
+extern int ds_ping_interval;
+extern int ds_probing_interval;
+extern int ds_latency_weight;
 
 
 int init_ds_db(ds_partition_t *partition);
@@ -79,7 +79,7 @@ int probing_threshhold = 3; /* number of failed requests, before a destination
 							   is taken into probing */
 str ds_ping_method = {"OPTIONS",7};
 str ds_ping_from   = {"sip:dispatcher@localhost", 24};
-static int ds_ping_interval = 0;
+int ds_ping_interval = 0;
 int ds_probing_mode = 0;
 int ds_persistent_state = 1;
 
@@ -240,11 +240,13 @@ static param_export_t params[]={
 	{"ds_ping_method",        STR_PARAM, &ds_ping_method.s},
 	{"ds_ping_from",          STR_PARAM, &ds_ping_from.s},
 	{"ds_ping_interval",      INT_PARAM, &ds_ping_interval},
+	{"ds_probing_interval",   INT_PARAM, &ds_probing_interval},
 	{"ds_probing_mode",       INT_PARAM, &ds_probing_mode},
 	{"options_reply_codes",   STR_PARAM, &options_reply_codes_str.s},
 	{"ds_probing_sock",       STR_PARAM, &probing_sock_s},
 	{"ds_define_blacklist",   STR_PARAM|USE_FUNC_PARAM, (void*)set_ds_bl},
 	{"persistent_state",      INT_PARAM, &ds_persistent_state},
+	{"ds_latency_weight",     INT_PARAM, &ds_latency_weight},
 	{0,0,0}
 };
 
@@ -810,12 +812,38 @@ static int mod_init(void)
 			LM_ERR("could not load the TM-functions - disable DS ping\n");
 			return -1;
 		}
-		/* Register the PING-Timer */
+		/* the destinations in probing state are probed more often */
+		if (ds_probing_interval <= 0) {
+			ds_probing_interval = ds_ping_interval / 4;
+			if (ds_probing_interval == 0)
+				ds_probing_interval = 1;
+		} else if (ds_probing_interval > ds_ping_interval) {
+			ds_probing_interval = ds_ping_interval;
+		}
+		/* Register the PING-Timer - it checks every second which
+		 * destinations are due for a probe */
 		if (register_timer("ds-pinger", ds_check_timer, NULL,
-		ds_ping_interval, TIMER_FLAG_DELAY_ON_DELAY)<0) {
+		1, TIMER_FLAG_DELAY_ON_DELAY)<0) {
 			LM_ERR("failed to register timer for probing!\n");
 			return -1;
 		}
+	} else {
+		/* not required, but used (if loaded) by the latency algorithm
+		 * to follow the response times of the destinations */
+		load_tm_f load_tm;
+
+		load_tm=(load_tm_f)find_export("load_tm", 0, 0);
+		if (load_tm==NULL || load_tm( &tmb ) == -1) {
+			LM_DBG("TM not loaded, no response times for the latency "
+				"algorithm\n");
+			memset(&tmb, 0, sizeof tmb);
+		}
+	}
+
+	if (ds_latency_weight <= 0 || ds_latency_weight > 100) {
+		LM_ERR("invalid ds_latency_weight %d (must be 1..100)\n",
+			ds_latency_weight);
+		return -1;
 	}
 
 	/* register timer to flush the state of destination back to DB */
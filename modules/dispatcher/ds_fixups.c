@@ -551,6 +551,14 @@ int fixup_flags(str* param)
 					ret |= DS_FORCE_DST;
 				}
 				break;
+			case 'c':
+			case 'C':
+				if (ret & DS_CONSISTENT_HASH) {
+					FLAG_ERR(consistent hashing (C));
+				} else {
+					ret |= DS_CONSISTENT_HASH;
+				}
+				break;
 			default :
 				LM_ERR("Invalid definition\n");
 				return -1;
@@ -102,6 +102,7 @@ static int add_rcv_param_f(struct sip_msg *, char *, char *);
 static int get_oldip_fields_value(modparam_t type, void* val);
 
 static void nh_timer(unsigned int, void *);
+static void nh_ping_timer(utime_t, void *);
 static int mod_init(void);
 static void mod_destroy(void);
 
@@ -195,6 +196,31 @@ int skip_oldip=0;
 /*0-> disabled, 1 ->enabled*/
 unsigned int *natping_state=0;
 
+/* steps per second the pinging of the in-memory contacts is spread over */
+#define NH_PING_STEPS_PER_SEC	10
+
+/* progress of a natping partition over the current ping interval - kept
+ * in shm as the timer jobs may run in any of the timer processes */
+struct nh_ping_part {
+	ucontact_cursor_t cur;
+	unsigned int step;      /* current step of the interval */
+	int total;              /* slots to ping over the interval */
+	int done;               /* slots pinged so far */
+};
+static struct nh_ping_part *nh_parts = 0;
+
+/* contacts copied out of the usrloc slots, to be pinged only after the
+ * slot lock is released */
+struct nh_ping_target {
+	str c;
+	str path;
+	struct socket_info *sock;
+	unsigned int flags;
+	struct proxy_l next_hop;
+	struct nh_ping_target *next;
+};
+static struct nh_ping_target *nh_targets = 0;
+
 
 static cmd_export_t cmds[] = {
 	{"fix_nated_contact",  (cmd_function)fix_nated_contact_f,    0,
@@ -549,12 +575,31 @@ mod_init(void)
 			init_sip_ping();
 		}
 
-		for( i=0 ; i<natping_partitions ; i++ ) {
-			if (register_timer( "nh-timer", nh_timer,
-			(void*)(unsigned long)i, 1, TIMER_FLAG_DELAY_ON_DELAY)<0) {
-				LM_ERR("failed to register timer routine\n");
+		if (ul.db_mode == DB_ONLY) {
+			/* no contacts in memory - fetch them from DB each second */
+			for( i=0 ; i<natping_partitions ; i++ ) {
+				if (register_timer( "nh-timer", nh_timer,
+				(void*)(unsigned long)i, 1, TIMER_FLAG_DELAY_ON_DELAY)<0) {
+					LM_ERR("failed to register timer routine\n");
+					return -1;
+				}
+			}
+		} else {
+			nh_parts = shm_malloc(natping_partitions*sizeof *nh_parts);
+			if (!nh_parts) {
+				LM_ERR("no shmem left\n");
 				return -1;
 			}
+			memset(nh_parts, 0, natping_partitions*sizeof *nh_parts);
+
+			for( i=0 ; i<natping_partitions ; i++ ) {
+				if (register_utimer( "nh-timer", nh_ping_timer,
+				(void*)(unsigned long)i, 1000000/NH_PING_STEPS_PER_SEC,
+				TIMER_FLAG_DELAY_ON_DELAY)<0) {
+					LM_ERR("failed to register timer routine\n");
+					return -1;
+				}
+			}
 		}
 	}
 
@@ -575,6 +620,8 @@ static void mod_destroy(void)
 	/*free the shared memory*/
 	if (natping_state)
 		shm_free(natping_state);
+	if (nh_parts)
+		shm_free(nh_parts);
 
 }
 
@@ -1243,6 +1290,144 @@ static int send_raw(const char *buf, int buf_len, union sockaddr_union *to,
 }
 
 
+static void
+nh_ping_contact(str *c, str *path, struct socket_info *send_sock,
+					unsigned int flags, struct proxy_l *next_hop)
+{
+	union sockaddr_union to;
+	struct hostent *he;
+	str opt;
+
+	if (next_hop->proto != PROTO_NONE && next_hop->proto != PROTO_UDP &&
+	    (natping_tcp == 0 || (next_hop->proto != PROTO_TCP &&
+	                          next_hop->proto != PROTO_TLS &&
+							  next_hop->proto != PROTO_WS)))
+		return;
+
+	LM_DBG("resolving next hop: '%.*s'\n",
+	        next_hop->name.len, next_hop->name.s);
+	he = sip_resolvehost(&next_hop->name, &next_hop->port,
+	                     &next_hop->proto, 0, NULL);
+	if (!he) {
+		LM_ERR("failed to resolve next hop: '%.*s'\n",
+		        next_hop->name.len, next_hop->name.s);
+		return;
+	}
+
+	hostent2su(&to, he, 0, next_hop->port);
+
+	if (!send_sock) {
+		send_sock = force_socket ? force_socket :
+		                           get_send_socket(0, &to, next_hop->proto);
+		if (!send_sock) {
+			LM_ERR("can't get sending socket\n");
+			return;
+		}
+	}
+
+	if ((flags & sipping_flag) &&
+	    (opt.s = build_sipping(c, send_sock, path, &opt.len))) {
+		if (msg_send(send_sock, next_hop->proto, &to, 0, opt.s, opt.len, NULL) < 0) {
+			LM_ERR("sip msg_send failed\n");
+		}
+	} else if (raw_ip && next_hop->proto == PROTO_UDP) {
+		if (send_raw((char*)sbuf, sizeof(sbuf), &to, raw_ip, raw_port)<0) {
+			LM_ERR("send_raw failed\n");
+		}
+	} else {
+		if (msg_send(send_sock, next_hop->proto, &to, 0,
+		             (char *)sbuf, sizeof(sbuf), NULL) < 0) {
+			LM_ERR("sip msg_send failed!\n");
+		}
+	}
+}
+
+
+/* copies the ping target of a contact - no sending (and no DNS lookup)
+ * is done under the usrloc slot lock */
+static int
+nh_ping_ucontact(ucontact_t *uc, void *param)
+{
+	struct nh_ping_target *d;
+	str *c;
+
+	c = uc->received.s ? &uc->received : &uc->c;
+
+	d = pkg_malloc(sizeof *d + c->len + uc->path.len +
+		uc->next_hop.name.len);
+	if (!d) {
+		LM_ERR("out of pkg memory\n");
+		return 0;
+	}
+
+	d->c.s = (char *)(d + 1);
+	d->c.len = c->len;
+	memcpy(d->c.s, c->s, c->len);
+	d->path.s = uc->path.len ? d->c.s + d->c.len : NULL;
+	d->path.len = uc->path.len;
+	memcpy(d->c.s + d->c.len, uc->path.s, uc->path.len);
+	d->next_hop = uc->next_hop;
+	d->next_hop.name.s = d->c.s + d->c.len + d->path.len;
+	memcpy(d->next_hop.name.s, uc->next_hop.name.s, uc->next_hop.name.len);
+	d->sock = uc->sock;
+	d->flags = uc->cflags;
+
+	d->next = nh_targets;
+	nh_targets = d;
+
+	return 0;
+}
+
+
+/* pings the in-memory contacts of a partition, spreading the usrloc slots
+ * evenly over the steps of the ping interval */
+static void
+nh_ping_timer(utime_t uticks, void *timer_idx)
+{
+	struct nh_ping_part *pp = &nh_parts[(unsigned long)timer_idx];
+	unsigned int steps = natping_interval * NH_PING_STEPS_PER_SEC;
+	struct nh_ping_target *d;
+	int n;
+
+	if (pp->step == 0) {
+		ul.init_ucontact_cursor(&pp->cur, (ping_nated_only?ul.nat_flag:0),
+			(unsigned int)(unsigned long)timer_idx, natping_partitions);
+		pp->total = ul.get_partition_slots(
+			(unsigned int)(unsigned long)timer_idx, natping_partitions);
+		pp->done = 0;
+	}
+
+	/* slots that should have been pinged by the end of this step */
+	n = (int)(((unsigned long long)pp->total * (pp->step + 1) + steps - 1)
+		/ steps) - pp->done;
+
+	if (++pp->step == steps)
+		pp->step = 0;
+
+	if (n <= 0)
+		return;
+	pp->done += n;
+
+	if ((*natping_state) == 0)
+		return;
+
+	tcp_no_new_conn = 1;
+
+	if (ul.next_ucontacts(&pp->cur, n, nh_ping_ucontact, NULL) < 0)
+		LM_ERR("failed to iterate the contacts\n");
+
+	while (nh_targets) {
+		d = nh_targets;
+		nh_targets = d->next;
+		nh_ping_contact(&d->c, &d->path, d->sock,
+			d->flags, &d->next_hop);
+		pkg_free(d);
+	}
+
+	tcp_no_new_conn = 0;
+}
+
+
 static void
 nh_timer(unsigned int ticks, void *timer_idx)
 {
@@ -1251,10 +1436,7 @@ nh_timer(unsigned int ticks, void *timer_idx)
 	void *buf = NULL;
 	void *cp;
 	str c;
-	str opt;
 	str path;
-	union sockaddr_union to;
-	struct hostent *he;
 	struct socket_info* send_sock;
 	unsigned int flags;
 	struct proxy_l next_hop;
@@ -1316,48 +1498,7 @@ nh_timer(unsigned int ticks, void *timer_idx)
 		memcpy(&next_hop, cp, sizeof(next_hop));
 		cp = (char*)cp + sizeof(next_hop);
 
-		if (next_hop.proto != PROTO_NONE && next_hop.proto != PROTO_UDP &&
-		    (natping_tcp == 0 || (next_hop.proto != PROTO_TCP &&
-		                          next_hop.proto != PROTO_TLS &&
-								  next_hop.proto != PROTO_WS)))
-			continue;
-
-		LM_DBG("resolving next hop: '%.*s'\n",
-		        next_hop.name.len, next_hop.name.s);
-		he = sip_resolvehost(&next_hop.name, &next_hop.port,
-		                     &next_hop.proto, 0, NULL);
-		if (!he) {
-			LM_ERR("failed to resolve next hop: '%.*s'\n",
-			        next_hop.name.len, next_hop.name.s);
-			continue;
-		}
-
-		hostent2su(&to, he, 0, next_hop.port);
-
-		if (!send_sock) {
-			send_sock = force_socket ? force_socket :
-			                           get_send_socket(0, &to, next_hop.proto);
-			if (!send_sock) {
-				LM_ERR("can't get sending socket\n");
-				continue;
-			}
-		}
-
-		if ((flags & sipping_flag) &&
-		    (opt.s = build_sipping(&c, send_sock, &path, &opt.len))) {
-			if (msg_send(send_sock, next_hop.proto, &to, 0, opt.s, opt.len, NULL) < 0) {
-				LM_ERR("sip msg_send failed\n");
-			}
-		} else if (raw_ip && next_hop.proto == PROTO_UDP) {
-			if (send_raw((char*)sbuf, sizeof(sbuf), &to, raw_ip, raw_port)<0) {
-				LM_ERR("send_raw failed\n");
-			}
-		} else {
-			if (msg_send(send_sock, next_hop.proto, &to, 0,
-			             (char *)sbuf, sizeof(sbuf), NULL) < 0) {
-				LM_ERR("sip msg_send failed!\n");
-			}
-		}
+		nh_ping_contact(&c, &path, send_sock, flags, &next_hop);
 	}
 
 	tcp_no_new_conn = 0;
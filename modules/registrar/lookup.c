@@ -38,6 +38,7 @@
 #include "../../action.h"
 #include "../../mod_fix.h"
 #include "../../parser/parse_rr.h"
+#include "../../re.h"
 #include "../usrloc/usrloc.h"
 #include "common.h"
 #include "regtime.h"
@@ -55,7 +56,7 @@
 	if (flags & REG_LOOKUP_UAFILTER_FLAG) { \
 		tmp = *(ptr->user_agent.s+ptr->user_agent.len); \
 		*(ptr->user_agent.s+ptr->user_agent.len) = '\0'; \
-		if (regexec(&ua_re, ptr->user_agent.s, 1, &ua_match, 0)) { \
+		if (regexec(ua_re, ptr->user_agent.s, 1, &ua_match, 0)) { \
 			return; \
 		} \
 		*(ptr->user_agent.s+ptr->user_agent.len) = tmp; \
@@ -83,11 +84,12 @@ int lookup(struct sip_msg* _m, char* _t, char* _f, char* _s)
 	int ret;
 	str path_dst;
 	str flags_s;
+	str ua_s;
 	char* ua = NULL;
 	char* re_end = NULL;
 	int re_len = 0;
 	char tmp;
-	regex_t ua_re;
+	regex_t *ua_re = NULL;
 	int regexp_flags = 0;
 	regmatch_t ua_match;
 	pv_value_t val;
@@ -195,14 +197,14 @@ int lookup(struct sip_msg* _m, char* _t, char* _f, char* _s)
 	}
 
 	if (flags & REG_LOOKUP_UAFILTER_FLAG) {
-		tmp = *(ua+re_len);
-		*(ua+re_len) = '\0';
-		if (regcomp(&ua_re, ua, regexp_flags) != 0) {
-			LM_ERR("bad regexp '%s'\n", ua);
-			*(ua+re_len) = tmp;
+		ua_s.s = ua;
+		ua_s.len = re_len;
+		if ((ua_re = re_cache_get(&ua_s, regexp_flags)) == NULL) {
+			LM_ERR("bad regexp '%.*s'\n", re_len, ua);
+			ul.release_urecord(r, 0);
+			ul.unlock_udomain((udomain_t*)_t, &aor);
 			return -1;
 		}
-		*(ua+re_len) = tmp;
 	}
 
 
@@ -401,9 +403,6 @@ search_valid_contact:
 done:
 	ul.release_urecord(r, 0);
 	ul.unlock_udomain((udomain_t*)_t, &aor);
-	if (flags & REG_LOOKUP_UAFILTER_FLAG) {
-		regfree(&ua_re);
-	}
 	return ret;
 }
 
@@ -1454,7 +1454,7 @@ void uac_cb(struct cell* t, int type,struct tmcb_params *rcvd_params)
    LM_DBG("transaction %p Nr_of_outgoings:%d is_Local:%c\n",
 		   t,t->nr_of_outgoings,is_local(t)?'y':'n');
    for(i=0;i<t->nr_of_outgoings;i++)
-      LM_DBG("UAC[%d].last_received=%d\n",i,t->uac[i].last_received);
+      LM_DBG("UAC[%d].last_received=%d\n",i,t->uac[i]->last_received);
    if(!(my_as_ev=shm_malloc(sizeof(as_msg_t)))){
       LM_ERR("no more shared mem\n");
       goto error;
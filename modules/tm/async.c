@@ -33,6 +33,9 @@
 
 
 typedef struct _async_ctx {
+	/* state of the operation, when completing without fd (must be first,
+	 * the ctx is the handle given to async_op_done()) */
+	async_op_t op;
 	/* the resume function to be called when data to read is available */
 	async_resume_module *resume_f;
 	/* parameter registered to the resume function */
@@ -41,7 +44,8 @@ typedef struct _async_ctx {
 	int resume_route;
 	/* the type of the route where the suspend was done */
 	int route_type;
-	/* the processing context for the handled message */
+	/* the processing context for the handled message - it lives in the
+	 * private memory of the launching process, where the resume is done */
 	context_p msg_ctx;
 	/* the transaction for the handled message */
 	struct cell *t;
@@ -106,7 +110,7 @@ int t_resume_async(int fd, void *param)
 	backup_list = set_avp_list( &t->user_avps );
 	/* set default send address to the saved value */
 	backup_si = bind_address;
-	bind_address = t->uac[0].request.dst.send_sock;
+	bind_address = t->uac[0]->request.dst.send_sock;
 
 	async_status = ASYNC_DONE; /* assume default status as done */
 	/* call the resume function in order to read and handle data */
@@ -116,11 +120,13 @@ int t_resume_async(int fd, void *param)
 		goto restore;
 	}
 
-	/* remove from reactor, we are done */
-	reactor_del_reader( fd, -1, IO_FD_CLOSING);
+	if (fd>=0) {
+		/* remove from reactor, we are done */
+		reactor_del_reader( fd, -1, IO_FD_CLOSING);
 
-	if (async_status == ASYNC_DONE_CLOSE_FD)
-		close(fd);
+		if (async_status == ASYNC_DONE_CLOSE_FD)
+			close(fd);
+	}
 
 	/* run the resume_route (some type as the original one) */
 	swap_route_type(route, ctx->route_type);
@@ -181,48 +187,78 @@ int t_handle_async(struct sip_msg *msg, struct action* a , int resume_route)
 		goto failure;
 	}
 
+	/* the ctx is created in advance, so it can be handed to the module
+	 * function (as async_op_handle) for the operations without fd */
+	ctx = shm_malloc( sizeof(async_ctx) );
+	if (ctx==NULL) {
+		LM_ERR("failed to allocate new ctx\n");
+		goto failure;
+	}
+	async_op_init( &ctx->op );
+	async_op_handle = (void*)ctx;
+
 	async_status = ASYNC_NO_IO; /*assume defauly status "no IO done" */
 	return_code = ((acmd_export_t*)(a->elem[0].u.data))->function(msg,
 			&ctx_f, &ctx_p,
 			(char*)a->elem[1].u.data, (char*)a->elem[2].u.data,
 			(char*)a->elem[3].u.data, (char*)a->elem[4].u.data,
 			(char*)a->elem[5].u.data, (char*)a->elem[6].u.data );
+	async_op_handle = NULL;
 	/* what to do now ? */
 	if (async_status>=0) {
 		/* async I/O was succesfully launched */
 		fd = async_status;
+	} else if (async_status==ASYNC_NO_FD) {
+		/* async op launched, its completion will be reported via
+		 * async_op_done() */
+		fd = -1;
 	} else if (async_status==ASYNC_NO_IO) {
 		/* no IO, so simply go for resume route */
+		shm_free(ctx);
 		goto resume;
 	} else if (async_status==ASYNC_SYNC) {
 		/* IO already done in SYNC'ed way */
+		shm_free(ctx);
 		goto resume;
 	} else {
-		/* generic error, go for resume route */
+		/* generic error, go for resume route; a completion reported
+		 * meanwhile via async_op_done() queued nothing, so the ctx
+		 * may be safely released */
+		shm_free(ctx);
 		goto resume;
 	}
 
+	ctx->resume_f = ctx_f;
+	ctx->resume_param = ctx_p;
+	ctx->resume_route = resume_route;
+	ctx->route_type = route_type;
+	ctx->msg_ctx = current_processing_ctx;
+	ctx->t = t;
+	ctx->kr = get_kr();
+
 	/* do we have a reactor in this process, to handle this 
 	   asyn I/O ? */
-	if ( 0/*reactor_exists()*/ ) {
+	if ( fd>=0 && 0/*reactor_exists()*/ ) {
 		/* no reactor, so we directly call the resume function
 		   which will block waiting for data */
+		shm_free(ctx);
 		goto sync;
 	}
 
-	if ( (ctx=shm_malloc(sizeof(async_ctx)))==NULL) {
-		LM_ERR("failed to allocate new ctx\n");
-		goto sync;
+	if (fd<0) {
+		/* from now on, the completion is dispatched back to us */
+		if (!async_op_suspend( &ctx->op )) {
+			/* already completed, no need to suspend at all */
+			shm_free(ctx);
+			return_code = ctx_f( -1, msg, ctx_p );
+			run_resume_route( resume_route, msg);
+			return 0;
+		}
+		current_processing_ctx = NULL;
+		set_t(T_UNDEFINED);
+		return 0;
 	}
 
-	ctx->resume_f = ctx_f;
-	ctx->resume_param = ctx_p;
-	ctx->resume_route = resume_route;
-	ctx->route_type = route_type;
-	ctx->msg_ctx = current_processing_ctx;
-	ctx->t = t;
-	ctx->kr = get_kr();
-
 	current_processing_ctx = NULL;
 	set_t(T_UNDEFINED);
 
@@ -28,11 +28,13 @@
 #include "../../config.h"
 
 
-/* size of TM hash table */
+/* default size of TM hash table (see the "hash_size" module parameter) */
 #define TM_TABLE_ENTRIES     (1<<16)
 
-/* always use a power of 2 for hash table size */
-#define tm_hash( s1, s2 )     core_hash( &s1, &s2, TM_TABLE_ENTRIES)
+/* actual size of the TM hash table, always a power of 2 */
+extern int tm_hash_size;
+
+#define tm_hash( s1, s2 )     core_hash( &s1, &s2, tm_hash_size)
 
 /* maximum length of localy generated acknowledgment */
 #define MAX_ACK_LEN   1024
@@ -54,6 +56,11 @@
 #define RETR_T1           500        /* in milliseconds */
 #define RETR_T2           4000       /* in milliseconds */
 
+/* max number of UDP retransmissions pushed with a single sendmmsg() and
+   the space available for holding their buffers */
+#define TM_RETR_BATCH       64
+#define TM_RETR_BATCH_BUF   (1<<16)
+
 /* when first reply is sent, this additional space is allocated so that
    one does not have to reallocate share memory when the message is
    replaced by a subsequent, longer message
@@ -58,6 +58,9 @@
 /* indicates how much we have to shift the transaction pointer in order to
  * obtain a fair distribution on the tm timers */
 int tm_timer_shift = 0;
+
+/* number of entries in the transaction hash table (power of 2) */
+int tm_hash_size = TM_TABLE_ENTRIES;
 static enum kill_reason kr;
 
 /* pointer to the big table where all the transaction data
@@ -107,12 +110,27 @@ unsigned int transaction_count( void )
 	unsigned int count;
 
 	count=0;
-	for (i=0; i<TM_TABLE_ENTRIES; i++)
+	for (i=0; i<tm_hash_size; i++)
 		count+=tm_table->entrys[i].cur_entries;
 	return count;
 }
 
 
+/* longest synonym list in the hash table (no locking, it is a
+ * statistic only) */
+unsigned long tm_hash_max_chain( unsigned short foo )
+{
+	unsigned int i;
+	unsigned long max;
+
+	max=0;
+	for (i=0; i<tm_hash_size; i++)
+		if (tm_table->entrys[i].cur_entries>max)
+			max=tm_table->entrys[i].cur_entries;
+	return max;
+}
+
+
 void free_cell( struct cell* dead_cell )
 {
 	char *b;
@@ -141,16 +159,16 @@ void free_cell( struct cell* dead_cell )
 	for ( i =0 ; i<dead_cell->nr_of_outgoings;  i++ )
 	{
 		/* retransmission buffer */
-		if ( (b=dead_cell->uac[i].request.buffer.s) )
+		if ( (b=dead_cell->uac[i]->request.buffer.s) )
 			tm_shm_free_unsafe( b );
-		b=dead_cell->uac[i].local_cancel.buffer.s;
+		b=dead_cell->uac[i]->local_cancel.buffer.s;
 		if (b!=0 && b!=BUSY_BUFFER)
 			tm_shm_free_unsafe( b );
-		rpl=dead_cell->uac[i].reply;
+		rpl=dead_cell->uac[i]->reply;
 		if (rpl && rpl!=FAKED_REPLY && rpl->msg_flags&FL_SHM_CLONE) {
 			free_cloned_msg_unsafe( rpl );
 		}
-		if ( (p=dead_cell->uac[i].proxy)!=NULL ) {
+		if ( (p=dead_cell->uac[i]->proxy)!=NULL ) {
 			if ( p->host.h_addr_list )
 				tm_shm_free_unsafe( p->host.h_addr_list );
 			if ( p->dn ) {
@@ -160,16 +178,19 @@ void free_cell( struct cell* dead_cell )
 			}
 			tm_shm_free_unsafe(p);
 		}
-		if (dead_cell->uac[i].path_vec.s) {
-			tm_shm_free_unsafe(dead_cell->uac[i].path_vec.s);
+		if (dead_cell->uac[i]->path_vec.s) {
+			tm_shm_free_unsafe(dead_cell->uac[i]->path_vec.s);
 		}
-		if (dead_cell->uac[i].duri.s) {
-			tm_shm_free_unsafe(dead_cell->uac[i].duri.s);
+		if (dead_cell->uac[i]->duri.s) {
+			tm_shm_free_unsafe(dead_cell->uac[i]->duri.s);
 		}
-		if (dead_cell->uac[i].user_avps) {
-			tm_destroy_avp_list_unsafe( &dead_cell->uac[i].user_avps);
+		if (dead_cell->uac[i]->user_avps) {
+			tm_destroy_avp_list_unsafe( &dead_cell->uac[i]->user_avps);
 		}
 	}
+	/* on demand allocated UACs (the first one is part of the cell) */
+	for ( i=1 ; i<MAX_BRANCHES && dead_cell->uac[i] ; i++ )
+		tm_shm_free_unsafe( dead_cell->uac[i] );
 
 	/* collected to tags */
 	tt=dead_cell->fwded_totags;
@@ -227,26 +248,44 @@ static inline void init_synonym_id( struct cell *t )
 	}
 }
 
-static inline void init_branches(struct cell *t, unsigned int set)
+static inline void init_uac(struct cell *t, unsigned int branch,
+												struct ua_client *uac)
 {
-	unsigned int i;
-	struct ua_client *uac;
+	unsigned short set;
 
-	for(i=0;i<MAX_BRANCHES;i++)
-	{
-		uac=&t->uac[i];
-		uac->request.my_T = t;
-		uac->request.branch = i;
+	/* same timer set as for the whole transaction */
+	set = t->uas.response.fr_timer.set;
+
+	uac->request.my_T = t;
+	uac->request.branch = branch;
 #ifdef EXTRA_DEBUG
-		uac->request.fr_timer.tg = TG_FR;
-		uac->request.retr_timer.tg = TG_RT;
+	uac->request.fr_timer.tg = TG_FR;
+	uac->request.retr_timer.tg = TG_RT;
 #endif
-		uac->request.fr_timer.set = set;
-		uac->request.retr_timer.set = set;
-		uac->local_cancel.fr_timer.set = set;
-		uac->local_cancel.retr_timer.set = set;
-		uac->local_cancel=uac->request;
+	uac->request.fr_timer.set = set;
+	uac->request.retr_timer.set = set;
+	uac->local_cancel=uac->request;
+}
+
+
+/* makes sure the UAC for the given branch exists; returns 0 on success */
+int alloc_uac(struct cell *t, unsigned int branch)
+{
+	struct ua_client *uac;
+
+	if (t->uac[branch])
+		return 0;
+
+	uac = (struct ua_client*)shm_malloc(sizeof(struct ua_client));
+	if (uac==NULL) {
+		LM_ERR("no more shm mem for a new branch\n");
+		return -1;
 	}
+	memset( uac, 0, sizeof(struct ua_client));
+	init_uac( t, branch, uac);
+
+	t->uac[branch] = uac;
+	return 0;
 }
 
 
@@ -282,6 +321,10 @@ struct cell*  build_cell( struct sip_msg* p_msg, int full_uas)
 	new_cell->uas.response.fr_timer.set = set;
 	new_cell->uas.response.my_T=new_cell;
 
+	/* first UAC (the rest are allocated on demand) */
+	new_cell->uac[0] = &new_cell->first_uac;
+	init_uac(new_cell, 0, new_cell->uac[0]);
+
 	/* dcm: - local generation transactions should not inherit AVPs
 	 * - commpletely new message */
 	if(p_msg) {
@@ -314,10 +357,9 @@ struct cell*  build_cell( struct sip_msg* p_msg, int full_uas)
 		if (!new_cell->uas.request)
 			goto error;
 		new_cell->uas.end_request=((char*)new_cell->uas.request)+sip_msg_len;
+		stats_trans_clone(sip_msg_len);
 	}
 
-	/* UAC */
-	init_branches(new_cell, set);
 	new_cell->fr_timeout = fr_timeout;
 	new_cell->fr_inv_timeout = fr_inv_timeout;
 
@@ -364,7 +406,7 @@ void free_hash_table(void)
 	if (tm_table)
 	{
 		/* remove the data contained by each entry */
-		for( i = 0 ; i<TM_TABLE_ENTRIES; i++)
+		for( i = 0 ; i<tm_hash_size; i++)
 		{
 			release_entry_lock( (tm_table->entrys)+i );
 			/* delete all synonyms at hash-collision-slot i */
@@ -387,18 +429,21 @@ struct s_table* init_hash_table( unsigned int timer_sets )
 	int              i;
 
 	/*allocs the table*/
-	tm_table= (struct s_table*)shm_malloc( sizeof( struct s_table ) );
+	tm_table= (struct s_table*)shm_malloc( sizeof( struct s_table ) +
+		tm_hash_size * sizeof( struct entry ) );
 	if ( !tm_table) {
 		LM_ERR("no more share memory\n");
 		goto error;
 	}
 
-	memset( tm_table, 0, sizeof (struct s_table ) );
+	memset( tm_table, 0, sizeof (struct s_table ) +
+		tm_hash_size * sizeof( struct entry ) );
+	tm_table->entrys = (struct entry*)(tm_table + 1);
 
 	tm_table->timer_sets = timer_sets;
 
 	/* inits the entrys */
-	for(  i=0 ; i<TM_TABLE_ENTRIES; i++ )
+	for(  i=0 ; i<tm_hash_size; i++ )
 	{
 		init_entry_lock( tm_table, (tm_table->entrys)+i );
 		tm_table->entrys[i].next_label = rand();
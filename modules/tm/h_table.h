@@ -219,6 +219,11 @@ typedef struct cell
 	unsigned int  label;
 	/* different information about the transaction */
 	unsigned int flags;
+	/* number of forks */
+	int nr_of_outgoings;
+
+	/* MD5checksum  (meaningful only if syn_branch=0) */
+	char md5[MD5_LEN];
 
 	/* how many processes are currently processing this transaction ;
 	   note that only processes working on a request/reply belonging
@@ -242,25 +247,26 @@ typedef struct cell
 	   original message; needed for reply matching */
 	str method;
 
-	/* head of callback list */
-	struct tmcb_head_list tmcb_hl;
-
-	/* bindings to wait and delete timer */
-	struct timer_link wait_tl;
-	struct timer_link dele_tl;
+	/* UA Clients - allocated on demand (see alloc_uac()), except for
+	 * the first one which is embedded into the cell; only the first
+	 * nr_of_outgoings are valid */
+	struct ua_client  *uac[ MAX_BRANCHES ];
+	/* UA Server */
+	struct ua_server  uas;
 
 	/* first branch - when serial forking is performed, keeps the first
 	 * branch for each step ; it allows proper branch selection */
 	int first_branch;
-	/* number of forks */
-	int nr_of_outgoings;
 	/* nr of replied branch; 0..MAX_BRANCHES=branch value,
 	 * -1 no reply, -2 local reply */
 	int relaied_reply_branch;
-	/* UA Server */
-	struct ua_server  uas;
-	/* UA Clients */
-	struct ua_client  uac[ MAX_BRANCHES ];
+
+	/* head of callback list */
+	struct tmcb_head_list tmcb_hl;
+
+	/* bindings to wait and delete timer */
+	struct timer_link wait_tl;
+	struct timer_link dele_tl;
 
 	/* protection against concurrent reply processing */
 	ser_lock_t   reply_mutex;
@@ -275,9 +281,6 @@ typedef struct cell
 	int fr_timeout;     /* final reply timeout (sec) */
 	int fr_inv_timeout; /* final reply timeout for an INVITE, after 1XX (sec) */
 
-	/* MD5checksum  (meaningful only if syn_branch=0) */
-	char md5[MD5_LEN];
-
 #ifdef	EXTRA_DEBUG
 	/* scheduled for deletion ? */
 	short damocles;
@@ -296,6 +299,9 @@ typedef struct cell
 
 	/* extra T headers */
 	str extra_hdrs;
+
+	/* storage of the first UAC */
+	struct ua_client  first_uac;
 }cell_type;
 
 
@@ -318,8 +324,9 @@ typedef struct entry
 /* transaction table */
 struct s_table
 {
-	/* table of hash entries; each of them is a list of synonyms  */
-	struct entry   entrys[ TM_TABLE_ENTRIES ];
+	/* table of hash entries (tm_hash_size of them); each of them is a
+	 * list of synonyms  */
+	struct entry   *entrys;
 	/* we keep it here just as a shortcut, we need it for assigning
 	 * a transaction to a specific timer set */
 	unsigned short timer_sets;
@@ -372,6 +379,7 @@ struct s_table* init_hash_table(unsigned int timer_sets);
 void   free_hash_table( void );
 void   free_cell( struct cell* dead_cell );
 struct cell*  build_cell( struct sip_msg* p_msg, int full_uas );
+int alloc_uac(struct cell *t, unsigned int branch);
 void   remove_from_hash_table_unsafe( struct cell * p_cell);
 #ifdef OBSOLETED
 void   insert_into_hash_table( struct cell * p_cell, unsigned int _hash);
@@ -379,6 +387,7 @@ void   insert_into_hash_table( struct cell * p_cell, unsigned int _hash);
 void   insert_into_hash_table_unsafe( struct cell * p_cell, unsigned int _hash );
 
 unsigned int transaction_count( void );
+unsigned long tm_hash_max_chain( unsigned short foo );
 
 /* Unix socket variant */
 int unixsock_hash(str* msg);
@@ -610,7 +610,7 @@ struct mi_root* mi_tm_hash(struct mi_root* cmd_tree, void* param)
 	rpl = &rpl_tree->node;
 	tm_t = get_tm_table();
 
-	for (i=0; i<TM_TABLE_ENTRIES; i++) {
+	for (i=0; i<tm_hash_size; i++) {
 		p = int2str((unsigned long)i, &len );
 		node = add_mi_node_child(rpl, MI_DUP_VALUE , 0, 0, p, len);
 		if(node == NULL)
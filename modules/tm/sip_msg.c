@@ -53,6 +53,7 @@
 #include "../../ut.h"
 #include "../../context.h"
 #include "../../parser/digest/digest.h"
+#include "../../parser/parse_via.h"
 
 
 /* rounds to the first 4 byte multiple on 32 bit archs
@@ -78,6 +79,11 @@
 
 
 
+/* if set, the parsed bodies not needed by TM itself (2nd and further Vias,
+ * credentials) are not cloned for the requests - they are rebuilt on
+ * demand in the failure/resume routes */
+int tm_compact_clone = 0;
+
 
 inline static struct via_body* via_body_cloner( char* new_buf,
 					char *org_buf, struct via_body *param_org_via, char **p)
@@ -411,6 +417,9 @@ struct sip_msg*  sip_msg_cloner( struct sip_msg *org_msg, int *sip_msg_len,
 	struct to_param   *to_prm,*new_to_prm;
 	struct sip_msg    *new_msg;
 	char              *p;
+	int               compact;
+
+	compact = tm_compact_clone && org_msg->first_line.type==SIP_REQUEST;
 
 	/*computing the length of entire sip_msg structure*/
 	len = ROUND4(sizeof( struct sip_msg ));
@@ -425,6 +434,8 @@ struct sip_msg*  sip_msg_cloner( struct sip_msg *org_msg, int *sip_msg_len,
 		switch (hdr->type)
 		{
 			case HDR_VIA_T:
+				if (compact && hdr!=org_msg->h_via1)
+					break;
 				for (via=(struct via_body*)hdr->parsed;via;via=via->next)
 				{
 					len+=ROUND4(sizeof(struct via_body));
@@ -452,7 +463,7 @@ struct sip_msg*  sip_msg_cloner( struct sip_msg *org_msg, int *sip_msg_len,
 
 			case HDR_AUTHORIZATION_T:
 			case HDR_PROXYAUTH_T:
-				if (hdr->parsed) {
+				if (hdr->parsed && !compact) {
 					len += ROUND4(AUTH_BODY_SIZE);
 				}
 				break;
@@ -638,6 +649,13 @@ struct sip_msg*  sip_msg_cloner( struct sip_msg *org_msg, int *sip_msg_len,
 					if ( new_msg->via1->next )
 						new_msg->via2 = new_msg->via1->next;
 				}
+				else if ( compact )
+				{
+					/* body left unparsed, see expand_compact_clone() */
+					LINK_SIBLING_HEADER(h_via1, new_hdr);
+					if ( org_msg->h_via2==hdr )
+						new_msg->h_via2 = new_hdr;
+				}
 				else if ( !new_msg->via2 )
 				{
 					LINK_SIBLING_HEADER(h_via1, new_hdr);
@@ -772,7 +790,7 @@ struct sip_msg*  sip_msg_cloner( struct sip_msg *org_msg, int *sip_msg_len,
 				} else {
 					LINK_SIBLING_HEADER(authorization, new_hdr);
 				}
-				if (hdr->parsed) {
+				if (hdr->parsed && !compact) {
 					new_hdr->parsed = auth_body_cloner(new_msg->buf ,
 						org_msg->buf , (struct auth_body*)hdr->parsed , &p);
 				}
@@ -788,7 +806,7 @@ struct sip_msg*  sip_msg_cloner( struct sip_msg *org_msg, int *sip_msg_len,
 				} else {
 					LINK_SIBLING_HEADER(proxy_auth, new_hdr);
 				}
-				if (hdr->parsed) {
+				if (hdr->parsed && !compact) {
 					new_hdr->parsed = auth_body_cloner(new_msg->buf ,
 						org_msg->buf , (struct auth_body*)hdr->parsed , &p);
 				}
@@ -959,7 +977,9 @@ struct sip_msg*  sip_msg_cloner( struct sip_msg *org_msg, int *sip_msg_len,
 		new_msg->last_header = last_hdr;
 	}
 
-	if (clone_authorized_hooks(new_msg, org_msg) < 0) {
+	if (compact) {
+		new_msg->msg_flags |= FL_SHM_COMPACT;
+	} else if (clone_authorized_hooks(new_msg, org_msg) < 0) {
 		free_cloned_msg(new_msg);
 		return 0;
 	}
@@ -1084,6 +1104,41 @@ struct sip_msg*  sip_msg_cloner( struct sip_msg *org_msg, int *sip_msg_len,
 }
 
 
+/* Parses (in pkg mem) the Via bodies left out by a compact cloning of the
+ * request; to be used on a faked request only, as the parsed bodies are
+ * released by clean_msg_clone() */
+void expand_compact_clone(struct sip_msg *msg)
+{
+	struct hdr_field *hdr;
+	struct via_body *vb;
+
+	for( hdr=msg->h_via1 ; hdr ; hdr=hdr->sibling ) {
+		if (hdr->parsed)
+			continue;
+		vb = (struct via_body*)pkg_malloc(sizeof(struct via_body));
+		if (vb==NULL) {
+			LM_ERR("no more pkg mem\n");
+			return;
+		}
+		memset( vb, 0, sizeof(struct via_body));
+		/* as when the request was parsed, the parser has to see past
+		 * the end of the (trimmed) body - the line terminator and the
+		 * start of the next line, to rule out a folded header */
+		parse_via( hdr->body.s, msg->buf+msg->len, vb);
+		if (vb->error==PARSE_ERROR) {
+			LM_ERR("failed to parse Via <%.*s>\n",
+				hdr->body.len, hdr->body.s);
+			free_via_list(vb);
+			continue;
+		}
+		vb->hdr = hdr->name;
+		hdr->parsed = vb;
+		if (hdr==msg->h_via2 && msg->via2==NULL)
+			msg->via2 = vb;
+	}
+}
+
+
 #define REALLOC_CLONED_FIELD_unsafe( _field, _old, _new, _bit) \
 	do { \
 		if ( _new->_field.len==0) { \
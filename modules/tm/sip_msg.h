@@ -90,9 +90,13 @@
 	}while(0)
 
 
+extern int tm_compact_clone;
+
 struct sip_msg*  sip_msg_cloner( struct sip_msg *org_msg, int *sip_msg_len,
 		int updatable );
 
+void expand_compact_clone(struct sip_msg *msg);
+
 
 static inline void clean_msg_clone(struct sip_msg *msg,void *min, void *max)
 {
@@ -81,8 +81,8 @@ void cancel_branch( struct cell *t, int branch )
 	unsigned int len;
 	struct retr_buf *crb, *irb;
 
-	crb=&t->uac[branch].local_cancel;
-	irb=&t->uac[branch].request;
+	crb=&t->uac[branch]->local_cancel;
+	irb=&t->uac[branch]->request;
 
 #	ifdef EXTRA_DEBUG
 	if (crb->buffer.s!=0 && crb->buffer.s!=BUSY_BUFFER) {
@@ -106,14 +106,14 @@ static inline int pre_print_uac_request( struct cell *t, int branch,
 
 	/* copy path vector into branch */
 	if (request->path_vec.len) {
-		t->uac[branch].path_vec.s =
-			shm_resize(t->uac[branch].path_vec.s, request->path_vec.len+1);
-		if (t->uac[branch].path_vec.s==NULL) {
+		t->uac[branch]->path_vec.s =
+			shm_resize(t->uac[branch]->path_vec.s, request->path_vec.len+1);
+		if (t->uac[branch]->path_vec.s==NULL) {
 			LM_ERR("shm_resize failed\n");
 			goto error;
 		}
-		t->uac[branch].path_vec.len = request->path_vec.len;
-		memcpy( t->uac[branch].path_vec.s, request->path_vec.s,
+		t->uac[branch]->path_vec.len = request->path_vec.len;
+		memcpy( t->uac[branch]->path_vec.s, request->path_vec.s,
 			request->path_vec.len+1);
 	}
 
@@ -171,14 +171,14 @@ static inline int pre_print_uac_request( struct cell *t, int branch,
 
 	/* copy dst_uri into branch (after branch route possible updated it) */
 	if (request->dst_uri.len) {
-		t->uac[branch].duri.s =
-			shm_resize(t->uac[branch].duri.s, request->dst_uri.len);
-		if (t->uac[branch].duri.s==NULL) {
+		t->uac[branch]->duri.s =
+			shm_resize(t->uac[branch]->duri.s, request->dst_uri.len);
+		if (t->uac[branch]->duri.s==NULL) {
 			LM_ERR("shm_resize failed\n");
 			goto error;
 		}
-		t->uac[branch].duri.len = request->dst_uri.len;
-		memcpy( t->uac[branch].duri.s,request->dst_uri.s,request->dst_uri.len);
+		t->uac[branch]->duri.len = request->dst_uri.len;
+		memcpy( t->uac[branch]->duri.s,request->dst_uri.s,request->dst_uri.len);
 	}
 
 	return 0;
@@ -254,10 +254,13 @@ int add_blind_uac(void)  /*struct cell *t*/
 		return -1;
 	}
 
+	if (alloc_uac(t, branch)<0)
+		return -1;
+
 	t->nr_of_outgoings++;
 	/* start FR timer -- protocol set by default to PROTO_NONE,
 	   which means retransmission timer will not be started */
-	start_retr(&t->uac[branch].request);
+	start_retr(&t->uac[branch]->request);
 	/* we are on a timer -- don't need to put on wait on script
 	   clean-up */
 	set_kr(REQ_FWDED);
@@ -350,8 +353,13 @@ static int add_uac( struct cell *t, struct sip_msg *request, str *uri,
 		goto error;
 	}
 
+	if (alloc_uac(t, branch)<0) {
+		ret=ser_error=E_OUT_OF_MEM;
+		goto error;
+	}
+
 	/* check existing buffer -- rewriting should never occur */
-	if (t->uac[branch].request.buffer.s) {
+	if (t->uac[branch]->request.buffer.s) {
 		LM_CRIT("buffer rewrite attempt\n");
 		ret=ser_error=E_BUG;
 		goto error;
@@ -387,29 +395,29 @@ static int add_uac( struct cell *t, struct sip_msg *request, str *uri,
 	msg_callback_process(request, REQ_PRE_FORWARD, (void *)proxy);
 
 	if ( !(t->flags&T_NO_DNS_FAILOVER_FLAG) ) {
-		t->uac[branch].proxy = shm_clone_proxy( proxy , do_free_proxy );
-		if (t->uac[branch].proxy==NULL) {
+		t->uac[branch]->proxy = shm_clone_proxy( proxy , do_free_proxy );
+		if (t->uac[branch]->proxy==NULL) {
 			ret = E_OUT_OF_MEM;
 			goto error02;
 		}
 	}
 
 	/* use the first address */
-	hostent2su( &t->uac[branch].request.dst.to,
+	hostent2su( &t->uac[branch]->request.dst.to,
 		&proxy->host, proxy->addr_idx, proxy->port ? proxy->port:SIP_PORT);
-	t->uac[branch].request.dst.proto = proxy->proto;
+	t->uac[branch]->request.dst.proto = proxy->proto;
 
-	if ( update_uac_dst( request, &t->uac[branch] )!=0) {
+	if ( update_uac_dst( request, t->uac[branch] )!=0) {
 		ret = ser_error;
 		goto error02;
 	}
 
 	/* things went well, move ahead */
-	t->uac[branch].uri.s=t->uac[branch].request.buffer.s+
+	t->uac[branch]->uri.s=t->uac[branch]->request.buffer.s+
 		request->first_line.u.request.method.len+1;
-	t->uac[branch].uri.len=request->new_uri.len;
-	t->uac[branch].br_flags = request->ruri_bflags;
-	t->uac[branch].added_rr = count_local_rr( request );
+	t->uac[branch]->uri.len=request->new_uri.len;
+	t->uac[branch]->br_flags = request->ruri_bflags;
+	t->uac[branch]->added_rr = count_local_rr( request );
 	t->nr_of_outgoings++;
 
 	/* done! */
@@ -436,19 +444,24 @@ int e2e_cancel_branch( struct sip_msg *cancel_msg, struct cell *t_cancel,
 	str bk_dst_uri;
 	str bk_path_vec;
 
-	if (t_cancel->uac[branch].request.buffer.s) {
+	if (alloc_uac(t_cancel, branch)<0) {
+		ret=ser_error=E_OUT_OF_MEM;
+		goto error;
+	}
+
+	if (t_cancel->uac[branch]->request.buffer.s) {
 		LM_CRIT("buffer rewrite attempt\n");
 		ret=ser_error=E_BUG;
 		goto error;
 	}
 
-	cancel_msg->new_uri = t_invite->uac[branch].uri;
+	cancel_msg->new_uri = t_invite->uac[branch]->uri;
 	cancel_msg->parsed_uri_ok=0;
 	bk_dst_uri = cancel_msg->dst_uri;
 	bk_path_vec = cancel_msg->path_vec;
 
 	/* force same path as for request */
-	cancel_msg->path_vec = t_invite->uac[branch].path_vec;
+	cancel_msg->path_vec = t_invite->uac[branch]->path_vec;
 
 	if ( pre_print_uac_request( t_cancel, branch, cancel_msg)!= 0 ) {
 		ret = -1;
@@ -456,17 +469,17 @@ int e2e_cancel_branch( struct sip_msg *cancel_msg, struct cell *t_cancel,
 	}
 
 	/* force same uri as in INVITE */
-	if (cancel_msg->new_uri.s!=t_invite->uac[branch].uri.s) {
+	if (cancel_msg->new_uri.s!=t_invite->uac[branch]->uri.s) {
 		pkg_free(cancel_msg->new_uri.s);
-		cancel_msg->new_uri = t_invite->uac[branch].uri;
+		cancel_msg->new_uri = t_invite->uac[branch]->uri;
 		/* and just to be sure */
 		cancel_msg->parsed_uri_ok = 0;
 	}
 
 	/* print */
 	shbuf=print_uac_request( cancel_msg, &len,
-		t_invite->uac[branch].request.dst.send_sock,
-		t_invite->uac[branch].request.dst.proto);
+		t_invite->uac[branch]->request.dst.send_sock,
+		t_invite->uac[branch]->request.dst.proto);
 	if (!shbuf) {
 		LM_ERR("printing e2e cancel failed\n");
 		ret=ser_error=E_OUT_OF_MEM;
@@ -474,19 +487,19 @@ int e2e_cancel_branch( struct sip_msg *cancel_msg, struct cell *t_cancel,
 	}
 
 	/* install buffer */
-	t_cancel->uac[branch].request.dst=t_invite->uac[branch].request.dst;
-	t_cancel->uac[branch].request.buffer.s=shbuf;
-	t_cancel->uac[branch].request.buffer.len=len;
-	t_cancel->uac[branch].uri.s=t_cancel->uac[branch].request.buffer.s+
+	t_cancel->uac[branch]->request.dst=t_invite->uac[branch]->request.dst;
+	t_cancel->uac[branch]->request.buffer.s=shbuf;
+	t_cancel->uac[branch]->request.buffer.len=len;
+	t_cancel->uac[branch]->uri.s=t_cancel->uac[branch]->request.buffer.s+
 		cancel_msg->first_line.u.request.method.len+1;
-	t_cancel->uac[branch].uri.len=t_invite->uac[branch].uri.len;
-	t_cancel->uac[branch].br_flags = cancel_msg->flags;
+	t_cancel->uac[branch]->uri.len=t_invite->uac[branch]->uri.len;
+	t_cancel->uac[branch]->br_flags = cancel_msg->flags;
 
 	/* success */
 	ret=1;
 
 error01:
-	post_print_uac_request( cancel_msg, &t_invite->uac[branch].uri,
+	post_print_uac_request( cancel_msg, &t_invite->uac[branch]->uri,
 		&bk_dst_uri);
 	cancel_msg->dst_uri = bk_dst_uri;
 	cancel_msg->path_vec = bk_path_vec;
@@ -546,10 +559,10 @@ void cancel_invite(struct sip_msg *cancel_msg,
 
 	/* internally cancel branches with no received reply */
 	for (i=t_invite->first_branch; i<t_invite->nr_of_outgoings; i++) {
-		if (t_invite->uac[i].last_received==0){
+		if (t_invite->uac[i]->last_received==0){
 			/* reset the "request" timers */
-			reset_timer(&t_invite->uac[i].request.retr_timer);
-			reset_timer(&t_invite->uac[i].request.fr_timer);
+			reset_timer(&t_invite->uac[i]->request.retr_timer);
+			reset_timer(&t_invite->uac[i]->request.fr_timer);
 			LOCK_REPLIES( t_invite );
 			relay_reply(t_invite,FAKED_REPLY,i,487,&dummy_bm);
 		}
@@ -671,20 +684,20 @@ int t_forward_nonack( struct cell *t, struct sip_msg* p_msg ,
 	for (i=t->first_branch; i<t->nr_of_outgoings; i++) {
 		if (added_branches & (1<<i)) {
 
-			if (t->uac[i].br_flags & tcp_no_new_conn_bflag)
+			if (t->uac[i]->br_flags & tcp_no_new_conn_bflag)
 				tcp_no_new_conn = 1;
 
 			do {
-				if (check_blacklists( t->uac[i].request.dst.proto,
-				&t->uac[i].request.dst.to,
-				t->uac[i].request.buffer.s,
-				t->uac[i].request.buffer.len)) {
+				if (check_blacklists( t->uac[i]->request.dst.proto,
+				&t->uac[i]->request.dst.to,
+				t->uac[i]->request.buffer.s,
+				t->uac[i]->request.buffer.len)) {
 					LM_DBG("blocked by blacklists\n");
 					ser_error=E_IP_BLOCKED;
 				} else {
 					run_trans_callbacks(TMCB_PRE_SEND_BUFFER, t, p_msg, 0, i);
 
-					if (SEND_BUFFER( &t->uac[i].request)==0) {
+					if (SEND_BUFFER( &t->uac[i]->request)==0) {
 						ser_error = 0;
 						break;
 					}
@@ -693,34 +706,34 @@ int t_forward_nonack( struct cell *t, struct sip_msg* p_msg ,
 					ser_error=E_SEND;
 				}
 				/* get next dns entry */
-				if ( t->uac[i].proxy==0 ||
-				get_next_su( t->uac[i].proxy, &t->uac[i].request.dst.to,
+				if ( t->uac[i]->proxy==0 ||
+				get_next_su( t->uac[i]->proxy, &t->uac[i]->request.dst.to,
 				(ser_error==E_IP_BLOCKED)?0:1)!=0 )
 					break;
-				t->uac[i].request.dst.proto = t->uac[i].proxy->proto;
+				t->uac[i]->request.dst.proto = t->uac[i]->proxy->proto;
 				/* update branch */
-				if ( update_uac_dst( p_msg, &t->uac[i] )!=0)
+				if ( update_uac_dst( p_msg, t->uac[i] )!=0)
 					break;
 			}while(1);
 
 			tcp_no_new_conn = 0;
 
 			if (ser_error) {
-				shm_free(t->uac[i].request.buffer.s);
-				t->uac[i].request.buffer.s = NULL;
-				t->uac[i].request.buffer.len = 0;
+				shm_free(t->uac[i]->request.buffer.s);
+				t->uac[i]->request.buffer.s = NULL;
+				t->uac[i]->request.buffer.len = 0;
 				continue;
 			}
 
 			success_branch++;
 
-			start_retr( &t->uac[i].request );
+			start_retr( &t->uac[i]->request );
 			set_kr(REQ_FWDED);
 
 			/* successfully sent out -> run callbacks */
 			if ( has_tran_tmcbs( t, TMCB_REQUEST_BUILT) ) {
-				set_extra_tmcb_params( &t->uac[i].request.buffer,
-					&t->uac[i].request.dst);
+				set_extra_tmcb_params( &t->uac[i]->request.buffer,
+					&t->uac[i]->request.dst);
 				run_trans_callbacks( TMCB_REQUEST_BUILT, t, p_msg,0,
 					-p_msg->REQ_METHOD);
 			}
@@ -82,6 +82,7 @@ struct cell;
  *
  * TMCB_RESPONSE_IN -- a brand-new reply was received which matches
  *  an existing transaction. It may or may not be a retransmission.
+ *  The extra1 param points to the index (int) of the matched branch.
  *
  * TMCB_RESPONSE_PRE_OUT -- a final reply is about to be sent out
  *  (either local or proxied); you cannnot change the reply, but
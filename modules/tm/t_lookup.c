@@ -748,7 +748,7 @@ int t_reply_matching( struct sip_msg *p_msg , int *p_branch )
 
 	/* sanity check */
 	if ((hash_index=reverse_hex2int(hashi, hashl))<0
-		||hash_index>=TM_TABLE_ENTRIES
+		||hash_index>=tm_hash_size
 		|| (branch_id=reverse_hex2int(branchi, branchl))<0
 		||branch_id>=MAX_BRANCHES
 		|| (syn_branch ? (entry_label=reverse_hex2int(syni, synl))<0
@@ -787,7 +787,7 @@ int t_reply_matching( struct sip_msg *p_msg , int *p_branch )
 		   as canceled transactions) */
 		if (!( /* it's a local cancel */
 			(cseq->method_id==METHOD_CANCEL && is_invite(p_cell)
-				&& p_cell->uac[branch_id].local_cancel.buffer.len )
+				&& p_cell->uac[branch_id]->local_cancel.buffer.len )
 			/* method match */
 			|| ((cseq->method_id!=METHOD_OTHER && p_cell->uas.request)?
 				(cseq->method_id==REQ_LINE(p_cell->uas.request).method_value)
@@ -821,7 +821,10 @@ int t_reply_matching( struct sip_msg *p_msg , int *p_branch )
 			}
 		}
 		if (!is_local(p_cell) &&
-		!(cseq->method_id==METHOD_CANCEL && is_invite(p_cell)) ) {
+		!(cseq->method_id==METHOD_CANCEL && is_invite(p_cell)) &&
+		has_tran_tmcbs(T, TMCB_RESPONSE_IN) ) {
+			/* let the callbacks know the branch of the reply */
+			set_extra_tmcb_params( &branch_id, 0);
 			run_trans_callbacks( TMCB_RESPONSE_IN, T, T->uas.request, p_msg,
 				p_msg->REPLY_STATUS);
 		}
@@ -1163,7 +1166,7 @@ int t_lookup_ident(struct cell ** trans, unsigned int hash_index,
 {
 	struct cell* p_cell;
 
-	if(hash_index >= TM_TABLE_ENTRIES){
+	if(hash_index >= tm_hash_size){
 		LM_ERR("invalid hash_index=%u\n",hash_index);
 		return -1;
 	}
@@ -1236,7 +1239,7 @@ int t_lookup_callid(struct cell ** trans, str callid, str cseq) {
 	/* lookup the hash index where the transaction is stored */
 	hash_index=tm_hash(callid, cseq);
 
-	if(hash_index >= TM_TABLE_ENTRIES){
+	if(hash_index >= tm_hash_size){
 		LM_ERR("invalid hash_index=%u\n",hash_index);
 		return -1;
 	}
@@ -123,8 +123,8 @@ char *build_local(struct cell *Trans,unsigned int branch,
 		from.s = rpl->from->name.s;
 		from.len = rpl->from->len;
 		if (req && req->msg_flags&FL_USE_UAC_CSEQ) {
-			if ( extract_ftc_hdrs( Trans->uac[branch].request.buffer.s,
-				Trans->uac[branch].request.buffer.len,0 ,0 ,
+			if ( extract_ftc_hdrs( Trans->uac[branch]->request.buffer.s,
+				Trans->uac[branch]->request.buffer.len,0 ,0 ,
 				&cseq_n ,0)!=0 ) {
 				LM_ERR("build_local: failed to extract UAC hdrs\n");
 				goto error;
@@ -134,8 +134,8 @@ char *build_local(struct cell *Trans,unsigned int branch,
 		to = Trans->to;
 		from = Trans->from;
 		if (req && req->msg_flags&(FL_USE_UAC_FROM|FL_USE_UAC_TO|FL_USE_UAC_CSEQ)) {
-			if ( extract_ftc_hdrs( Trans->uac[branch].request.buffer.s,
-				Trans->uac[branch].request.buffer.len,
+			if ( extract_ftc_hdrs( Trans->uac[branch]->request.buffer.s,
+				Trans->uac[branch]->request.buffer.len,
 				(req->msg_flags&FL_USE_UAC_FROM)?&from:0 ,
 				(req->msg_flags&FL_USE_UAC_TO)?&to:0 ,
 				(req->msg_flags&FL_USE_UAC_CSEQ)?&cseq_n:0 ,0)!=0 ) {
@@ -150,15 +150,15 @@ char *build_local(struct cell *Trans,unsigned int branch,
 
 	/* method, separators, version  */
 	*len=SIP_VERSION_LEN + method->len + 2 /* spaces */ + CRLF_LEN;
-	*len+=Trans->uac[branch].uri.len;
+	*len+=Trans->uac[branch]->uri.len;
 
 	/*via*/
 	branch_str.s=branch_buf;
 	if (!t_calc_branch(Trans,  branch, branch_str.s, &branch_str.len ))
 		goto error;
 	set_hostport(&hp, (is_local(Trans))?0:req);
-	via=via_builder(&via_len, Trans->uac[branch].request.dst.send_sock,
-		&branch_str, 0, Trans->uac[branch].request.dst.proto, &hp );
+	via=via_builder(&via_len, Trans->uac[branch]->request.dst.send_sock,
+		&branch_str, 0, Trans->uac[branch]->request.dst.proto, &hp );
 	if (!via){
 		LM_ERR("no via header got from builder\n");
 		goto error;
@@ -170,10 +170,10 @@ char *build_local(struct cell *Trans,unsigned int branch,
 	/* copy'n'paste Route headers that were sent out */
 	if (!is_local(Trans) &&
 	( (req && req->route) || /* at least one route was received*/
-	(Trans->uac[branch].path_vec.len!=0)) ) /* path was forced */
+	(Trans->uac[branch]->path_vec.len!=0)) ) /* path was forced */
 	{
-		buf_hdrs = extract_parsed_hdrs(Trans->uac[branch].request.buffer.s,
-			Trans->uac[branch].request.buffer.len );
+		buf_hdrs = extract_parsed_hdrs(Trans->uac[branch]->request.buffer.s,
+			Trans->uac[branch]->request.buffer.len );
 		if (buf_hdrs==NULL) {
 			LM_ERR("failed to reparse the request buffer\n");
 			goto error01;
@@ -201,7 +201,7 @@ char *build_local(struct cell *Trans,unsigned int branch,
 
 	append_string( p, method->s, method->len );
 	*(p++) = ' ';
-	append_string( p, Trans->uac[branch].uri.s, Trans->uac[branch].uri.len);
+	append_string( p, Trans->uac[branch]->uri.s, Trans->uac[branch]->uri.len);
 	append_string( p, " " SIP_VERSION CRLF, 1+SIP_VERSION_LEN+CRLF_LEN );
 
 	/* insert our via */
@@ -470,7 +470,7 @@ char *build_dlg_ack(struct sip_msg* rpl, struct cell *Trans,
 	} else {
 		/* build hop-by-hop ack for negative reply ->
 		 * ruri is the same as in INVITE; no route set */
-		ruri = Trans->uac[branch].uri;
+		ruri = Trans->uac[branch]->uri;
 		cont = 0;
 		list = 0;
 	}
@@ -480,7 +480,7 @@ char *build_dlg_ack(struct sip_msg* rpl, struct cell *Trans,
 	*len += ruri.len;
 
 	/* use same socket as for INVITE -bogdan */
-	send_sock = Trans->uac[branch].request.dst.send_sock;
+	send_sock = Trans->uac[branch]->request.dst.send_sock;
 
 	if (!t_calc_branch(Trans,  branch, branch_buf, &branch_len)) goto error;
 	branch_str.s = branch_buf;
@@ -638,8 +638,8 @@ static inline char* print_request_uri(char* w, str* method, dlg_t* dialog, struc
 	append_string(w, method->s, method->len);
 	*(w++) = ' ';
 
-	t->uac[branch].uri.s = w;
-	t->uac[branch].uri.len = dialog->hooks.request_uri->len;
+	t->uac[branch]->uri.s = w;
+	t->uac[branch]->uri.len = dialog->hooks.request_uri->len;
 
 	append_string(w, dialog->hooks.request_uri->s, dialog->hooks.request_uri->len);
 	append_string(w, " " SIP_VERSION CRLF, 1 + SIP_VERSION_LEN + CRLF_LEN);
@@ -864,14 +864,14 @@ char* build_uac_req(str* method, str* headers, str* body, dlg_t* dialog,
 		append_string(w, CRLF, CRLF_LEN);
 	}
 	if (headers) {
-		t->uac[branch].extra_headers.s = w;
-		t->uac[branch].extra_headers.len = headers->len;
+		t->uac[branch]->extra_headers.s = w;
+		t->uac[branch]->extra_headers.len = headers->len;
 		append_string(w, headers->s, headers->len);
 	}
 	append_string(w, CRLF, CRLF_LEN);
 	if (body) {
-		t->uac[branch].body.s = w;
-		t->uac[branch].body.len = body->len;
+		t->uac[branch]->body.s = w;
+		t->uac[branch]->body.len = body->len;
 		append_string(w, body->s, body->len);
 	}
 
@@ -144,6 +144,10 @@ static inline int fake_req(struct sip_msg *faked_req, struct sip_msg *shm_msg,
 
 	faked_req->msg_flags |= FL_TM_FAKE_REQ;
 
+	/* rebuild the parsed bodies left out by a compact cloning */
+	if (shm_msg->msg_flags&FL_SHM_COMPACT)
+		expand_compact_clone(faked_req);
+
 	/* new_uri can change -- make a private copy */
 	faked_req->new_uri.s=pkg_malloc( uac->uri.len+1 );
 	if (!faked_req->new_uri.s) {
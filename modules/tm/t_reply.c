@@ -163,7 +163,7 @@ void t_on_reply( unsigned int go_to )
 		goto_on_reply=go_to;
 	} else {
 		if (route_type==BRANCH_ROUTE) {
-			t->uac[_tm_branch_index].on_reply = go_to;
+			t->uac[_tm_branch_index]->on_reply = go_to;
 		} else {
 			t->on_reply = go_to;
 		}
@@ -311,7 +311,7 @@ static int send_ack(struct sip_msg* rpl, struct cell *trans, int branch)
 		goto error;
 	}
 
-	SEND_PR_BUFFER(&trans->uac[branch].request, ack_p, ack_len);
+	SEND_PR_BUFFER(&trans->uac[branch]->request, ack_p, ack_len);
 	shm_free(ack_p);
 
 	return 0;
@@ -520,7 +520,7 @@ static inline void faked_env( struct cell *t,struct sip_msg *msg)
 		backup_list = set_avp_list( &t->user_avps );
 		/* set default send address to the saved value */
 		backup_si = bind_address;
-		bind_address = t->uac[0].request.dst.send_sock;
+		bind_address = t->uac[0]->request.dst.send_sock;
 	} else {
 		/* restore original environment */
 		set_t(backup_t);
@@ -541,7 +541,7 @@ static inline int run_failure_handlers(struct cell *t)
 	int on_failure;
 
 	shmem_msg = t->uas.request;
-	uac = &t->uac[picked_branch];
+	uac = t->uac[picked_branch];
 
 	/* failure_route for a local UAC? */
 	if (!shmem_msg || REQ_LINE(shmem_msg).method_value==METHOD_CANCEL ) {
@@ -599,15 +599,15 @@ static inline int is_3263_failure(struct cell *t)
 	 * and RFC 3261, this means 503 reply with Retr-After hdr
 	 * or timeout with no reply */
 	LM_DBG("dns-failover test: branch=%d, last_recv=%d, flags=%X\n",
-		picked_branch, t->uac[picked_branch].last_received,
-		t->uac[picked_branch].flags);
+		picked_branch, t->uac[picked_branch]->last_received,
+		t->uac[picked_branch]->flags);
 
-	switch (t->uac[picked_branch].last_received) {
+	switch (t->uac[picked_branch]->last_received) {
 		case 408:
-			return ((t->uac[picked_branch].flags&T_UAC_HAS_RECV_REPLY)==0);
+			return ((t->uac[picked_branch]->flags&T_UAC_HAS_RECV_REPLY)==0);
 		case 503:
-			if (t->uac[picked_branch].reply==NULL ||
-			t->uac[picked_branch].reply==FAKED_REPLY)
+			if (t->uac[picked_branch]->reply==NULL ||
+			t->uac[picked_branch]->reply==FAKED_REPLY)
 				return 0;
 			/* we do not care about the Retry-After header in 503
 			 * as following discussion on sip-implementers list :
@@ -629,7 +629,7 @@ static inline int do_dns_failover(struct cell *t)
 	dlg_t dialog;
 	int ret, sip_msg_len;
 
-	uac = &t->uac[picked_branch];
+	uac = t->uac[picked_branch];
 
 	/* check if the DNS resolver can get at least one new IP */
 	if ( get_next_su( uac->proxy, &uac->request.dst.to, 1)!=0 )
@@ -660,6 +660,7 @@ static inline int do_dns_failover(struct cell *t)
 			return -1;
 		}
 		t->uas.end_request = ((char*)t->uas.request) + sip_msg_len;
+		stats_trans_clone(sip_msg_len);
 		/* free the actual SIP message, keep the clone only */
 		free_sip_msg(req);
 		/* the sip_msg structure is static in buf_to_sip_msg,
@@ -753,24 +754,24 @@ static inline int t_pick_branch( struct cell *t, int *res_code, int *do_cancel)
 	*do_cancel = 0;
 	for ( b=t->first_branch; b<t->nr_of_outgoings ; b++ ) {
 		/* skip 'empty branches' */
-		if (!t->uac[b].request.buffer.s) continue;
+		if (!t->uac[b]->request.buffer.s) continue;
 		/* there is still an unfinished UAC transaction; wait now! */
-		if ( t->uac[b].last_received<200 ) {
-			if (t->uac[b].br_flags & minor_branch_flag) {
+		if ( t->uac[b]->last_received<200 ) {
+			if (t->uac[b]->br_flags & minor_branch_flag) {
 				*do_cancel = 1;
 				continue;
 			}
 			return -2;
 		}
 		/* compare against the priority of the current branch */
-		prio = branch_prio(t->uac[b].last_received,cancelled);
+		prio = branch_prio(t->uac[b]->last_received,cancelled);
 		if ( (lowest_b==-1) || (prio<lowest_s) ) {
 			lowest_b = b;
 			lowest_s = prio;
 		}
 	} /* find lowest branch */
-	LM_DBG("picked branch %d, code %d (prio=%d)\n",
-		lowest_b,t->uac[lowest_b].last_received,lowest_s);
+	LM_DBG("picked branch %d, code %d (prio=%d)\n", lowest_b,
+		lowest_b>=0 ? t->uac[lowest_b]->last_received : 0, lowest_s);
 
 	*res_code=lowest_s;
 	return lowest_b;
@@ -810,7 +811,7 @@ static enum rps t_should_relay_response( struct cell *Trans , int new_code,
 		if (inv_through) {
 			LM_DBG("200 OK for INVITE after final sent\n");
 			*should_store=0;
-			Trans->uac[branch].last_received=new_code;
+			Trans->uac[branch]->last_received=new_code;
 			*should_relay=branch;
 			return RPS_PUSHED_AFTER_COMPLETION;
 		}
@@ -826,22 +827,22 @@ static enum rps t_should_relay_response( struct cell *Trans , int new_code,
 	}
 
 	/* if final response received at this branch, allow only INVITE 2xx */
-	if (Trans->uac[branch].last_received>=200
-			&& !(inv_through && Trans->uac[branch].last_received<300)) {
+	if (Trans->uac[branch]->last_received>=200
+			&& !(inv_through && Trans->uac[branch]->last_received<300)) {
 #ifdef EXTRA_DEBUG
 		/* don't report on retransmissions */
-		if (Trans->uac[branch].last_received==new_code) {
+		if (Trans->uac[branch]->last_received==new_code) {
 			LM_DBG("final reply retransmission\n");
 		} else
 		/* if you FR-timed-out, faked a local 408 and 487 came, don't
 		 * report on it either */
-		if (Trans->uac[branch].last_received==408 && new_code==487) {
+		if (Trans->uac[branch]->last_received==408 && new_code==487) {
 			LM_DBG("487 reply came for a timed-out branch\n");
 		} else {
 		/* this looks however how a very strange status rewrite attempt;
 		 * report on it */
 			LM_DBG("status rewrite by UAS: stored: %d, received: %d\n",
-				Trans->uac[branch].last_received, new_code );
+				Trans->uac[branch]->last_received, new_code );
 		}
 #endif
 		goto discard;
@@ -851,11 +852,11 @@ static enum rps t_should_relay_response( struct cell *Trans , int new_code,
 	/* negative replies subject to fork picking */
 	if (new_code >=300 ) {
 
-		Trans->uac[branch].last_received=new_code;
+		Trans->uac[branch]->last_received=new_code;
 		/* also append the current reply to the transaction to
 		 * make it available in failure routes - a kind of "fake"
 		 * save of the final reply per branch */
-		Trans->uac[branch].reply = reply;
+		Trans->uac[branch]->reply = reply;
 
 		if (new_code>=600 && !disable_6xx_block) {
 			/* this is a winner and close all branches */
@@ -870,12 +871,12 @@ static enum rps t_should_relay_response( struct cell *Trans , int new_code,
 				*should_store=1;
 				*should_relay=-1;
 				picked_branch=-1;
-				Trans->uac[branch].reply = 0;
+				Trans->uac[branch]->reply = 0;
 				return RPS_STORE;
 			}
 			if (picked_branch==-1) {
 				LM_CRIT("pick_branch failed (lowest==-1) for code %d\n",new_code);
-				Trans->uac[branch].reply = 0;
+				Trans->uac[branch]->reply = 0;
 				goto discard;
 			}
 			if (do_cancel) {
@@ -893,7 +894,7 @@ static enum rps t_should_relay_response( struct cell *Trans , int new_code,
 		reset_kr();
 
 		if ( !(Trans->flags&T_NO_DNS_FAILOVER_FLAG) &&
-		Trans->uac[picked_branch].proxy!=NULL ) {
+		Trans->uac[picked_branch]->proxy!=NULL ) {
 			/* is is a DNS failover scenario, according to RFC 3263 ? */
 			if (is_3263_failure(Trans)) {
 				LM_DBG("trying DNS-based failover\n");
@@ -914,7 +915,7 @@ static enum rps t_should_relay_response( struct cell *Trans , int new_code,
 		/* now reset it; after the failure logic, the reply may
 		 * not be stored any more and we don't want to keep into
 		 * transaction some broken reference */
-		Trans->uac[branch].reply = 0;
+		Trans->uac[branch]->reply = 0;
 
 		/* look if the callback perhaps replied transaction; it also
 		   covers the case in which a transaction is replied localy
@@ -952,7 +953,7 @@ static enum rps t_should_relay_response( struct cell *Trans , int new_code,
 	/* not >=300 ... it must be 2xx or provisional 1xx */
 	if (new_code>=100) {
 		/* 1xx and 2xx except 100 will be relayed */
-		Trans->uac[branch].last_received=new_code;
+		Trans->uac[branch]->last_received=new_code;
 		*should_store=0;
 		*should_relay= new_code==100? -1 : branch;
 		if (new_code>=200 ) {
@@ -1056,8 +1057,8 @@ void cleanup_uac_timers( struct cell *t )
 
 	/* reset FR/retransmission timers */
 	for (i=t->first_branch; i<t->nr_of_outgoings; i++ )  {
-		reset_timer( &t->uac[i].request.retr_timer );
-		reset_timer( &t->uac[i].request.fr_timer );
+		reset_timer( &t->uac[i]->request.retr_timer );
+		reset_timer( &t->uac[i]->request.fr_timer );
 	}
 	LM_DBG("RETR/FR timers reset\n");
 }
@@ -1065,7 +1066,7 @@ void cleanup_uac_timers( struct cell *t )
 static int store_reply( struct cell *trans, int branch, struct sip_msg *rpl)
 {
 #		ifdef EXTRA_DEBUG
-		if (trans->uac[branch].reply) {
+		if (trans->uac[branch]->reply) {
 			LM_ERR("replacing stored reply; aborting\n");
 			abort();
 		}
@@ -1076,11 +1077,11 @@ static int store_reply( struct cell *trans, int branch, struct sip_msg *rpl)
 		   it in shared memory; -jiri
 		*/
 		if (rpl==FAKED_REPLY)
-			trans->uac[branch].reply=FAKED_REPLY;
+			trans->uac[branch]->reply=FAKED_REPLY;
 		else
-			trans->uac[branch].reply = sip_msg_cloner( rpl, 0, 0 );
+			trans->uac[branch]->reply = sip_msg_cloner( rpl, 0, 0 );
 
-		if (! trans->uac[branch].reply ) {
+		if (! trans->uac[branch]->reply ) {
 			LM_ERR("failed to alloc' clone memory\n");
 			return 0;
 		}
@@ -1143,10 +1144,10 @@ enum rps relay_reply( struct cell *t, struct sip_msg *p_msg, int branch,
 
 		/* try building the outbound reply from either the current
 		 * or a stored message */
-		relayed_msg = branch==relay ? p_msg :  t->uac[relay].reply;
+		relayed_msg = branch==relay ? p_msg :  t->uac[relay]->reply;
 		if (relayed_msg==FAKED_REPLY) {
 			relayed_code = branch==relay
-				? msg_status : t->uac[relay].last_received;
+				? msg_status : t->uac[relay]->last_received;
 
 			text.s = error_text(relayed_code);
 			text.len = strlen(text.s); /* FIXME - bogdan*/
@@ -1265,9 +1266,9 @@ error03:
 	pkg_free( buf );
 error02:
 	if (save_clone) {
-		if (t->uac[branch].reply!=FAKED_REPLY)
-			free_cloned_msg( t->uac[branch].reply );
-		t->uac[branch].reply = NULL;
+		if (t->uac[branch]->reply!=FAKED_REPLY)
+			free_cloned_msg( t->uac[branch]->reply );
+		t->uac[branch]->reply = NULL;
 	}
 error01:
 	text.s = "Reply processing error";
@@ -1314,10 +1315,10 @@ enum rps local_reply( struct cell *t, struct sip_msg *p_msg, int branch,
 	}
 	if (local_winner>=0) {
 		winning_msg= branch==local_winner
-			? p_msg :  t->uac[local_winner].reply;
+			? p_msg :  t->uac[local_winner]->reply;
 		if (winning_msg==FAKED_REPLY) {
 			winning_code = branch==local_winner
-				? msg_status : t->uac[local_winner].last_received;
+				? msg_status : t->uac[local_winner]->last_received;
 		} else {
 			winning_code=winning_msg->REPLY_STATUS;
 		}
@@ -1392,7 +1393,7 @@ int reply_received( struct sip_msg  *p_msg )
 	cancel_bitmap=0;
 	msg_status=p_msg->REPLY_STATUS;
 
-	uac=&t->uac[branch];
+	uac=t->uac[branch];
 	LM_DBG("org. status uas=%d, uac[%d]=%d local=%d is_invite=%d)\n",
 		t->uas.status, branch, uac->last_received,
 		is_local(t), is_invite(t));
@@ -1431,7 +1432,7 @@ int reply_received( struct sip_msg  *p_msg )
 	_tm_branch_index = branch;
 
 	/* processing of on_reply block */
-	has_reply_route = (t->on_reply) || (t->uac[branch].on_reply);
+	has_reply_route = (t->on_reply) || (t->uac[branch]->on_reply);
 	if (has_reply_route) {
 		if (onreply_avp_mode) {
 			/* lock the reply*/
@@ -1443,10 +1444,10 @@ int reply_received( struct sip_msg  *p_msg )
 		}
 		/* transfer transaction flag to branch context */
 		p_msg->flags = t->uas.request ? t->uas.request->flags : 0;
-		setb0flags( p_msg, t->uac[branch].br_flags);
+		setb0flags( p_msg, t->uac[branch]->br_flags);
 		/* run block - first per branch and then global one */
-		if ( t->uac[branch].on_reply &&
-		(run_top_route(onreply_rlist[t->uac[branch].on_reply].a,p_msg)
+		if ( t->uac[branch]->on_reply &&
+		(run_top_route(onreply_rlist[t->uac[branch]->on_reply].a,p_msg)
 		&ACT_FL_DROP) && (msg_status<200) ) {
 			if (onreply_avp_mode) {
 				UNLOCK_REPLIES( t );
@@ -1465,7 +1466,7 @@ int reply_received( struct sip_msg  *p_msg )
 			goto done;
 		}
 		/* transfer current message context back to t */
-		t->uac[branch].br_flags = getb0flags(p_msg);
+		t->uac[branch]->br_flags = getb0flags(p_msg);
 		if (t->uas.request)
 			t->uas.request->flags = p_msg->flags;
 		if (onreply_avp_mode)
@@ -1483,13 +1484,13 @@ int reply_received( struct sip_msg  *p_msg )
 	/* we fire a cancel on spot if (a) branch is marked "to be canceled" or (b)
 	 * the whole transaction was canceled (received cancel) and no cancel sent
 	 * yet on this branch; and of course, only if a provisional reply :) */
-	if (t->uac[branch].flags&T_UAC_TO_CANCEL_FLAG ||
-	((t->flags&T_WAS_CANCELLED_FLAG) && !t->uac[branch].local_cancel.buffer.s)) {
+	if (t->uac[branch]->flags&T_UAC_TO_CANCEL_FLAG ||
+	((t->flags&T_WAS_CANCELLED_FLAG) && !t->uac[branch]->local_cancel.buffer.s)) {
 		if ( msg_status < 200 )
 			/* reply for an UAC with a pending cancel -> do cancel now */
 			cancel_branch(t, branch);
 		/* reset flag */
-		t->uac[branch].flags &= ~(T_UAC_TO_CANCEL_FLAG);
+		t->uac[branch]->flags &= ~(T_UAC_TO_CANCEL_FLAG);
 	}
 
 	if (is_local(t)) {
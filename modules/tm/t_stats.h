@@ -45,6 +45,9 @@ extern stat_var *tm_trans_4xx;
 extern stat_var *tm_trans_5xx;
 extern stat_var *tm_trans_6xx;
 extern stat_var *tm_trans_inuse;
+extern stat_var *tm_cloned_bytes;
+extern stat_var *tm_retr_batches;
+extern stat_var *tm_retr_batched;
 
 
 #ifdef STATISTICS
@@ -90,9 +93,15 @@ inline static void stats_trans_new( int local ) {
 			update_stat( tm_uas_trans, 1 );
 	}
 }
+
+inline static void stats_trans_clone( int len ) {
+	if (tm_enable_stats)
+		update_stat( tm_cloned_bytes, len );
+}
 #else
 	#define stats_trans_rpl( _code , _local )
 	#define stats_trans_new( _local )
+	#define stats_trans_clone( _len )
 #endif
 
 #endif
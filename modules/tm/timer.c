@@ -96,6 +96,10 @@
 */
 
 
+#ifdef __OS_linux
+#define _GNU_SOURCE /* sendmmsg() */
+#endif
+
 #include "config.h"
 #include "h_table.h"
 #include "timer.h"
@@ -111,6 +115,11 @@
 #include "t_funcs.h"
 #include "t_reply.h"
 #include "t_cancel.h"
+#include "t_stats.h"
+
+#ifdef __OS_linux
+#include <sys/socket.h>
+#endif
 
 
 static struct timer_table *timertable=0;
@@ -197,28 +206,28 @@ static void delete_cell( struct cell *p_cell, int unlock )
 		abort();
 	}
 	for (i=0; i<p_cell->nr_of_outgoings; i++) {
-		if (is_in_timer_list2(& p_cell->uac[i].request.retr_timer)) {
+		if (is_in_timer_list2(& p_cell->uac[i]->request.retr_timer)) {
 			LM_ERR("transaction %p scheduled for deletion and still on RETR "
 				"(req %d), timeout %lld\n", p_cell, i,
-				p_cell->uac[i].request.retr_timer.time_out);
+				p_cell->uac[i]->request.retr_timer.time_out);
 			abort();
 		}
-		if (is_in_timer_list2(& p_cell->uac[i].request.fr_timer)) {
+		if (is_in_timer_list2(& p_cell->uac[i]->request.fr_timer)) {
 			LM_ERR("transaction %p scheduled for deletion and"
 				" still on FR (req %d), timeout %lld\n", p_cell, i,
-				p_cell->uac[i].request.fr_timer.time_out);
+				p_cell->uac[i]->request.fr_timer.time_out);
 			abort();
 		}
-		if (is_in_timer_list2(& p_cell->uac[i].local_cancel.retr_timer)) {
+		if (is_in_timer_list2(& p_cell->uac[i]->local_cancel.retr_timer)) {
 			LM_ERR("transaction %p scheduled for deletion and"
 				" still on RETR/cancel (req %d), timeout %lld\n", p_cell, i,
-				p_cell->uac[i].request.retr_timer.time_out);
+				p_cell->uac[i]->request.retr_timer.time_out);
 			abort();
 		}
-		if (is_in_timer_list2(& p_cell->uac[i].local_cancel.fr_timer)) {
+		if (is_in_timer_list2(& p_cell->uac[i]->local_cancel.fr_timer)) {
 			LM_ERR("transaction %p scheduled for deletion and"
 				" still on FR/cancel (req %d), timeout %lld\n", p_cell, i,
-				p_cell->uac[i].request.fr_timer.time_out);
+				p_cell->uac[i]->request.fr_timer.time_out);
 			abort();
 		}
 	}
@@ -283,6 +292,129 @@ static void fake_reply(struct cell *t, int branch, int code )
 
 
 
+/* send the UDP request retransmissions of an utimer run in batches */
+int tm_retr_batching = 0;
+
+#ifdef __OS_linux
+/* UDP retransmission waiting for the batch to be flushed; the buffer is
+ * copied as the transaction may be released before the flush */
+struct retr_batch_msg {
+	struct socket_info *sock;
+	union sockaddr_union to;
+	char *buf;
+	int len;
+};
+
+static struct retr_batch_msg retr_batch[TM_RETR_BATCH];
+static char retr_batch_buf[TM_RETR_BATCH_BUF];
+static int retr_batch_no = 0;
+static int retr_batch_used = 0;
+#endif
+
+/* retransmissions fired by the current utimer run */
+static unsigned int retr_burst = 0;
+/* the highest burst of all the timer processes (shm) */
+static unsigned int *retr_max_burst = 0;
+
+
+#ifdef __OS_linux
+static void flush_retr_batch(void)
+{
+	struct mmsghdr msgs[TM_RETR_BATCH];
+	struct iovec iov[TM_RETR_BATCH];
+	char queued[TM_RETR_BATCH];
+	struct socket_info *sock;
+	int i, j, n, k, r;
+
+	memset( queued, 0, retr_batch_no);
+
+	/* one sendmmsg() for all the retransmissions going out via the
+	 * same socket */
+	for( i=0 ; i<retr_batch_no ; i++ ) {
+		if (queued[i])
+			continue;
+		sock = retr_batch[i].sock;
+		for( j=i,n=0 ; j<retr_batch_no ; j++ ) {
+			if (queued[j] || retr_batch[j].sock!=sock)
+				continue;
+			iov[n].iov_base = retr_batch[j].buf;
+			iov[n].iov_len = retr_batch[j].len;
+			memset( &msgs[n], 0, sizeof(struct mmsghdr));
+			msgs[n].msg_hdr.msg_name = &retr_batch[j].to.s;
+			msgs[n].msg_hdr.msg_namelen = sockaddru_len(retr_batch[j].to);
+			msgs[n].msg_hdr.msg_iov = &iov[n];
+			msgs[n].msg_hdr.msg_iovlen = 1;
+			queued[j] = 1;
+			n++;
+		}
+
+		for( k=0 ; k<n ; ) {
+			r = sendmmsg( sock->socket, msgs+k, n-k, 0);
+			if (r<0) {
+				if (errno==EINTR)
+					continue;
+				LM_ERR("sendmmsg(sock,%d msgs) failed: %s(%d)\n",
+					n-k, strerror(errno), errno);
+				/* drop the message that failed and go on */
+				k++;
+				continue;
+			}
+			k += r;
+		}
+
+		if (tm_enable_stats) {
+			update_stat( tm_retr_batches, 1);
+			update_stat( tm_retr_batched, n);
+		}
+	}
+
+	retr_batch_no = 0;
+	retr_batch_used = 0;
+}
+
+
+/* queues an UDP request retransmission to be sent at the end of the
+ * utimer run; returns 0 if the buffer was queued, -1 if it has to be
+ * sent right away */
+static int queue_retr_batch(struct retr_buf *rb)
+{
+	struct retr_batch_msg *bm;
+	str out_buff;
+
+	if (rb->dst.proto!=PROTO_UDP || rb->dst.send_sock==NULL
+	|| rb->buffer.s==NULL || rb->buffer.len==0)
+		return -1;
+
+	/* the raw processing callbacks are free to change the buffer */
+	out_buff = rb->buffer;
+	run_post_raw_processing_cb(POST_RAW_PROCESSING, &out_buff, NULL);
+
+	if (out_buff.len>TM_RETR_BATCH_BUF) {
+		if (out_buff.s!=rb->buffer.s)
+			pkg_free(out_buff.s);
+		return -1;
+	}
+
+	if (retr_batch_no==TM_RETR_BATCH
+	|| retr_batch_used+out_buff.len>TM_RETR_BATCH_BUF)
+		flush_retr_batch();
+
+	bm = &retr_batch[retr_batch_no++];
+	bm->sock = rb->dst.send_sock;
+	bm->to = rb->dst.to;
+	bm->buf = retr_batch_buf + retr_batch_used;
+	bm->len = out_buff.len;
+	memcpy( bm->buf, out_buff.s, out_buff.len);
+	retr_batch_used += out_buff.len;
+
+	if (out_buff.s!=rb->buffer.s)
+		pkg_free(out_buff.s);
+
+	return 0;
+}
+#endif
+
+
 inline static void retransmission_handler( struct timer_link *retr_tl )
 {
 	struct retr_buf* r_buf ;
@@ -297,6 +429,8 @@ inline static void retransmission_handler( struct timer_link *retr_tl )
 	}
 #endif
 
+	retr_burst++;
+
 	/* the transaction is already removed from RETRANSMISSION_LIST by timer*/
 	/* retransmission */
 	if ( r_buf->activ_type==TYPE_LOCAL_CANCEL
@@ -304,7 +438,10 @@ inline static void retransmission_handler( struct timer_link *retr_tl )
 			LM_DBG("retransmission_handler : request resending"
 				" (t=%p, %.9s ... )\n", r_buf->my_T, r_buf->buffer.s);
 			set_t(r_buf->my_T);
-			SEND_BUFFER( r_buf );
+#ifdef __OS_linux
+			if (!tm_retr_batching || queue_retr_batch( r_buf )<0)
+#endif
+				SEND_BUFFER( r_buf );
 			/*if (SEND_BUFFER( r_buf )==-1) {
 				reset_timer( &r_buf->fr_timer );
 				fake_reply(r_buf->my_T, r_buf->branch, 503 );
@@ -400,8 +537,8 @@ void cleanup_localcancel_timers( struct cell *t )
 {
 	int i;
 	for (i=0; i<t->nr_of_outgoings; i++ )  {
-		reset_timer(  &t->uac[i].local_cancel.retr_timer );
-		reset_timer(  &t->uac[i].local_cancel.fr_timer );
+		reset_timer(  &t->uac[i]->local_cancel.retr_timer );
+		reset_timer(  &t->uac[i]->local_cancel.fr_timer );
 	}
 }
 
@@ -521,6 +658,13 @@ struct timer_table *tm_init_timers( unsigned int sets )
 	memset(timertable, 0, sets * sizeof(struct timer_table));
 	timer_sets = sets;
 
+	retr_max_burst = (unsigned int*)shm_malloc(sizeof(unsigned int));
+	if (!retr_max_burst) {
+		LM_ERR("no more share memory\n");
+		goto error0;
+	}
+	*retr_max_burst = 0;
+
 	/* check the timeout values */
 	if ( timer_id2timeout[FR_TIMER_LIST]<MIN_TIMER_VALUE ) {
 		LM_ERR("FR_TIMER must be at least %d\n",
@@ -599,6 +743,14 @@ void free_timer_table(void)
 			release_timerlist_lock( &timertable->timers[i] );
 		shm_free(timertable);
 	}
+	if (retr_max_burst)
+		shm_free(retr_max_burst);
+}
+
+
+unsigned long tm_retr_max_burst( unsigned short foo )
+{
+	return retr_max_burst ? *retr_max_burst : 0;
 }
 
 
@@ -968,15 +1120,15 @@ static void unlink_timers( struct cell *t )
 	*/
 	if (is_in_timer_list2(&t->uas.response.fr_timer)) remove_fr=1;
 	else for (i=0; i<t->nr_of_outgoings; i++)
-		if (is_in_timer_list2(&t->uac[i].request.fr_timer)
-			|| is_in_timer_list2(&t->uac[i].local_cancel.fr_timer)) {
+		if (is_in_timer_list2(&t->uac[i]->request.fr_timer)
+			|| is_in_timer_list2(&t->uac[i]->local_cancel.fr_timer)) {
 				remove_fr=1;
 				break;
 		}
 	if (is_in_timer_list2(&t->uas.response.retr_timer)) remove_retr=1;
 	else for (i=0; i<t->nr_of_outgoings; i++)
-		if (is_in_timer_list2(&t->uac[i].request.retr_timer)
-			|| is_in_timer_list2(&t->uac[i].local_cancel.retr_timer)) {
+		if (is_in_timer_list2(&t->uac[i]->request.retr_timer)
+			|| is_in_timer_list2(&t->uac[i]->local_cancel.retr_timer)) {
 				remove_retr=1;
 				break;
 		}
@@ -991,8 +1143,8 @@ static void unlink_timers( struct cell *t )
 		lock(timertable[set].timers[RT_T1_TO_1].mutex);
 		remove_timer_unsafe(&t->uas.response.retr_timer);
 		for (i=0; i<t->nr_of_outgoings; i++) {
-			remove_timer_unsafe(&t->uac[i].request.retr_timer);
-			remove_timer_unsafe(&t->uac[i].local_cancel.retr_timer);
+			remove_timer_unsafe(&t->uac[i]->request.retr_timer);
+			remove_timer_unsafe(&t->uac[i]->local_cancel.retr_timer);
 		}
 		unlock(timertable[set].timers[RT_T1_TO_1].mutex);
 	}
@@ -1003,8 +1155,8 @@ static void unlink_timers( struct cell *t )
 		lock(timertable[set].timers[FR_TIMER_LIST].mutex);
 		remove_timer_unsafe(&t->uas.response.fr_timer);
 		for (i=0; i<t->nr_of_outgoings; i++) {
-			remove_timer_unsafe(&t->uac[i].request.fr_timer);
-			remove_timer_unsafe(&t->uac[i].local_cancel.fr_timer);
+			remove_timer_unsafe(&t->uac[i]->request.fr_timer);
+			remove_timer_unsafe(&t->uac[i]->local_cancel.fr_timer);
 		}
 		unlock(timertable[set].timers[FR_TIMER_LIST].mutex);
 	}
@@ -1062,6 +1214,7 @@ void utimer_routine(utime_t uticks , void *set)
 {
 	struct timer_link *tl, *tmp_tl;
 	int                id;
+	unsigned int       max;
 
 	for( id=RT_T1_TO_1 ; id<NR_OF_TIMER_LISTS ; id++ )
 	{
@@ -1079,5 +1232,18 @@ void utimer_routine(utime_t uticks , void *set)
 				break;
 		}
 	}
+
+#ifdef __OS_linux
+	if (retr_batch_no)
+		flush_retr_batch();
+#endif
+
+	if (retr_burst) {
+		max = *retr_max_burst;
+		while (retr_burst>max &&
+		!__sync_bool_compare_and_swap( retr_max_burst, max, retr_burst))
+			max = *retr_max_burst;
+		retr_burst = 0;
+	}
 }
 
@@ -87,6 +87,9 @@ struct timer_table
 
 
 extern int timer_group[NR_OF_TIMER_LISTS];
+extern int tm_retr_batching;
+
+unsigned long tm_retr_max_burst( unsigned short foo );
 extern unsigned int timer_id2timeout[NR_OF_TIMER_LISTS];
 
 
@@ -173,6 +173,9 @@ stat_var *tm_trans_4xx;
 stat_var *tm_trans_5xx;
 stat_var *tm_trans_6xx;
 stat_var *tm_trans_inuse;
+stat_var *tm_cloned_bytes;
+stat_var *tm_retr_batches;
+stat_var *tm_retr_batched;
 
 
 static cmd_export_t cmds[]={
@@ -273,6 +276,12 @@ static param_export_t params[]={
 		&minor_branch_flag },
 	{ "timer_partitions",         INT_PARAM,
 		&timer_partitions },
+	{ "hash_size",                INT_PARAM,
+		&tm_hash_size },
+	{ "compact_clone",            INT_PARAM,
+		&tm_compact_clone },
+	{ "retr_batching",            INT_PARAM,
+		&tm_retr_batching },
 	{0,0,0}
 };
 
@@ -289,6 +298,13 @@ static stat_export_t mod_stats[] = {
 	{"5xx_transactions" ,    0,              &tm_trans_5xx   },
 	{"6xx_transactions" ,    0,              &tm_trans_6xx   },
 	{"inuse_transactions" ,  STAT_NO_RESET,  &tm_trans_inuse },
+	{"cloned_bytes" ,        0,              &tm_cloned_bytes },
+	{"retr_batches" ,        0,              &tm_retr_batches },
+	{"retr_batched" ,        0,              &tm_retr_batched },
+	{"retr_max_burst" ,      STAT_IS_FUNC,
+		(stat_var**)tm_retr_max_burst },
+	{"hash_max_chain" ,      STAT_IS_FUNC,
+		(stat_var**)tm_hash_max_chain },
 	{0,0,0}
 };
 
@@ -717,6 +733,7 @@ static int mod_init(void)
 {
 	unsigned int timer_sets,set;
 	unsigned int roundto_init;
+	int n;
 
 	LM_INFO("TM - initializing...\n");
 
@@ -728,6 +745,13 @@ static int mod_init(void)
 		return -1;
 	}
 
+	/* shm footprint of a transaction (without the cloned request and the
+	 * buffers); only the first UAC is part of the cell */
+	LM_INFO("transaction footprint: %lu bytes per cell (with 1 branch) + "
+		"%lu bytes per extra branch\n",
+		(unsigned long)(sizeof(struct cell) + context_size(CONTEXT_TRAN)),
+		(unsigned long)sizeof(struct ua_client));
+
 	fix_flag_name(minor_branch_flag_str, minor_branch_flag);
 
 	minor_branch_flag =
@@ -756,6 +780,19 @@ static int mod_init(void)
 		return -1;
 	}
 
+	/* the hash index is obtained by masking, so the size of the
+	 * transaction table must be a power of 2 */
+	if (tm_hash_size<=0 || tm_hash_size>(1<<24)) {
+		LM_ERR("invalid hash_size %d\n", tm_hash_size);
+		return -1;
+	}
+	if (tm_hash_size & (tm_hash_size-1)) {
+		for (n=1; n<tm_hash_size; n<<=1);
+		LM_WARN("hash_size %d is not a power of 2, using %d\n",
+			tm_hash_size, n);
+		tm_hash_size = n;
+	}
+
 	/* how many timer sets do we need to create? */
 	timer_sets = (timer_partitions<=1)?1:timer_partitions ;
 
@@ -906,7 +943,7 @@ static int t_check_status(struct sip_msg* msg, char *regexp)
 						" in MODE_ONFAILURE\n", branch);
 				return -1;
 			}
-			status = int2str( t->uac[branch].last_received , 0);
+			status = int2str( t->uac[branch]->last_received , 0);
 			break;
 		default:
 			LM_ERR("unsupported route_type %d\n", route_type);
@@ -1000,7 +1037,7 @@ inline static int t_local_replied(struct sip_msg* msg, char *type)
 		/* check all */
 		case 0:
 			for( i=t->first_branch ; i<t->nr_of_outgoings ; i++ ) {
-				if (t->uac[i].flags&T_UAC_HAS_RECV_REPLY)
+				if (t->uac[i]->flags&T_UAC_HAS_RECV_REPLY)
 					return -1;
 			}
 			return 1;
@@ -1013,7 +1050,7 @@ inline static int t_local_replied(struct sip_msg* msg, char *type)
 						" a final response in MODE_ONFAILURE\n", branch);
 					return -1;
 				}
-				if (t->uac[branch].flags&T_UAC_HAS_RECV_REPLY)
+				if (t->uac[branch]->flags&T_UAC_HAS_RECV_REPLY)
 					return -1;
 				return 1;
 			}
@@ -1027,7 +1064,7 @@ inline static int t_local_replied(struct sip_msg* msg, char *type)
 						" a final response in MODE_ONFAILURE\n", branch);
 					return -1;
 				}
-				if (t->uac[branch].reply==FAKED_REPLY)
+				if (t->uac[branch]->reply==FAKED_REPLY)
 					return 1;
 				return -1;
 			}
@@ -1568,7 +1605,7 @@ static int pv_get_tm_reply_code(struct sip_msg *msg, pv_param_t *param,
 							" in MODE_ONFAILURE\n", branch);
 					code = 0;
 				} else {
-					code = t->uac[branch].last_received;
+					code = t->uac[branch]->last_received;
 				}
 				break;
 			default:
@@ -1612,7 +1649,7 @@ static int pv_get_tm_ruri(struct sip_msg *msg, pv_param_t *param,
 		return -1;
 	}
 
-	res->rs = t->uac[_tm_branch_index].uri;
+	res->rs = t->uac[_tm_branch_index]->uri;
 
 	res->flags = PV_VAL_STR;
 
@@ -1636,7 +1673,7 @@ struct sip_msg* tm_pv_context_reply(struct sip_msg* msg)
 		return 0;
 	}
 
-	return trans->uac[branch].reply;
+	return trans->uac[branch]->reply;
 }
 
 
@@ -1902,7 +1939,7 @@ struct usr_avp** get_bavp_list(void)
 	}
 
 	/* setting the avp head */
-	return &t->uac[_tm_branch_index].user_avps;
+	return &t->uac[_tm_branch_index]->user_avps;
 }
 
 int pv_get_tm_fr_timeout(struct sip_msg *msg, pv_param_t *param,
@@ -63,6 +63,7 @@
 #include "t_funcs.h"
 #include "t_msgbuilder.h"
 #include "callid.h"
+#include "t_stats.h"
 #include "uac.h"
 
 
@@ -84,7 +85,7 @@ int uac_init(void)
 	str src[3];
 	struct socket_info *si;
 
-	if (RAND_MAX < TM_TABLE_ENTRIES) {
+	if (RAND_MAX < tm_hash_size) {
 		LM_WARN("uac does not spread across the whole hash table\n");
 	}
 	/* on tcp/tls bind_address is 0 so try to get the first address we listen
@@ -254,7 +255,7 @@ int t_uac(str* method, str* headers, str* body, dlg_t* dialog,
 		new_cell->flags |= T_IS_INVITE_FLAG;
 	new_cell->flags |= T_IS_LOCAL_FLAG;
 
-	request = &new_cell->uac[0].request;
+	request = &new_cell->uac[0]->request;
 	if (dialog->forced_to_su.s.sa_family == AF_UNSPEC)
 		request->dst.to = to_su;
 	else
@@ -303,7 +304,7 @@ int t_uac(str* method, str* headers, str* body, dlg_t* dialog,
 			set_route_type( backup_route_type );
 
 			/* transfer current message context back to t */
-			new_cell->uac[0].br_flags = getb0flags(req);
+			new_cell->uac[0]->br_flags = getb0flags(req);
 			/* restore the prevoius active transaction */
 			set_t( backup_cell );
 
@@ -415,9 +416,9 @@ int t_uac(str* method, str* headers, str* body, dlg_t* dialog,
 				}
 				/* here we rely on how build_uac_req()
 				   builds the first line */
-				new_cell->uac[0].uri.s = buf1 +
+				new_cell->uac[0]->uri.s = buf1 +
 					req->first_line.u.request.method.len + 1;
-				new_cell->uac[0].uri.len = GET_RURI(req)->len;
+				new_cell->uac[0]->uri.len = GET_RURI(req)->len;
 
 				/* update also info about new destination and send sock */
 				if (new_send_sock)
@@ -442,6 +443,7 @@ abort_update:
 			} else {
 				new_cell->uas.end_request=
 					((char*)new_cell->uas.request)+sip_msg_len;
+				stats_trans_clone(sip_msg_len);
 			}
 			/* no parallel support in UAC transactions */
 			new_cell->on_branch = 0;
@@ -451,8 +453,8 @@ abort_update:
 
 	/* for DNS based failover, copy the DNS proxy into transaction */
 	if (!disable_dns_failover) {
-		new_cell->uac[0].proxy = shm_clone_proxy( proxy, 1/*do_free*/);
-		if (new_cell->uac[0].proxy==NULL)
+		new_cell->uac[0]->proxy = shm_clone_proxy( proxy, 1/*do_free*/);
+		if (new_cell->uac[0]->proxy==NULL)
 			LM_ERR("failed to store DNS info -> no DNS based failover\n");
 	}
 
@@ -204,8 +204,8 @@ int uac_auth( struct sip_msg *msg)
 		goto error;
 	}
 
-	rpl = t->uac[branch].reply;
-	code = t->uac[branch].last_received;
+	rpl = t->uac[branch]->reply;
+	code = t->uac[branch]->last_received;
 	LM_DBG("picked reply is %p, code %d\n",rpl,code);
 
 	if (rpl==0)
@@ -245,10 +245,10 @@ int uac_auth( struct sip_msg *msg)
 
 	/* do authentication */
 	uac_auth_api._do_uac_auth( &msg->first_line.u.request.method,
-			&t->uac[branch].uri, crd, auth, &auth_nc_cnonce, response);
+			&t->uac[branch]->uri, crd, auth, &auth_nc_cnonce, response);
 
 	/* build the authorization header */
-	new_hdr = uac_auth_api._build_authorization_hdr( code, &t->uac[branch].uri,
+	new_hdr = uac_auth_api._build_authorization_hdr( code, &t->uac[branch]->uri,
 		crd, auth, &auth_nc_cnonce, response);
 	if (new_hdr==0)
 	{
@@ -257,7 +257,7 @@ int uac_auth( struct sip_msg *msg)
 	}
 
 	/* so far, so good -> add the header and set the proper RURI */
-	if (apply_urihdr_changes( msg, &t->uac[branch].uri, new_hdr)<0)
+	if (apply_urihdr_changes( msg, &t->uac[branch]->uri, new_hdr)<0)
 	{
 		LM_ERR("failed to apply changes\n");
 		pkg_free(new_hdr->s);
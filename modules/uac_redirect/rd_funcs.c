@@ -67,7 +67,7 @@ int get_redirect( struct sip_msg *msg , int maxt, int maxb,
 	for( i=t->first_branch ; i<t->nr_of_outgoings ; i++) {
 		LM_DBG("checking branch=%d (added=%d)\n", i, cts_added);
 		/* is a redirected branch? */
-		if (t->uac[i].last_received<300 || t->uac[i].last_received>399)
+		if (t->uac[i]->last_received<300 || t->uac[i]->last_received>399)
 			continue;
 		LM_DBG("branch=%d is a redirect (added=%d)\n", i, cts_added);
 		/* ok - we have a new redirected branch -> how many contacts can
@@ -80,7 +80,7 @@ int get_redirect( struct sip_msg *msg , int maxt, int maxb,
 		if (max==0)
 			continue;
 		/* get the contact from it */
-		n = shmcontact2dset( msg, t->uac[i].reply, max, reason);
+		n = shmcontact2dset( msg, t->uac[i]->reply, max, reason);
 		if ( n<0 ) {
 			LM_ERR("get contact from shm_reply branch %d failed\n",i);
 			/* do not go to error, try next branches */
@@ -575,6 +575,85 @@ int get_domain_ucontacts(udomain_t *d, void *buf, int len, unsigned int flags,
 
 
 
+void init_ucontact_cursor(ucontact_cursor_t* cur, unsigned int flags,
+		unsigned int part_idx, unsigned int part_max)
+{
+	cur->d = root ? root->d : NULL;
+	cur->slot = part_idx;
+	cur->flags = flags;
+	cur->part_idx = part_idx;
+	cur->part_max = part_max ? part_max : 1;
+}
+
+
+int next_ucontacts(ucontact_cursor_t* cur, int max_slots,
+		ucontact_iter_f f, void* param)
+{
+	urecord_t *r;
+	ucontact_t *c, *next;
+	void **dest;
+	map_iterator_t it;
+	int n = 0;
+
+	if (db_mode == DB_ONLY)
+		return -1;
+
+	while (cur->d && n < max_slots) {
+		/* move on to the next domain */
+		if (cur->slot >= cur->d->size) {
+			cur->d = get_next_udomain(cur->d);
+			cur->slot = cur->part_idx;
+			continue;
+		}
+
+		lock_ulslot(cur->d, cur->slot);
+
+		for (map_first(cur->d->table[cur->slot].records, &it);
+		iterator_is_valid(&it); iterator_next(&it)) {
+
+			dest = iterator_val(&it);
+			if (dest == NULL)
+				break;
+			r = (urecord_t *)*dest;
+
+			for (c = r->contacts; c; c = next) {
+				next = c->next;
+
+				if (c->c.len <= 0 || (c->cflags & cur->flags) != cur->flags)
+					continue;
+
+				if (f(c, param) < 0) {
+					unlock_ulslot(cur->d, cur->slot);
+					return -1;
+				}
+			}
+		}
+
+		unlock_ulslot(cur->d, cur->slot);
+
+		cur->slot += cur->part_max;
+		n++;
+	}
+
+	return n;
+}
+
+
+int get_partition_slots(unsigned int part_idx, unsigned int part_max)
+{
+	dlist_t *p;
+	int n = 0;
+
+	if (part_max == 0)
+		part_max = 1;
+
+	for (p = root; p; p = p->next)
+		if (p->d->size > part_idx)
+			n += (p->d->size - part_idx + part_max - 1) / part_max;
+
+	return n;
+}
+
 
 
 /*! \brief
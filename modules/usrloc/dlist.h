@@ -99,6 +99,51 @@ int get_domain_ucontacts(udomain_t *d,void *buf, int len, unsigned int flags,
 
 
 
+/*! \brief
+ * Callback run by the contact iterator for each contact, with the slot
+ * of the contact locked - the contact must not be referenced after the
+ * callback returns. A negative return code stops the iteration.
+ */
+typedef int (*ucontact_iter_f)(ucontact_t* c, void* param);
+
+/*! \brief
+ * Position of an incremental iteration over the in-memory contacts
+ */
+typedef struct ucontact_cursor {
+	udomain_t* d;           /* domain being iterated, NULL when done */
+	int slot;               /* next slot to be visited in the domain */
+	unsigned int flags;     /* visit only contacts having these cflags */
+	unsigned int part_idx;  /* visit only the slots of this partition */
+	unsigned int part_max;  /* number of partitions */
+} ucontact_cursor_t;
+
+/*! \brief
+ * Start an iteration over the contacts of all the domains
+ */
+typedef void (*init_ucontact_cursor_t)(ucontact_cursor_t* cur,
+		unsigned int flags, unsigned int part_idx, unsigned int part_max);
+void init_ucontact_cursor(ucontact_cursor_t* cur, unsigned int flags,
+		unsigned int part_idx, unsigned int part_max);
+
+/*! \brief
+ * Visit the contacts of (at most) the next max_slots slots of the
+ * cursor's partition, one slot lock at a time, without copying them.
+ * Returns the number of visited slots, 0 if the iteration is over or
+ * -1 if not possible (DB_ONLY mode) or stopped by the callback.
+ */
+typedef int (*next_ucontacts_t)(ucontact_cursor_t* cur, int max_slots,
+		ucontact_iter_f f, void* param);
+int next_ucontacts(ucontact_cursor_t* cur, int max_slots,
+		ucontact_iter_f f, void* param);
+
+/*! \brief
+ * Number of slots (over all domains) in the given partition
+ */
+typedef int (*get_partition_slots_t)(unsigned int part_idx,
+		unsigned int part_max);
+int get_partition_slots(unsigned int part_idx, unsigned int part_max);
+
+
 /* Sums up the total number of users in memory, over all domains. */
 unsigned long get_number_of_users(void *);
 
@@ -27,7 +27,19 @@
 
 
 
+#include <string.h>
+
+#include "../../mem/shm_mem.h"
 #include "hslot.h"
+#include "ul_mod.h"
+
+#define EXP_HEAP_INIT_SIZE 16
+#define AOR_IDX_INIT_SIZE 16
+
+/* the low bits of the AoR hash select the slot, so they are the same for
+ * all the records of a slot - mix in the high ones for the index */
+#define aor_idx_pos(_h, _size) \
+	((((_h) ^ ((_h) >> 16)) * 0x45d9f3bu) & ((_size) - 1))
 
 int ul_locks_no=4;
 gen_lock_set_t* ul_locks=0;
@@ -133,10 +145,131 @@ void free_value_urecord( void * val )
 void deinit_slot(hslot_t* _s)
 {
 	map_destroy(_s->records , free_value_urecord);
+	if (_s->aor_idx)
+		shm_free(_s->aor_idx);
+	_s->aor_idx = 0;
+	_s->aor_idx_size = _s->aor_idx_used = 0;
+	if (_s->exp_heap)
+		shm_free(_s->exp_heap);
+	_s->exp_heap = 0;
+	_s->exp_no = _s->exp_size = 0;
+	_s->sync_first = _s->sync_last = 0;
 	_s->d = 0;
 }
 
 
+/* ================= open addressing AoR index ================= */
+
+static inline ul_aor_entry_t* aor_idx_lookup(hslot_t* _s, str* _aor,
+													unsigned int _h)
+{
+	ul_aor_entry_t* e;
+	unsigned int i;
+
+	for (i = aor_idx_pos(_h, _s->aor_idx_size); ;
+	i = (i + 1) & (_s->aor_idx_size - 1)) {
+		e = &_s->aor_idx[i];
+		if (e->r == NULL)
+			return NULL;
+		if (e->r != UL_AOR_DELETED && e->aorhash == _h &&
+		e->r->aor.len == _aor->len &&
+		memcmp(e->r->aor.s, _aor->s, _aor->len) == 0)
+			return e;
+	}
+}
+
+static inline void aor_idx_put(ul_aor_entry_t* idx, unsigned int size,
+		struct urecord* _r)
+{
+	unsigned int i;
+
+	for (i = aor_idx_pos(_r->aorhash, size);
+	idx[i].r != NULL && idx[i].r != UL_AOR_DELETED; i = (i + 1) & (size - 1));
+
+	idx[i].aorhash = _r->aorhash;
+	idx[i].r = _r;
+}
+
+/* rebuilds the index, dropping the deleted entries */
+static int aor_idx_resize(hslot_t* _s, unsigned int size)
+{
+	ul_aor_entry_t* idx;
+	unsigned int i, used = 0;
+
+	idx = shm_malloc(size * sizeof *idx);
+	if (!idx) {
+		LM_ERR("no more shm memory - slot falls back to map lookups\n");
+		return -1;
+	}
+	memset(idx, 0, size * sizeof *idx);
+
+	for (i = 0; i < _s->aor_idx_size; i++)
+		if (_s->aor_idx[i].r && _s->aor_idx[i].r != UL_AOR_DELETED) {
+			aor_idx_put(idx, size, _s->aor_idx[i].r);
+			used++;
+		}
+
+	if (_s->aor_idx)
+		shm_free(_s->aor_idx);
+	_s->aor_idx = idx;
+	_s->aor_idx_size = size;
+	_s->aor_idx_used = used;
+	return 0;
+}
+
+static void aor_idx_add(hslot_t* _s, struct urecord* _r)
+{
+	unsigned int size, live;
+
+	if (_s->aor_idx_broken)
+		return;
+
+	/* keep the load (deleted entries included) under 3/4 */
+	if ((_s->aor_idx_used + 1) * 4 > _s->aor_idx_size * 3) {
+		live = map_size(_s->records);
+		size = _s->aor_idx_size ? _s->aor_idx_size : AOR_IDX_INIT_SIZE;
+		while ((live + 1) * 2 > size)
+			size *= 2;
+		if (aor_idx_resize(_s, size) < 0) {
+			_s->aor_idx_broken = 1;
+			return;
+		}
+	}
+
+	aor_idx_put(_s->aor_idx, _s->aor_idx_size, _r);
+	_s->aor_idx_used++;
+}
+
+static void aor_idx_rem(hslot_t* _s, struct urecord* _r)
+{
+	ul_aor_entry_t* e;
+
+	if (_s->aor_idx_broken || !_s->aor_idx)
+		return;
+
+	e = aor_idx_lookup(_s, &_r->aor, _r->aorhash);
+	if (e)
+		e->r = UL_AOR_DELETED;
+}
+
+
+struct urecord* slot_find(hslot_t* _s, str* _aor, unsigned int _aorhash)
+{
+	ul_aor_entry_t* e;
+	void ** dest;
+
+	if (ul_aor_index && !_s->aor_idx_broken) {
+		if (!_s->aor_idx)
+			return NULL;
+		e = aor_idx_lookup(_s, _aor, _aorhash);
+		return e ? e->r : NULL;
+	}
+
+	dest = map_find(_s->records, *_aor);
+	return dest ? (struct urecord*)*dest : NULL;
+}
+
+
 /*! \brief
  * Add an element to an slot's linked list
  */
@@ -159,6 +292,9 @@ int slot_add(hslot_t* _s, struct urecord* _r)
 
 	_r->slot = _s;
 
+	if (ul_aor_index)
+		aor_idx_add(_s, _r);
+
 	return 0;
 }
 
@@ -169,6 +305,197 @@ int slot_add(hslot_t* _s, struct urecord* _r)
 void slot_rem(hslot_t* _s, struct urecord* _r)
 {
 
+	if (ul_aor_index)
+		aor_idx_rem(_s, _r);
 	map_remove( _s->records, _r->aor );
 	_r->slot = 0;
 }
+
+
+/* ============ expiry index and sync queue of the slot ============ */
+
+#define exp_heap_set(_s, _i, _c) \
+	do { \
+		(_s)->exp_heap[_i] = (_c); \
+		(_c)->exp_idx = (_i) + 1; \
+	} while (0)
+
+static void exp_heap_up(hslot_t* _s, unsigned int i)
+{
+	ucontact_t* c = _s->exp_heap[i];
+	unsigned int p;
+
+	while (i > 0) {
+		p = (i - 1) / 2;
+		if (_s->exp_heap[p]->expires <= c->expires)
+			break;
+		exp_heap_set(_s, i, _s->exp_heap[p]);
+		i = p;
+	}
+	exp_heap_set(_s, i, c);
+}
+
+static void exp_heap_down(hslot_t* _s, unsigned int i)
+{
+	ucontact_t* c = _s->exp_heap[i];
+	unsigned int k;
+
+	while ((k = 2 * i + 1) < _s->exp_no) {
+		if (k + 1 < _s->exp_no &&
+		_s->exp_heap[k + 1]->expires < _s->exp_heap[k]->expires)
+			k++;
+		if (c->expires <= _s->exp_heap[k]->expires)
+			break;
+		exp_heap_set(_s, i, _s->exp_heap[k]);
+		i = k;
+	}
+	exp_heap_set(_s, i, c);
+}
+
+static inline void exp_heap_update_next(hslot_t* _s)
+{
+	_s->next_expiry = _s->exp_no ? _s->exp_heap[0]->expires : 0;
+}
+
+static void exp_heap_remove(hslot_t* _s, ucontact_t* _c)
+{
+	unsigned int i = _c->exp_idx - 1;
+	ucontact_t* last;
+
+	_c->exp_idx = 0;
+	last = _s->exp_heap[--_s->exp_no];
+	if (last != _c) {
+		/* move the last one in the hole and restore the heap order */
+		exp_heap_set(_s, i, last);
+		exp_heap_up(_s, i);
+		exp_heap_down(_s, last->exp_idx - 1);
+	}
+	exp_heap_update_next(_s);
+}
+
+static int exp_heap_insert(hslot_t* _s, ucontact_t* _c)
+{
+	ucontact_t** heap;
+	unsigned int size;
+
+	if (_s->exp_no == _s->exp_size) {
+		size = _s->exp_size ? 2 * _s->exp_size : EXP_HEAP_INIT_SIZE;
+		heap = shm_realloc(_s->exp_heap, size * sizeof(ucontact_t*));
+		if (!heap) {
+			LM_ERR("no more shm memory - slot falls back to full scans\n");
+			_s->exp_lost = 1;
+			return -1;
+		}
+		_s->exp_heap = heap;
+		_s->exp_size = size;
+	}
+
+	_s->exp_heap[_s->exp_no] = _c;
+	_c->exp_idx = ++_s->exp_no;
+	exp_heap_up(_s, _s->exp_no - 1);
+	exp_heap_update_next(_s);
+	return 0;
+}
+
+
+ucontact_t* slot_pop_expired(hslot_t* _s, time_t _now)
+{
+	ucontact_t* c;
+
+	if (_s->exp_no == 0 || VALID_CONTACT(_s->exp_heap[0], _now))
+		return NULL;
+
+	c = _s->exp_heap[0];
+	exp_heap_remove(_s, c);
+	return c;
+}
+
+
+static inline hslot_t* contact_slot(ucontact_t* _c)
+{
+	if (db_mode == DB_ONLY || _c->rec == NULL)
+		return NULL;
+	return _c->rec->slot;
+}
+
+
+void ul_index_contact(ucontact_t* _c)
+{
+	hslot_t* s;
+
+	if ((s = contact_slot(_c)) == NULL)
+		return;
+
+	if (_c->expires == 0) {
+		/* permanent contacts never expire */
+		if (_c->exp_idx)
+			exp_heap_remove(s, _c);
+		return;
+	}
+
+	if (_c->exp_idx == 0) {
+		exp_heap_insert(s, _c);
+		return;
+	}
+
+	exp_heap_up(s, _c->exp_idx - 1);
+	exp_heap_down(s, _c->exp_idx - 1);
+	exp_heap_update_next(s);
+}
+
+
+void ul_queue_sync(ucontact_t* _c)
+{
+	hslot_t* s;
+
+	if ((s = contact_slot(_c)) == NULL || db_mode == NO_DB)
+		return;
+
+	/* already queued */
+	if (_c->sync_prev || s->sync_first == _c)
+		return;
+
+	_c->sync_next = 0;
+	_c->sync_prev = s->sync_last;
+	if (s->sync_last)
+		s->sync_last->sync_next = _c;
+	else
+		s->sync_first = _c;
+	s->sync_last = _c;
+}
+
+
+void ul_unqueue_sync(ucontact_t* _c)
+{
+	hslot_t* s;
+
+	if ((s = contact_slot(_c)) == NULL)
+		return;
+
+	if (!_c->sync_prev && s->sync_first != _c)
+		return;
+
+	if (_c->sync_prev)
+		_c->sync_prev->sync_next = _c->sync_next;
+	else
+		s->sync_first = _c->sync_next;
+	if (_c->sync_next)
+		_c->sync_next->sync_prev = _c->sync_prev;
+	else
+		s->sync_last = _c->sync_prev;
+
+	_c->sync_next = _c->sync_prev = 0;
+}
+
+
+void ul_unindex_contact(ucontact_t* _c)
+{
+	hslot_t* s;
+
+	if ((s = contact_slot(_c)) == NULL)
+		return;
+
+	if (_c->exp_idx)
+		exp_heap_remove(s, _c);
+	ul_unqueue_sync(_c);
+}
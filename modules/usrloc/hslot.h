@@ -40,11 +40,44 @@ struct udomain;
 struct urecord;
 
 
+/*! \brief
+ * Entry of the open addressing AoR index of a slot
+ */
+typedef struct ul_aor_entry {
+	unsigned int aorhash;   /*!< Full hash of the AoR */
+	struct urecord* r;      /*!< Record, NULL or UL_AOR_DELETED if none */
+} ul_aor_entry_t;
+
+#define UL_AOR_DELETED ((struct urecord*)-1)
+
+
 typedef struct hslot {
 
 	map_t records;
 	unsigned int next_label;
 
+	/* optional open addressing index over the records of the slot,
+	 * for faster lookups than the AVL map (aor_index parameter) */
+	ul_aor_entry_t *aor_idx;
+	unsigned int aor_idx_size;  /*!< Number of entries, power of 2 */
+	unsigned int aor_idx_used;  /*!< Entries in use, deleted ones included */
+	int aor_idx_broken;         /*!< Index out of sync - use the map only */
+
+	/* contacts indexed by expiry time (min-heap), so that the timer
+	 * only touches the contacts which are due */
+	struct ucontact **exp_heap;
+	unsigned int exp_no;
+	unsigned int exp_size;
+	/* earliest expiry in the slot (0 - none), readable without the lock */
+	volatile time_t next_expiry;
+	/* set if a contact could not be indexed - the slot falls back to
+	 * being fully scanned by the timer */
+	int exp_lost;
+
+	/* contacts not in sync with the DB, in the order they got dirty */
+	struct ucontact *sync_first;
+	struct ucontact *sync_last;
+
 	struct udomain* d;      /*!< Domain we belong to */
 #ifdef GEN_LOCK_T_PREFERED
 	gen_lock_t *lock;       /*!< Lock for hash entry - fastlock */
@@ -76,6 +109,38 @@ int slot_add(hslot_t* _s, struct urecord* _r);
  */
 void slot_rem(hslot_t* _s, struct urecord* _r);
 
+
+/*! \brief
+ * Find a record of the slot by its AoR
+ */
+struct urecord* slot_find(hslot_t* _s, str* _aor, unsigned int _aorhash);
+
+
+/*! \brief
+ * Removes and returns the first contact of the slot expired
+ * at the given time, NULL if none
+ */
+struct ucontact* slot_pop_expired(hslot_t* _s, time_t _now);
+
+
+/*! \brief
+ * (Re)Index the contact in its slot after its expires value changed
+ */
+void ul_index_contact(struct ucontact* _c);
+
+
+/*! \brief
+ * Remove the contact from all the slot indexes
+ */
+void ul_unindex_contact(struct ucontact* _c);
+
+
+/*! \brief
+ * Queue/unqueue the contact for being synced with the DB by the timer
+ */
+void ul_queue_sync(struct ucontact* _c);
+void ul_unqueue_sync(struct ucontact* _c);
+
 int ul_init_locks();
 void ul_unlock_locks();
 void ul_destroy_locks();
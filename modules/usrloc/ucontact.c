@@ -190,6 +190,7 @@ void print_ucontact(FILE* _f, ucontact_t* _c)
 	case CS_NEW:   st = "CS_NEW";     break;
 	case CS_SYNC:  st = "CS_SYNC";    break;
 	case CS_DIRTY: st = "CS_DIRTY";   break;
+	case CS_RESTORED: st = "CS_RESTORED"; break;
 	default:       st = "CS_UNKNOWN"; break;
 	}
 
@@ -292,6 +293,7 @@ int mem_update_ucontact(ucontact_t* _c, ucontact_info_t* _ci)
 
 	_c->sock = _ci->sock;
 	_c->expires = _ci->expires;
+	ul_index_contact(_c);
 	_c->q = _ci->q;
 	_c->cseq = _ci->cseq;
 	_c->methods = _ci->methods;
@@ -335,10 +337,12 @@ void st_update_ucontact(ucontact_t* _c)
 			  */
 		if (db_mode == WRITE_BACK || db_mode == WRITE_THROUGH) {
 			_c->state = CS_DIRTY;
+			ul_queue_sync(_c);
 		}
 		break;
 
 	case CS_DIRTY:
+	case CS_RESTORED:
 			 /* Modification of dirty contact results in
 			  * dirty contact again, don't change anything
 			  */
@@ -364,6 +368,7 @@ int st_delete_ucontact(ucontact_t* _c)
 
 	case CS_SYNC:
 	case CS_DIRTY:
+	case CS_RESTORED:
 		     /* Contact is in the database,
 		      * we cannot remove it from the memory
 		      * directly, but we can set expires to zero
@@ -373,6 +378,7 @@ int st_delete_ucontact(ucontact_t* _c)
 		      */
 		if (db_mode == WRITE_BACK) {
 			_c->expires = UL_EXPIRED_TIME;
+			ul_index_contact(_c);
 			return 0;
 		} else {
 			     /* WRITE_THROUGH or NO_DB -- we can
@@ -410,6 +416,7 @@ int st_expired_ucontact(ucontact_t* _c)
 
 	case CS_SYNC:
 	case CS_DIRTY:
+	case CS_RESTORED:
 		     /* Remove from database here */
 		return 1;
 	}
@@ -421,7 +428,7 @@ int st_expired_ucontact(ucontact_t* _c)
 /*! \brief
  * Called when the timer is about flushing the contact,
  * updates contact state and returns 1 if the contact
- * should be inserted, 2 if update and 0 otherwise
+ * should be inserted, 2 if update, 3 if insert-update and 0 otherwise
  */
 int st_flush_ucontact(ucontact_t* _c)
 {
@@ -447,6 +454,13 @@ int st_flush_ucontact(ucontact_t* _c)
 		      */
 		_c->state = CS_SYNC;
 		return 2;
+
+	case CS_RESTORED:
+		     /* Contact may or may not be in the
+		      * db, so insert it or update it
+		      */
+		_c->state = CS_SYNC;
+		return 3;
 	}
 
 	return 0; /* Makes gcc happy */
@@ -627,6 +641,7 @@ int db_insert_ucontact(ucontact_t* _c,query_list_t **ins_list, int update)
 		}
 	}
 
+	_c->db_expires = _c->expires;
 	return 0;
 }
 
@@ -789,6 +804,7 @@ int db_update_ucontact(ucontact_t* _c)
 		return -1;
 	}
 
+	_c->db_expires = _c->expires;
 	return 0;
 }
 
@@ -953,6 +969,7 @@ int update_ucontact(struct urecord* _r, ucontact_t* _c, ucontact_info_t* _ci,
 			LM_ERR("failed to update database\n");
 		} else {
 			_c->state = CS_SYNC;
+			ul_unqueue_sync(_c);
 		}
 	}
 	return 0;
@@ -43,13 +43,16 @@
 #include "../../proxy.h"
 #include "../../db/db_insertq.h"
 
+struct urecord;
 
 
 /*! \brief States for in-memory contacts in regards to contact storage handler (db, in-memory, ldap etc) */
 typedef enum cstate {
 	CS_NEW,        /*!< New contact - not flushed yet */
 	CS_SYNC,       /*!< Synchronized contact with the database */
-	CS_DIRTY       /*!< Update contact - not flushed yet */
+	CS_DIRTY,      /*!< Update contact - not flushed yet */
+	CS_RESTORED    /*!< Restored from a snapshot, may not be in the database
+	                *   yet - flushed with an insert-update */
 } cstate_t;
 
 
@@ -73,6 +76,8 @@ typedef struct ucontact {
 	str received;           /*!< IP+port+protocol we received the REGISTER from */
 	str path;               /*!< Path header */
 	time_t expires;         /*!< Expires parameter */
+	time_t db_expires;      /*!< Expires value last written to the DB
+	                         * (0 - unknown) */
 	qvalue_t q;             /*!< q parameter */
 	str instance;			/*!< instance parameter */
 	str callid;             /*!< Call-ID header field of registration */
@@ -88,6 +93,12 @@ typedef struct ucontact {
 	struct proxy_l next_hop;/*!< SIP-wise determined next hop */
 	unsigned int label;     /*!< label to find the contact in contact list>*/
 
+	struct urecord* rec;    /*!< Record the contact belongs to */
+	unsigned int exp_idx;   /*!< Position in the slot expiry heap, plus one
+	                         * (0 - not indexed) */
+	struct ucontact* sync_next; /*!< Next contact in the slot sync queue */
+	struct ucontact* sync_prev; /*!< Previous contact in the slot sync queue */
+
 	struct ucontact* next;  /*!< Next contact in the linked list */
 	struct ucontact* prev;  /*!< Previous contact in the linked list */
 } ucontact_t;
@@ -35,6 +35,7 @@
 #include "udomain.h"
 #include <string.h>
 #include "../../parser/parse_methods.h"
+#include "../../mem/mem.h"
 #include "../../mem/shm_mem.h"
 #include "../../dprint.h"
 #include "../../db/db.h"
@@ -493,7 +494,7 @@ static inline ucontact_info_t* dbrow2info( db_val_t *vals, str *contact)
 }
 
 
-int preload_udomain(db_con_t* _c, udomain_t* _d)
+int preload_udomain(db_con_t* _c, udomain_t* _d, time_t _since)
 {
 	/* no use to try prepared statements here as this query is performed
 	   once at startup -bogdan */
@@ -501,12 +502,16 @@ int preload_udomain(db_con_t* _c, udomain_t* _d)
 	ucontact_info_t *ci;
 	db_row_t *row;
 	db_key_t columns[17];
+	db_key_t keys[1];
+	db_op_t  ops[1];
+	db_val_t vals[1];
 	db_res_t* res = NULL;
 	str user, contact;
 	char* domain;
 	int i;
 	int n;
 	int no_rows = 10;
+	int nk = 0;
 
 	urecord_t* r;
 	ucontact_t* c;
@@ -529,6 +534,16 @@ int preload_udomain(db_con_t* _c, udomain_t* _d)
 	columns[15] = &attr_col;
 	columns[16] = &domain_col;
 
+	if (_since) {
+		/* only the delta on top of a loaded snapshot */
+		keys[0] = &last_mod_col;
+		ops[0] = OP_GEQ;
+		vals[0].type = DB_DATETIME;
+		vals[0].nul = 0;
+		vals[0].val.time_val = _since;
+		nk = 1;
+	}
+
 	if (ul_dbf.use_table(_c, _d->name) < 0) {
 		LM_ERR("sql use_table failed\n");
 		return -1;
@@ -539,8 +554,8 @@ int preload_udomain(db_con_t* _c, udomain_t* _d)
 #endif
 
 	if (DB_CAPABILITY(ul_dbf, DB_CAP_FETCH)) {
-		if (ul_dbf.query(_c, 0, 0, 0, columns, 0, (use_domain)?(17):(16), 0,
-		0) < 0) {
+		if (ul_dbf.query(_c, keys, ops, vals, columns, nk,
+		(use_domain)?(17):(16), 0, 0) < 0) {
 			LM_ERR("db_query (1) failed\n");
 			return -1;
 		}
@@ -552,8 +567,8 @@ int preload_udomain(db_con_t* _c, udomain_t* _d)
 			return -1;
 		}
 	} else {
-		if (ul_dbf.query(_c, 0, 0, 0, columns, 0, (use_domain)?(17):(16), 0,
-		&res) < 0) {
+		if (ul_dbf.query(_c, keys, ops, vals, columns, nk,
+		(use_domain)?(17):(16), 0, &res) < 0) {
 			LM_ERR("db_query failed\n");
 			return -1;
 		}
@@ -613,6 +628,20 @@ int preload_udomain(db_con_t* _c, udomain_t* _d)
 					unlock_udomain(_d, &user);
 					goto error;
 				}
+			} else if (_since &&
+			get_ucontact(r, &contact, ci->callid, ci->cseq, &c) != 1) {
+				/* already loaded - keep the copy modified last */
+				if (c && ci->last_modified > c->last_modified) {
+					if (mem_update_ucontact(c, ci) < 0) {
+						LM_ERR("updating contact failed\n");
+					} else {
+						c->state = CS_SYNC;
+						c->db_expires = c->expires;
+						ul_unqueue_sync(c);
+					}
+				}
+				unlock_udomain(_d, &user);
+				continue;
 			}
 
 			if ( (c=mem_insert_ucontact(r, &contact, ci)) == 0) {
@@ -624,6 +653,8 @@ int preload_udomain(db_con_t* _c, udomain_t* _d)
 			/* We have to do this, because insert_ucontact sets state to CS_NEW
 			 * and we have the contact in the database already */
 			c->state = CS_SYNC;
+			c->db_expires = c->expires;
+			ul_unqueue_sync(c);
 			unlock_udomain(_d, &user);
 		}
 
@@ -755,6 +786,7 @@ urecord_t* db_load_urecord(db_con_t* _c, udomain_t* _d, str *_aor)
 		/* We have to do this, because insert_ucontact sets state to CS_NEW
 		 * and we have the contact in the database already */
 		c->state = CS_SYNC;
+		c->db_expires = c->expires;
 	}
 
 	ul_dbf.free_result(_c, res);
@@ -865,51 +897,172 @@ void mem_delete_urecord(udomain_t* _d, struct urecord* _r)
 }
 
 
-int mem_timer_udomain(udomain_t* _d)
+/*! \brief
+ * Timer handling of a slot by walking all its records - used only if
+ * the expiry index of the slot is not complete
+ */
+static int timer_slot_scan(udomain_t* _d, int i)
 {
 	struct urecord* ptr;
 	void ** dest;
-	int i,ret=0,flush=0;
+	int ret=0,flush=0;
 	map_iterator_t it,prev;
 
-	for(i=0; i<_d->size; i++)
+	map_first(_d->table[i].records,&it);
+
+	while(iterator_is_valid(&it))
 	{
-		lock_ulslot(_d, i);
 
-		map_first(_d->table[i].records,&it);
+		dest = iterator_val(&it);
+		if( dest == NULL )
+			return -1;
+
+		ptr = (struct urecord *)*dest;
+
+		prev = it;
+		iterator_next(&it);
+
+		if ((ret =timer_urecord(ptr,&_d->ins_list)) < 0) {
+			LM_ERR("timer_urecord failed\n");
+			return -1;
+		}
+
+		if (ret)
+			flush=1;
 
-		while(iterator_is_valid(&it))
+		/* Remove the entire record if it is empty */
+		if (ptr->contacts == 0)
 		{
+			iterator_delete(&prev);
+			mem_delete_urecord(_d,ptr);
+		}
+	}
 
-			dest = iterator_val(&it);
-			if( dest == NULL ) {
-				unlock_ulslot(_d, i);
-				return -1;
-			}
+	return flush;
+}
 
-			ptr = (struct urecord *)*dest;
 
-			prev = it;
-			iterator_next(&it);
+/* expired contacts detached from a slot index - used only by the timer */
+static struct ucontact **expired_batch = NULL;
+static unsigned int expired_batch_size = 0;
 
-			if ((ret =timer_urecord(ptr,&_d->ins_list)) < 0) {
-				LM_ERR("timer_urecord failed\n");
-				unlock_ulslot(_d, i);
-				return -1;
-			}
+static inline int expired_batch_add(struct ucontact* c, unsigned int n)
+{
+	struct ucontact **batch;
+	unsigned int size;
+
+	if (n == expired_batch_size) {
+		size = expired_batch_size ? 2 * expired_batch_size : 64;
+		batch = pkg_realloc(expired_batch, size * sizeof(struct ucontact*));
+		if (!batch) {
+			LM_ERR("no more pkg memory\n");
+			return -1;
+		}
+		expired_batch = batch;
+		expired_batch_size = size;
+	}
 
-			if (ret)
-				flush=1;
+	expired_batch[n] = c;
+	return 0;
+}
 
-			/* Remove the entire record if it is empty */
-			if (ptr->contacts == 0)
-			{
-				iterator_delete(&prev);
-				mem_delete_urecord(_d,ptr);
-			}
+
+/*! \brief
+ * Timer handling of a slot, touching only the contacts which are due
+ * (from the expiry index) or dirty (from the sync queue)
+ */
+static int timer_slot(udomain_t* _d, int i)
+{
+	hslot_t* s = &_d->table[i];
+	struct ucontact *c, *next;
+	struct urecord* r;
+	unsigned int n = 0, k;
+	int flush=0;
+
+	/* detach all the expired contacts first, so the ones which cannot
+	 * be deleted right now are put back for a later retry */
+	while ((c = slot_pop_expired(s, act_time)) != NULL) {
+		if (expired_batch_add(c, n) < 0) {
+			ul_index_contact(c);
+			break;
 		}
+		n++;
+	}
+
+	for (k = 0; k < n; k++) {
+		c = expired_batch[k];
+		r = c->rec;
+
+		if (timer_expire_ucontact(r, c) < 0) {
+			ul_index_contact(c);
+			continue;
+		}
+
+		/* Remove the entire record if it is empty */
+		if (r->contacts == 0)
+			mem_delete_urecord(_d, r);
+	}
+
+	/* flush the contacts which got out of sync with the DB */
+	c = s->sync_first;
+	s->sync_first = s->sync_last = 0;
+
+	for ( ; c; c = next) {
+		next = c->sync_next;
+		c->sync_next = c->sync_prev = 0;
+
+		/* leave the expired ones to the expiry index */
+		if (!VALID_CONTACT(c, act_time)) {
+			ul_queue_sync(c);
+			continue;
+		}
+
+		if (timer_flush_ucontact(c, &_d->ins_list))
+			flush = 1;
+	}
+
+	return flush;
+}
+
+
+int mem_timer_udomain(udomain_t* _d)
+{
+	hslot_t* s;
+	int i,ret=0,flush=0;
+
+	/* remove all the expired rows with a single query - the timer will
+	 * skip the per contact deletes for the rows covered by it */
+	if (db_flush_batch && db_mode == WRITE_BACK) {
+		if (db_timer_udomain(_d) < 0) {
+			LM_ERR("bulk delete of the expired contacts failed\n");
+		} else {
+			_d->db_expired = act_time;
+			ul_flush_queries++;
+		}
+	}
+
+	for(i=0; i<_d->size; i++)
+	{
+		s = &_d->table[i];
+
+		/* check without the lock if the slot has anything due */
+		if (!s->exp_lost && s->sync_first == 0 &&
+		(s->next_expiry == 0 || s->next_expiry > act_time))
+			continue;
+
+		lock_ulslot(_d, i);
+
+		if (s->exp_lost)
+			ret = timer_slot_scan(_d, i);
+		else
+			ret = timer_slot(_d, i);
 
 		unlock_ulslot(_d, i);
+
+		if (ret < 0)
+			return -1;
+		if (ret)
+			flush=1;
 	}
 
 	if (flush) {
@@ -1019,7 +1172,6 @@ int get_urecord(udomain_t* _d, str* _aor, struct urecord** _r)
 {
 	unsigned int sl, aorhash;
 	urecord_t* r;
-	void ** dest;
 
 
 	if (db_mode!=DB_ONLY) {
@@ -1027,13 +1179,11 @@ int get_urecord(udomain_t* _d, str* _aor, struct urecord** _r)
 		aorhash = core_hash(_aor, 0, 0);
 		sl = aorhash&(_d->size-1);
 
-
-		dest = map_find(_d->table[sl].records, *_aor);
-
-		if( dest == NULL )
+		r = slot_find(&_d->table[sl], _aor, aorhash);
+		if (r == NULL)
 			return 1;
 
-		*_r = *dest;
+		*_r = r;
 
 		return 0;
 
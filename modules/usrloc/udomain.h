@@ -56,6 +56,8 @@ typedef struct udomain {
 	query_list_t *ins_list;    /*!< insert buffering list for this domain */
 	int size;                  /*!< Hash table size */
 	struct hslot* table;       /*!< Hash table - array of collision slots */
+	time_t db_expired;         /*!< Time of the last bulk delete of the
+	                            * expired rows from the DB table */
 	/* statistics */
 	stat_var *users;           /*!< no of registered users */
 	stat_var *contacts;        /*!< no of registered contacts */
@@ -88,9 +90,10 @@ void print_udomain(FILE* _f, udomain_t* _d);
 
 
 /*! \brief
- * Load data from a database
+ * Load data from a database - only the rows modified since _since,
+ * on top of the already loaded contacts, if _since is not 0
  */
-int preload_udomain(db_con_t* _c, udomain_t* _d);
+int preload_udomain(db_con_t* _c, udomain_t* _d, time_t _since);
 
 
 /*! \brief
@@ -176,6 +176,8 @@ static inline int mi_add_aor_node(struct mi_node *parent, urecord_t* r,
 			node = add_mi_node_child( cnode, 0, "State", 5, "CS_SYNC", 7);
 		} else if (c->state== CS_DIRTY) {
 			node = add_mi_node_child( cnode, 0, "State", 5, "CS_DIRTY", 8);
+		} else if (c->state== CS_RESTORED) {
+			node = add_mi_node_child( cnode, 0, "State", 5, "CS_RESTORED", 11);
 		} else {
 			node = add_mi_node_child( cnode, 0, "State", 5, "CS_UNKNOWN", 10);
 		}
@@ -638,6 +640,7 @@ static int mi_process_sync(void *param, str key, void *value)
 
 	for (c = rec->contacts; c; c = c->next) {
 		c->state = CS_NEW;
+		ul_queue_sync(c);
 	}
 	return 0;
 }
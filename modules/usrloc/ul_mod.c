@@ -43,6 +43,7 @@
  */
 
 #include <stdio.h>
+#include <sys/time.h>
 #include "../../sr_module.h"
 #include "ul_mod.h"
 #include "../../rw_locking.h"
@@ -50,11 +51,13 @@
 #include "../../timer.h"     /* register_timer */
 #include "../../globals.h"   /* is_main */
 #include "../../ut.h"        /* str_init */
+#include "../../db/db_insertq.h" /* query_buffer_size */
 #include "dlist.h"           /* register_udomain */
 #include "udomain.h"         /* {insert,delete,get,release}_urecord */
 #include "urecord.h"         /* {insert,delete,get}_ucontact */
 #include "ucontact.h"        /* update_ucontact */
 #include "ureplication.h"
+#include "ul_snapshot.h"
 #include "ul_mi.h"
 #include "ul_callback.h"
 #include "usrloc.h"
@@ -120,6 +123,16 @@ int use_domain      = 0;				/*!< Whether usrloc should use domain part of aor */
 int desc_time_order = 0;				/*!< By default do not enable timestamp ordering */
 
 int ul_hash_size = 9;
+int ul_aor_index = 0;
+int db_flush_batch = 0;
+
+unsigned int ul_flush_rows = 0;
+unsigned int ul_flush_queries = 0;
+unsigned int ul_flush_inserts = 0;
+
+static stat_var *db_flush_time = 0;
+static stat_var *db_flush_rows = 0;
+static stat_var *db_flush_queries = 0;
 
 /* flag */
 unsigned int nat_bflag = (unsigned int)-1;
@@ -171,6 +184,10 @@ static param_export_t params[] = {
 	{"matching_mode",      INT_PARAM, &matching_mode     },
 	{"cseq_delay",         INT_PARAM, &cseq_delay        },
 	{"hash_size",          INT_PARAM, &ul_hash_size      },
+	{"aor_index",          INT_PARAM, &ul_aor_index      },
+	{"db_flush_batch",     INT_PARAM, &db_flush_batch    },
+	{"snapshot_file",      STR_PARAM, &ul_snap_file      },
+	{"snapshot_interval",  INT_PARAM, &ul_snap_interval  },
 	{"nat_bflag",          STR_PARAM, &nat_bflag_str     },
 	{"nat_bflag",          INT_PARAM, &nat_bflag         },
     /* data replication through UDP binary packets */
@@ -178,12 +195,24 @@ static param_export_t params[] = {
 	{ "replicate_contacts_to",     STR_PARAM|USE_FUNC_PARAM,
 	                            (void *)add_replication_dest           },
 	{ "skip_replicated_db_ops", INT_PARAM, &skip_replicated_db_ops     },
+	{ "replicate_contacts_batch",  INT_PARAM, &ul_repl_batch_size      },
+	{ "replicate_contacts_batch_window", INT_PARAM, &ul_repl_batch_window },
+	{ "replicate_contacts_compress", INT_PARAM, &ul_repl_compress      },
 	{0, 0, 0}
 };
 
 
 static stat_export_t mod_stats[] = {
 	{"registered_users" ,  STAT_IS_FUNC, (stat_var**)get_number_of_users  },
+	{"db_flush_time",       0,              &db_flush_time       },
+	{"db_flush_rows",       0,              &db_flush_rows       },
+	{"db_flush_queries",    0,              &db_flush_queries    },
+	{"repl_frames_sent",    0,              &repl_frames_sent    },
+	{"repl_events_sent",    0,              &repl_events_sent    },
+	{"repl_frames_received",0,              &repl_frames_recv    },
+	{"repl_events_received",0,              &repl_events_recv    },
+	{"repl_lag",            STAT_IS_FUNC,   (stat_var**)ul_repl_lag     },
+	{"repl_max_lag",        STAT_IS_FUNC,   (stat_var**)ul_repl_max_lag },
 	{0,0,0}
 };
 
@@ -296,6 +325,15 @@ static int mod_init(void)
 	register_timer( "ul-timer", timer, 0, timer_interval,
 		TIMER_FLAG_DELAY_ON_DELAY);
 
+	if (ul_snapshot_init() < 0) {
+		LM_ERR("snapshot initialization failed\n");
+		return -1;
+	}
+
+	if (ul_snap_file && ul_snap_interval > 0)
+		register_timer( "ul-snapshot", ul_snapshot_timer, 0,
+			ul_snap_interval, TIMER_FLAG_DELAY_ON_DELAY);
+
 	/* init the callbacks list */
 	if ( init_ulcb_list() < 0) {
 		LM_ERR("usrloc/callbacks initialization failed\n");
@@ -348,6 +386,11 @@ static int mod_init(void)
 		return -1;
 	}
 
+	if (ul_repl_batch_init() < 0) {
+		LM_ERR("cannot initialize the replication batching\n");
+		return -1;
+	}
+
 	init_flag = 1;
 
 	return 0;
@@ -357,10 +400,19 @@ static int mod_init(void)
 static int child_init(int _rank)
 {
 	dlist_t* ptr;
+	time_t since;
+
+	/* all the SIP workers share the loading of the snapshot, if any */
+	if (ul_snapshot_load(_rank) < 0) {
+		LM_ERR("child(%d): failed to load the snapshot\n", _rank);
+		return -1;
+	}
 
 	/* connecting to DB ? */
 	switch (db_mode) {
 		case NO_DB:
+			if (_rank == 1)
+				ul_snapshot_loaded();
 			return 0;
 		case DB_ONLY:
 		case WRITE_THROUGH:
@@ -378,14 +430,21 @@ static int child_init(int _rank)
 	}
 	/* _rank==1 is used even when fork is disabled */
 	if (_rank==1 && db_mode!= DB_ONLY) {
-		/* if cache is used, populate domains from DB */
+		/* if cache is used, populate domains from DB - only with the rows
+		 * changed since the snapshot, if one was loaded; in write-back
+		 * mode, the rows may be written up to a timer run later */
+		since = ul_snapshot_time();
+		if (since)
+			since -= UL_SNAP_DELTA_MARGIN +
+				(db_mode == WRITE_BACK ? timer_interval : 0);
 		for( ptr=root ; ptr ; ptr=ptr->next) {
-			if (preload_udomain(ul_dbh, ptr->d) < 0) {
+			if (preload_udomain(ul_dbh, ptr->d, since) < 0) {
 				LM_ERR("child(%d): failed to preload domain '%.*s'\n",
 						_rank, ptr->name.len, ZSW(ptr->name.s));
 				return -1;
 			}
 		}
+		ul_snapshot_loaded();
 	}
 
 	return 0;
@@ -418,6 +477,9 @@ static int mi_child_init(void)
  */
 static void destroy(void)
 {
+	/* send out the last coalesced replication events */
+	ul_repl_batch_flush();
+
 	/* we need to sync DB in order to flush the cache */
 	if (ul_dbh) {
 		ul_unlock_locks();
@@ -434,6 +496,13 @@ static void destroy(void)
 		ul_dbf.close(ul_dbh);
 	}
 
+	/* save the contacts for the next start */
+	if (ul_snap_file) {
+		if (!ul_dbh)
+			ul_unlock_locks();
+		ul_snapshot_destroy();
+	}
+
 	free_all_udomains();
 	ul_destroy_locks();
 
@@ -442,11 +511,44 @@ static void destroy(void)
 }
 
 
+static inline void ul_flush_stats(struct timeval *start)
+{
+	struct timeval end;
+	unsigned long ms;
+	unsigned int queries;
+
+	if (db_mode == NO_DB || db_mode == DB_ONLY)
+		return;
+
+	gettimeofday(&end, NULL);
+	ms = (end.tv_sec - start->tv_sec) * 1000 +
+		(end.tv_usec - start->tv_usec) / 1000;
+
+	/* the queued inserts are written query_buffer_size rows at a time */
+	queries = ul_flush_queries;
+	if (query_buffer_size > 1 &&
+	DB_CAPABILITY(ul_dbf, DB_CAP_MULTIPLE_INSERT))
+		queries += (ul_flush_inserts + query_buffer_size - 1) /
+			query_buffer_size;
+	else
+		queries += ul_flush_inserts;
+
+	update_stat(db_flush_time, ms);
+	update_stat(db_flush_rows, ul_flush_rows);
+	update_stat(db_flush_queries, queries);
+}
+
+
 /*! \brief
  * Timer handler
  */
 static void timer(unsigned int ticks, void* param)
 {
+	struct timeval start;
+
+	gettimeofday(&start, NULL);
+	ul_flush_rows = ul_flush_queries = ul_flush_inserts = 0;
+
 	if (sync_lock)
 		lock_start_read(sync_lock);
 	if (synchronize_all_udomains() != 0) {
@@ -454,6 +556,8 @@ static void timer(unsigned int ticks, void* param)
 	}
 	if (sync_lock)
 		lock_stop_read(sync_lock);
+
+	ul_flush_stats(&start);
 }
 
 static int add_replication_dest(modparam_t type, void *val)
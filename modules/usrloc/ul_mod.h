@@ -34,18 +34,13 @@
 
 #include "../../db/db.h"
 #include "../../str.h"
+#include "usrloc.h"
 
 
 /*
  * Module parameters
  */
 
-
-#define NO_DB         0
-#define WRITE_THROUGH 1
-#define WRITE_BACK    2
-#define DB_ONLY       3
-
 #define UL_TABLE_VERSION 1009
 
 extern str user_col;
@@ -73,6 +68,13 @@ extern int use_domain;
 extern int desc_time_order;
 extern int cseq_delay;
 extern int ul_hash_size;
+extern int ul_aor_index;
+extern int db_flush_batch;
+
+/* DB rows and queries of the current timer run - for the flush stats */
+extern unsigned int ul_flush_rows;
+extern unsigned int ul_flush_queries;
+extern unsigned int ul_flush_inserts;
 
 extern db_con_t* ul_dbh;   /* Database connection handle */
 extern db_func_t ul_dbf;
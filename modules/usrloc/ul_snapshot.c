@@ -0,0 +1,708 @@
+/*
+ * Usrloc binary snapshots, for fast restarts
+ *
+ * Copyright (C) 2013 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "../../mem/mem.h"
+#include "../../mem/shm_mem.h"
+#include "../../locking.h"
+#include "../../dprint.h"
+#include "../../ut.h"
+#include "../../flags.h"
+#include "../../socket_info.h"
+#include "ul_snapshot.h"
+#include "ul_mod.h"
+#include "dlist.h"
+#include "udomain.h"
+#include "urecord.h"
+#include "ucontact.h"
+
+#define UL_SNAP_ALIGN(_n) (((_n) + 7) & ~((uint64_t)7))
+
+char *ul_snap_file = NULL;
+int ul_snap_interval = 300;
+
+/* the records of one slot of the snapshot - the unit of work shared by
+ * the workers loading the snapshot */
+typedef struct ul_snap_unit {
+	uint64_t start;
+	uint64_t end;
+	unsigned int domain;    /*!< Index of the domain in the snapshot */
+} ul_snap_unit_t;
+
+/* loading progress, shared by the workers */
+typedef struct ul_snap_load {
+	gen_lock_t lock;
+	unsigned int next;      /*!< Next unit to be loaded */
+	unsigned int done;      /*!< Units loaded so far */
+	unsigned int contacts;  /*!< Contacts loaded so far */
+	volatile int loaded;    /*!< Startup loading over, snapshots allowed */
+} ul_snap_load_t;
+
+static ul_snap_load_t *snap_load = NULL;
+
+/* read-only mapping of the snapshot and its load units, set up in
+ * mod_init and inherited by all the workers */
+static char *snap_map = NULL;
+static uint64_t snap_size = 0;
+static time_t snap_time = 0;
+static ul_snap_unit_t *snap_units = NULL;
+static unsigned int snap_units_no = 0;
+static str *snap_domains = NULL;
+static unsigned int snap_domains_no = 0;
+
+/* buffer the contacts of a slot are packed in, under the slot lock */
+static char *snap_buf = NULL;
+static unsigned int snap_buf_size = 0;
+
+
+static int snap_add_unit(uint64_t start, uint64_t end, unsigned int domain)
+{
+	ul_snap_unit_t *units;
+
+	if ((snap_units_no & 255) == 0) {
+		units = pkg_realloc(snap_units,
+			(snap_units_no + 256) * sizeof(ul_snap_unit_t));
+		if (!units) {
+			LM_ERR("no more pkg memory\n");
+			return -1;
+		}
+		snap_units = units;
+	}
+
+	snap_units[snap_units_no].start = start;
+	snap_units[snap_units_no].end = end;
+	snap_units[snap_units_no].domain = domain;
+	snap_units_no++;
+	return 0;
+}
+
+
+/*! \brief
+ * Checks all the records of the mapped snapshot and splits it into load
+ * units, so the workers may later use it without any further checks
+ */
+static int snap_check(void)
+{
+	ul_snap_hdr_t *hdr;
+	ul_snap_domain_t *dom;
+	ul_snap_contact_t *sc;
+	uint64_t *offs, pos, rec, slen;
+	unsigned int i, j;
+
+	if (snap_size < sizeof(ul_snap_hdr_t))
+		return -1;
+
+	hdr = (ul_snap_hdr_t*)snap_map;
+	if (memcmp(hdr->magic, UL_SNAP_MAGIC, 4) != 0 ||
+	hdr->version != UL_SNAP_VERSION || hdr->size != snap_size) {
+		LM_ERR("bad header or truncated file\n");
+		return -1;
+	}
+
+	snap_domains = pkg_malloc((hdr->domains + 1) * sizeof(str));
+	if (!snap_domains) {
+		LM_ERR("no more pkg memory\n");
+		return -1;
+	}
+	snap_domains_no = hdr->domains;
+
+	pos = sizeof(ul_snap_hdr_t);
+	for (i = 0; i < hdr->domains; i++) {
+		if (pos + sizeof(ul_snap_domain_t) > snap_size)
+			return -1;
+		dom = (ul_snap_domain_t*)(snap_map + pos);
+		pos += sizeof(ul_snap_domain_t);
+
+		if (pos + UL_SNAP_ALIGN(dom->name_len) +
+		((uint64_t)dom->slots + 1) * sizeof(uint64_t) > snap_size)
+			return -1;
+		snap_domains[i].s = snap_map + pos;
+		snap_domains[i].len = dom->name_len;
+		pos += UL_SNAP_ALIGN(dom->name_len);
+
+		offs = (uint64_t*)(snap_map + pos);
+		pos += ((uint64_t)dom->slots + 1) * sizeof(uint64_t);
+		if (offs[0] != pos)
+			return -1;
+
+		for (j = 0; j < dom->slots; j++) {
+			if (offs[j + 1] < offs[j] || offs[j + 1] > snap_size)
+				return -1;
+
+			for (rec = offs[j]; rec < offs[j + 1]; rec += sc->len) {
+				sc = (ul_snap_contact_t*)(snap_map + rec);
+				if (rec + sizeof(ul_snap_contact_t) > offs[j + 1] ||
+				sc->len & 7 || rec + sc->len > offs[j + 1])
+					return -1;
+				slen = (uint64_t)sc->aor_len + sc->c_len + sc->callid_len +
+					sc->received_len + sc->path_len + sc->ua_len +
+					sc->instance_len + sc->attr_len + sc->sock_len +
+					sc->cflags_len;
+				if (sizeof(ul_snap_contact_t) + slen > sc->len ||
+				!sc->aor_len || !sc->c_len || !sc->callid_len)
+					return -1;
+			}
+
+			if (offs[j + 1] > offs[j] &&
+			snap_add_unit(offs[j], offs[j + 1], i) < 0)
+				return -1;
+		}
+
+		pos = offs[dom->slots];
+	}
+
+	if (pos != snap_size)
+		return -1;
+
+	snap_time = (time_t)hdr->time;
+	return 0;
+}
+
+
+static void snap_unmap(void)
+{
+	if (snap_map) {
+		munmap(snap_map, snap_size);
+		snap_map = NULL;
+	}
+	if (snap_units) {
+		pkg_free(snap_units);
+		snap_units = NULL;
+	}
+	if (snap_domains) {
+		pkg_free(snap_domains);
+		snap_domains = NULL;
+	}
+	snap_units_no = snap_domains_no = 0;
+}
+
+
+int ul_snapshot_init(void)
+{
+	struct stat st;
+	void *map;
+	int fd;
+
+	if (!ul_snap_file)
+		return 0;
+
+	if (db_mode == DB_ONLY) {
+		LM_WARN("snapshots are not used in DB only mode\n");
+		ul_snap_file = NULL;
+		return 0;
+	}
+
+	snap_load = shm_malloc(sizeof(ul_snap_load_t));
+	if (!snap_load) {
+		LM_ERR("no more shm memory\n");
+		return -1;
+	}
+	memset(snap_load, 0, sizeof(ul_snap_load_t));
+	lock_init(&snap_load->lock);
+	snap_load->loaded = 1;
+
+	fd = open(ul_snap_file, O_RDONLY);
+	if (fd < 0) {
+		if (errno == ENOENT) {
+			LM_INFO("no snapshot in %s yet\n", ul_snap_file);
+			return 0;
+		}
+		LM_ERR("failed to open %s: %s\n", ul_snap_file, strerror(errno));
+		return 0;
+	}
+
+	if (fstat(fd, &st) < 0 || st.st_size == 0) {
+		LM_ERR("failed to stat %s or empty file\n", ul_snap_file);
+		close(fd);
+		return 0;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		LM_ERR("failed to map %s: %s\n", ul_snap_file, strerror(errno));
+		return 0;
+	}
+	snap_map = map;
+	snap_size = st.st_size;
+
+	/* a broken snapshot is just ignored - everything comes from DB */
+	if (snap_check() < 0) {
+		LM_ERR("invalid snapshot %s, ignoring it\n", ul_snap_file);
+		snap_unmap();
+		snap_time = 0;
+		return 0;
+	}
+
+	LM_INFO("loading snapshot %s from %ld (%u units)\n",
+		ul_snap_file, (long)snap_time, snap_units_no);
+	snap_load->loaded = 0;
+	return 0;
+}
+
+
+/*! \brief
+ * Adds a contact of the snapshot to the domain, unless it was already
+ * registered again by the time it got loaded
+ */
+static int snap_load_contact(udomain_t* _d, ul_snap_contact_t* sc)
+{
+	ucontact_info_t ci;
+	str aor, contact, callid, path, ua, attr, s, host;
+	int port, proto;
+	char *p = sc->data;
+	urecord_t* r;
+	ucontact_t* c;
+
+#define snap_str(_s, _len) \
+	do { \
+		(_s).s = (_len) ? p : NULL; \
+		(_s).len = (_len); \
+		p += (_len); \
+	} while (0)
+
+	memset(&ci, 0, sizeof(ucontact_info_t));
+
+	snap_str(aor, sc->aor_len);
+	snap_str(contact, sc->c_len);
+	snap_str(callid, sc->callid_len);
+	snap_str(ci.received, sc->received_len);
+	snap_str(path, sc->path_len);
+	snap_str(ua, sc->ua_len);
+	snap_str(ci.instance, sc->instance_len);
+	snap_str(attr, sc->attr_len);
+
+	snap_str(s, sc->sock_len);
+	if (s.len) {
+		if (parse_phostport(s.s, s.len, &host.s, &host.len,
+		&port, &proto) != 0) {
+			LM_ERR("bad socket <%.*s>\n", s.len, s.s);
+		} else {
+			ci.sock = grep_sock_info(&host, (unsigned short)port, proto);
+			if (ci.sock == 0)
+				LM_DBG("non-local socket <%.*s>...ignoring\n", s.len, s.s);
+		}
+	}
+
+	snap_str(s, sc->cflags_len);
+	if (s.len)
+		ci.cflags = flag_list_to_bitmask(&s, FLAG_TYPE_BRANCH, FLAG_DELIM);
+
+#undef snap_str
+
+	ci.callid = &callid;
+	ci.path = &path;
+	ci.user_agent = &ua;
+	ci.attr = &attr;
+	ci.expires = (time_t)sc->expires;
+	ci.last_modified = (time_t)sc->last_modified;
+	ci.q = sc->q;
+	ci.cseq = sc->cseq;
+	ci.flags = sc->flags;
+	ci.methods = sc->methods;
+
+	lock_udomain(_d, &aor);
+
+	if (get_urecord(_d, &aor, &r) > 0) {
+		if (mem_insert_urecord(_d, &aor, &r) < 0) {
+			LM_ERR("failed to create a record\n");
+			unlock_udomain(_d, &aor);
+			return -1;
+		}
+	} else if (get_ucontact(r, &contact, &callid, ci.cseq, &c) != 1) {
+		/* registered again meanwhile - the live copy is newer */
+		unlock_udomain(_d, &aor);
+		return 0;
+	}
+
+	if ((c = mem_insert_ucontact(r, &contact, &ci)) == 0) {
+		LM_ERR("inserting contact failed\n");
+		unlock_udomain(_d, &aor);
+		return -1;
+	}
+
+	/* a new contact may have been written back to DB after the snapshot,
+	 * or not at all before the restart - write it with an insert-update */
+	c->state = (db_mode == WRITE_BACK &&
+		(sc->state == CS_NEW || sc->state == CS_RESTORED)) ?
+		CS_RESTORED : sc->state;
+	if (c->state == CS_SYNC) {
+		c->db_expires = (time_t)sc->db_expires;
+		ul_unqueue_sync(c);
+	}
+
+	unlock_udomain(_d, &aor);
+	return 0;
+}
+
+
+int ul_snapshot_load(int rank)
+{
+	udomain_t *d;
+	ul_snap_unit_t *u;
+	uint64_t pos;
+	unsigned int n, loaded;
+
+	if (!snap_map)
+		return 0;
+
+	if (rank < 1) {
+		snap_unmap();
+		return 0;
+	}
+
+	/* take units of work until none left, in parallel with the other
+	 * workers, as each unit covers a single slot of the snapshot */
+	for (;;) {
+		lock_get(&snap_load->lock);
+		n = snap_load->next;
+		if (n < snap_units_no)
+			snap_load->next++;
+		lock_release(&snap_load->lock);
+
+		if (n >= snap_units_no)
+			break;
+
+		u = &snap_units[n];
+		loaded = 0;
+
+		if (find_domain(&snap_domains[u->domain], &d) != 0) {
+			LM_DBG("domain '%.*s' not used anymore\n",
+				snap_domains[u->domain].len, snap_domains[u->domain].s);
+		} else {
+			for (pos = u->start; pos < u->end;
+			pos += ((ul_snap_contact_t*)(snap_map + pos))->len)
+				if (snap_load_contact(d,
+				(ul_snap_contact_t*)(snap_map + pos)) == 0)
+					loaded++;
+		}
+
+		lock_get(&snap_load->lock);
+		snap_load->done++;
+		snap_load->contacts += loaded;
+		lock_release(&snap_load->lock);
+	}
+
+	if (rank == 1) {
+		/* wait for the units still loaded by the other workers */
+		for (;;) {
+			lock_get(&snap_load->lock);
+			n = snap_load->done;
+			lock_release(&snap_load->lock);
+			if (n >= snap_units_no)
+				break;
+			sleep_us(10000);
+		}
+
+		LM_INFO("loaded %u contacts from snapshot %s\n",
+			snap_load->contacts, ul_snap_file);
+	}
+
+	snap_unmap();
+	return 0;
+}
+
+
+time_t ul_snapshot_time(void)
+{
+	return snap_time;
+}
+
+
+void ul_snapshot_loaded(void)
+{
+	if (snap_load)
+		snap_load->loaded = 1;
+}
+
+
+static inline int snap_buf_grow(unsigned int len)
+{
+	char *buf;
+	unsigned int size;
+
+	if (len <= snap_buf_size)
+		return 0;
+
+	size = snap_buf_size ? snap_buf_size : 4096;
+	while (size < len)
+		size *= 2;
+
+	buf = pkg_realloc(snap_buf, size);
+	if (!buf) {
+		LM_ERR("no more pkg memory\n");
+		return -1;
+	}
+	snap_buf = buf;
+	snap_buf_size = size;
+	return 0;
+}
+
+
+/*! \brief
+ * Packs all the contacts of a slot into the snapshot buffer - called
+ * with the slot locked
+ * \return the packed length or -1 on error
+ */
+static int snap_pack_slot(hslot_t* s)
+{
+	map_iterator_t it;
+	void **dest;
+	urecord_t *r;
+	ucontact_t *c;
+	ul_snap_contact_t *sc;
+	str sock, cflags;
+	unsigned int len, used = 0;
+	char *p;
+
+#define snap_put(_s) \
+	do { \
+		if ((_s).len) { \
+			memcpy(p, (_s).s, (_s).len); \
+			p += (_s).len; \
+		} \
+	} while (0)
+
+	for (map_first(s->records, &it); iterator_is_valid(&it);
+	iterator_next(&it)) {
+		dest = iterator_val(&it);
+		if (dest == NULL)
+			return -1;
+		r = (urecord_t*)*dest;
+
+		for (c = r->contacts; c; c = c->next) {
+			if (c->sock)
+				sock = c->sock->sock_str;
+			else {
+				sock.s = NULL;
+				sock.len = 0;
+			}
+			if (c->cflags)
+				cflags = bitmask_to_flag_list(FLAG_TYPE_BRANCH, c->cflags);
+			else {
+				cflags.s = NULL;
+				cflags.len = 0;
+			}
+
+			len = UL_SNAP_ALIGN(sizeof(ul_snap_contact_t) + r->aor.len +
+				c->c.len + c->callid.len + c->received.len + c->path.len +
+				c->user_agent.len + c->instance.len + c->attr.len +
+				sock.len + cflags.len);
+			if (snap_buf_grow(used + len) < 0)
+				return -1;
+
+			sc = (ul_snap_contact_t*)(snap_buf + used);
+			memset(sc, 0, len);
+			sc->len = len;
+			sc->state = c->state;
+			sc->expires = c->expires;
+			sc->db_expires = c->db_expires;
+			sc->last_modified = c->last_modified;
+			sc->q = c->q;
+			sc->cseq = c->cseq;
+			sc->flags = c->flags;
+			sc->methods = c->methods;
+			sc->aor_len = r->aor.len;
+			sc->c_len = c->c.len;
+			sc->callid_len = c->callid.len;
+			sc->received_len = c->received.len;
+			sc->path_len = c->path.len;
+			sc->ua_len = c->user_agent.len;
+			sc->instance_len = c->instance.len;
+			sc->attr_len = c->attr.len;
+			sc->sock_len = sock.len;
+			sc->cflags_len = cflags.len;
+
+			p = sc->data;
+			snap_put(r->aor);
+			snap_put(c->c);
+			snap_put(c->callid);
+			snap_put(c->received);
+			snap_put(c->path);
+			snap_put(c->user_agent);
+			snap_put(c->instance);
+			snap_put(c->attr);
+			snap_put(sock);
+			snap_put(cflags);
+
+			used += len;
+		}
+	}
+
+#undef snap_put
+
+	return used;
+}
+
+
+int ul_snapshot_write(void)
+{
+	static const char pad[8] = {0};
+	ul_snap_hdr_t hdr;
+	ul_snap_domain_t dom;
+	dlist_t *dl;
+	udomain_t *d;
+	uint64_t *offs = NULL, pos;
+	long idx_pos;
+	char *tmp;
+	FILE *f;
+	int i, len, fd;
+
+	/* do not overwrite the snapshot while still loading it */
+	if (!ul_snap_file || !snap_load || !snap_load->loaded)
+		return 0;
+
+	len = strlen(ul_snap_file);
+	tmp = pkg_malloc(len + 5);
+	if (!tmp) {
+		LM_ERR("no more pkg memory\n");
+		return -1;
+	}
+	memcpy(tmp, ul_snap_file, len);
+	memcpy(tmp + len, ".tmp", 5);
+
+	/* the contacts are nobody else's business */
+	fd = open(tmp, O_WRONLY|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR);
+	if (fd < 0 || (f = fdopen(fd, "w")) == NULL) {
+		LM_ERR("failed to open %s: %s\n", tmp, strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		pkg_free(tmp);
+		return -1;
+	}
+
+	memset(&hdr, 0, sizeof(ul_snap_hdr_t));
+	memcpy(hdr.magic, UL_SNAP_MAGIC, 4);
+	hdr.version = UL_SNAP_VERSION;
+	hdr.time = time(NULL);
+	for (dl = root; dl; dl = dl->next)
+		hdr.domains++;
+
+	if (fwrite(&hdr, sizeof(ul_snap_hdr_t), 1, f) != 1)
+		goto write_error;
+	pos = sizeof(ul_snap_hdr_t);
+
+	for (dl = root; dl; dl = dl->next) {
+		d = dl->d;
+
+		dom.name_len = d->name->len;
+		dom.slots = d->size;
+		if (fwrite(&dom, sizeof(ul_snap_domain_t), 1, f) != 1 ||
+		fwrite(d->name->s, 1, d->name->len, f) != d->name->len ||
+		fwrite(pad, 1, UL_SNAP_ALIGN(d->name->len) - d->name->len, f) !=
+		UL_SNAP_ALIGN(d->name->len) - d->name->len)
+			goto write_error;
+		pos += sizeof(ul_snap_domain_t) + UL_SNAP_ALIGN(d->name->len);
+
+		/* the offsets are known only after writing the slots */
+		offs = pkg_malloc((d->size + 1) * sizeof(uint64_t));
+		if (!offs) {
+			LM_ERR("no more pkg memory\n");
+			goto error;
+		}
+		memset(offs, 0, (d->size + 1) * sizeof(uint64_t));
+		idx_pos = pos;
+		if (fwrite(offs, sizeof(uint64_t), d->size + 1, f) != d->size + 1)
+			goto write_error;
+		pos += (d->size + 1) * sizeof(uint64_t);
+
+		for (i = 0; i < d->size; i++) {
+			offs[i] = pos;
+
+			lock_ulslot(d, i);
+			len = snap_pack_slot(&d->table[i]);
+			unlock_ulslot(d, i);
+
+			if (len < 0)
+				goto error;
+			if (len && fwrite(snap_buf, 1, len, f) != len)
+				goto write_error;
+			pos += len;
+		}
+		offs[d->size] = pos;
+
+		if (fseek(f, idx_pos, SEEK_SET) < 0 ||
+		fwrite(offs, sizeof(uint64_t), d->size + 1, f) != d->size + 1 ||
+		fseek(f, 0, SEEK_END) < 0)
+			goto write_error;
+
+		pkg_free(offs);
+		offs = NULL;
+	}
+
+	hdr.size = pos;
+	if (fseek(f, 0, SEEK_SET) < 0 ||
+	fwrite(&hdr, sizeof(ul_snap_hdr_t), 1, f) != 1 ||
+	fflush(f) != 0 || fsync(fileno(f)) < 0)
+		goto write_error;
+
+	fclose(f);
+	f = NULL;
+
+	/* replace the old snapshot only once the new one is complete */
+	if (rename(tmp, ul_snap_file) < 0) {
+		LM_ERR("failed to rename %s: %s\n", tmp, strerror(errno));
+		goto error;
+	}
+
+	LM_DBG("wrote snapshot %s (%llu bytes)\n", ul_snap_file,
+		(unsigned long long)pos);
+	pkg_free(tmp);
+	return 0;
+
+write_error:
+	LM_ERR("failed to write %s: %s\n", tmp, strerror(errno));
+error:
+	if (f)
+		fclose(f);
+	unlink(tmp);
+	if (offs)
+		pkg_free(offs);
+	pkg_free(tmp);
+	return -1;
+}
+
+
+void ul_snapshot_timer(unsigned int ticks, void* param)
+{
+	ul_snapshot_write();
+}
+
+
+void ul_snapshot_destroy(void)
+{
+	if (ul_snapshot_write() < 0)
+		LM_ERR("failed to write the snapshot on shutdown\n");
+
+	if (snap_load) {
+		shm_free(snap_load);
+		snap_load = NULL;
+	}
+}
@@ -0,0 +1,113 @@
+/*
+ * Usrloc binary snapshots, for fast restarts
+ *
+ * Copyright (C) 2013 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _USRLOC_SNAPSHOT_H_
+#define _USRLOC_SNAPSHOT_H_
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Layout of a snapshot file - all the structures are 8 bytes aligned, so
+ * the file is used directly from a read-only mapping:
+ *
+ *   ul_snap_hdr_t
+ *   for each domain:
+ *     ul_snap_domain_t, the domain name (padded), slots+1 record offsets
+ *     the contact records of each slot (ul_snap_contact_t + strings)
+ *
+ * The snapshot is meant to be loaded by the same OpenSIPS build (no
+ * endianness conversions are done).
+ */
+
+#define UL_SNAP_MAGIC    "ULSN"
+#define UL_SNAP_VERSION  1
+
+typedef struct ul_snap_hdr {
+	char magic[4];
+	uint32_t version;
+	int64_t time;           /*!< When the snapshot was started */
+	uint64_t size;          /*!< Total size of the file, for validation */
+	uint32_t domains;
+	uint32_t reserved;
+} ul_snap_hdr_t;
+
+typedef struct ul_snap_domain {
+	uint32_t name_len;
+	uint32_t slots;
+	/* followed by the name and (slots+1) uint64_t offsets of the records
+	 * of each slot, relative to the start of the file */
+} ul_snap_domain_t;
+
+typedef struct ul_snap_contact {
+	uint32_t len;           /*!< Size of the record, padding included */
+	uint32_t state;
+	int64_t expires;
+	int64_t db_expires;
+	int64_t last_modified;
+	int32_t q;
+	int32_t cseq;
+	uint32_t flags;
+	uint32_t methods;
+	/* lengths of the strings following the record, in this order */
+	uint32_t aor_len;
+	uint32_t c_len;
+	uint32_t callid_len;
+	uint32_t received_len;
+	uint32_t path_len;
+	uint32_t ua_len;
+	uint32_t instance_len;
+	uint32_t attr_len;
+	uint32_t sock_len;
+	uint32_t cflags_len;    /*!< Script flags, as a list of names */
+	char data[0];
+} ul_snap_contact_t;
+
+/* the DB rows modified this many seconds before the snapshot are also
+ * loaded, for the registrations in progress while it was written (plus
+ * the timer interval in write-back mode, for the rows written late) */
+#define UL_SNAP_DELTA_MARGIN 5
+
+extern char *ul_snap_file;
+extern int ul_snap_interval;
+
+/* maps and checks the snapshot file, if any (mod_init) */
+int ul_snapshot_init(void);
+
+/* loads a share of the snapshot in the calling worker - the first worker
+ * also waits for the whole snapshot to be loaded (child_init) */
+int ul_snapshot_load(int rank);
+
+/* time of the loaded snapshot, 0 if none */
+time_t ul_snapshot_time(void);
+
+/* marks the end of the startup loading - snapshots may be written */
+void ul_snapshot_loaded(void);
+
+/* writes a new snapshot of all the domains */
+int ul_snapshot_write(void);
+
+void ul_snapshot_timer(unsigned int ticks, void* param);
+
+void ul_snapshot_destroy(void);
+
+#endif /* _USRLOC_SNAPSHOT_H_ */
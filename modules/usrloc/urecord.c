@@ -147,6 +147,10 @@ ucontact_t* mem_insert_ucontact(urecord_t* _r, str* _c, ucontact_info_t* _ci)
 	}
 	if_update_stat( _r->slot, _r->slot->d->contacts, 1);
 
+	c->rec = _r;
+	ul_index_contact(c);
+	ul_queue_sync(c);
+
 	ptr = _r->contacts;
 
 	if (!desc_time_order) {
@@ -186,6 +190,8 @@ ucontact_t* mem_insert_ucontact(urecord_t* _r, str* _c, ucontact_info_t* _ci)
  */
 void mem_remove_ucontact(urecord_t* _r, ucontact_t* _c)
 {
+	ul_unindex_contact(_c);
+
 	if (_c->prev) {
 		_c->prev->next = _c->next;
 		if (_c->next) {
@@ -214,6 +220,123 @@ void mem_delete_ucontact(urecord_t* _r, ucontact_t* _c)
 }
 
 
+/*! \brief
+ * Checks if the DB row of the contact was already removed by the last
+ * bulk delete of the expired rows (see mem_timer_udomain)
+ */
+static inline int db_row_expired(ucontact_t* _c)
+{
+	return _c->db_expires && _c->rec &&
+		_c->db_expires <= _c->rec->slot->d->db_expired;
+}
+
+
+/*! \brief
+ * Handles a contact found expired by the timer
+ * \return 0 if the contact was deleted, -1 if it has to be kept for now
+ * (write-back mode only, if it could not be deleted from the database)
+ */
+int timer_expire_ucontact(urecord_t* _r, ucontact_t* _c)
+{
+	/* run callbacks for EXPIRE event */
+	if (exists_ulcb_type(UL_CONTACT_EXPIRE))
+		run_ul_callbacks( UL_CONTACT_EXPIRE, _c);
+
+	LM_DBG("Binding '%.*s','%.*s' has expired\n",
+		_c->aor->len, ZSW(_c->aor->s),
+		_c->c.len, ZSW(_c->c.s));
+	update_stat( _r->slot->d->expires, 1);
+
+	/* Should we remove the contact from the database ? */
+	if (db_mode != NO_DB && st_expired_ucontact(_c) == 1) {
+		if (db_row_expired(_c)) {
+			ul_flush_rows++;
+		} else if (db_delete_ucontact(_c) < 0) {
+			LM_ERR("failed to delete contact from the database\n");
+			/* in write-back mode, do not delete from memory now - if
+			 * we do, we'll get a stuck record in DB. Future registrations
+			 * will not be able to get inserted due to index collision.
+			 * In write-through mode the contact is dropped anyway (the
+			 * error is only logged), or it would be retried forever */
+			if (db_mode == WRITE_BACK)
+				return -1;
+		} else {
+			ul_flush_rows++;
+			ul_flush_queries++;
+		}
+	}
+
+	mem_delete_ucontact(_r, _c);
+	return 0;
+}
+
+
+/*! \brief
+ * Synchronizes a contact with the database from the timer
+ * \return 1 if an insert was done, 0 otherwise
+ */
+int timer_flush_ucontact(ucontact_t* _c, query_list_t **ins_list)
+{
+	cstate_t old_state;
+	int ret;
+
+	ul_unqueue_sync(_c);
+
+	/* Determine the operation we have to do */
+	old_state = _c->state;
+
+	switch(st_flush_ucontact(_c)) {
+	case 0: /* do nothing, contact is synchronized */
+		break;
+
+	case 2: /* update */
+		/* the contact was refreshed after its row expired and the row is
+		 * already gone with the bulk delete - write it back as new */
+		if (!db_row_expired(_c)) {
+			if (db_update_ucontact(_c) < 0) {
+				LM_ERR("updating contact in db failed\n");
+				_c->state = old_state;
+				ul_queue_sync(_c);
+			} else {
+				ul_flush_rows++;
+				ul_flush_queries++;
+			}
+			break;
+		}
+		/* fall-through */
+	case 1: /* insert */
+		if (db_insert_ucontact(_c,ins_list,0) < 0) {
+			LM_ERR("inserting contact into database failed\n");
+			_c->state = old_state;
+			ul_queue_sync(_c);
+		} else {
+			ul_flush_rows++;
+			ul_flush_inserts++;
+		}
+		return 1;
+
+	case 3: /* insert or update */
+		/* restored from a snapshot - it may have been written or not
+		 * before the restart */
+		if (DB_CAPABILITY(ul_dbf, DB_CAP_INSERT_UPDATE))
+			ret = db_insert_ucontact(_c,0,1);
+		else if ((ret = db_insert_ucontact(_c,0,0)) < 0)
+			ret = db_update_ucontact(_c);
+		if (ret < 0) {
+			LM_ERR("writing restored contact into database failed\n");
+			_c->state = old_state;
+			ul_queue_sync(_c);
+		} else {
+			ul_flush_rows++;
+			ul_flush_queries++;
+		}
+		break;
+	}
+
+	return 0;
+}
+
+
 /*! \brief
  * This timer routine is used when
  * db_mode is set to NO_DB
@@ -226,19 +349,10 @@ static inline int nodb_timer(urecord_t* _r)
 
 	while(ptr) {
 		if (!VALID_CONTACT(ptr, act_time)) {
-			/* run callbacks for EXPIRE event */
-			if (exists_ulcb_type(UL_CONTACT_EXPIRE))
-				run_ul_callbacks( UL_CONTACT_EXPIRE, ptr);
-
-			LM_DBG("Binding '%.*s','%.*s' has expired\n",
-				ptr->aor->len, ZSW(ptr->aor->s),
-				ptr->c.len, ZSW(ptr->c.s));
-
 			t = ptr;
 			ptr = ptr->next;
 
-			mem_delete_ucontact(_r, t);
-			update_stat( _r->slot->d->expires, 1);
+			timer_expire_ucontact(_r, t);
 		} else {
 			ptr = ptr->next;
 		}
@@ -294,63 +408,19 @@ static inline int wt_timer(urecord_t* _r)
 static inline int wb_timer(urecord_t* _r,query_list_t **ins_list)
 {
 	ucontact_t* ptr, *t;
-	cstate_t old_state;
-	int op,ins_done=0;
+	int ins_done=0;
 
 	ptr = _r->contacts;
 
 	while(ptr) {
 		if (!VALID_CONTACT(ptr, act_time)) {
-			/* run callbacks for EXPIRE event */
-			if (exists_ulcb_type(UL_CONTACT_EXPIRE)) {
-				run_ul_callbacks( UL_CONTACT_EXPIRE, ptr);
-			}
-
-			LM_DBG("Binding '%.*s','%.*s' has expired\n",
-				ptr->aor->len, ZSW(ptr->aor->s),
-				ptr->c.len, ZSW(ptr->c.s));
-			update_stat( _r->slot->d->expires, 1);
-
 			t = ptr;
 			ptr = ptr->next;
 
-			/* Should we remove the contact from the database ? */
-			if (st_expired_ucontact(t) == 1) {
-				if (db_delete_ucontact(t) < 0) {
-					LM_ERR("failed to delete contact from the database\n");
-					/* do not delete from memory now - if we do, we'll get
-					 * a stuck record in DB. Future registrations will not be
-					 * able to get inserted due to index collision */
-					continue;
-				}
-			}
-
-			mem_delete_ucontact(_r, t);
+			timer_expire_ucontact(_r, t);
 		} else {
-			/* Determine the operation we have to do */
-			old_state = ptr->state;
-			op = st_flush_ucontact(ptr);
-
-			switch(op) {
-			case 0: /* do nothing, contact is synchronized */
-				break;
-
-			case 1: /* insert */
-				if (db_insert_ucontact(ptr,ins_list,0) < 0) {
-					LM_ERR("inserting contact into database failed\n");
-					ptr->state = old_state;
-				}
-				if (ins_done == 0)
-					ins_done = 1;
-				break;
-
-			case 2: /* update */
-				if (db_update_ucontact(ptr) < 0) {
-					LM_ERR("updating contact in db failed\n");
-					ptr->state = old_state;
-				}
-				break;
-			}
+			if (timer_flush_ucontact(ptr, ins_list))
+				ins_done = 1;
 
 			ptr = ptr->next;
 		}
@@ -459,6 +529,7 @@ int insert_ucontact(urecord_t* _r, str* _contact, ucontact_info_t* _ci,
 			LM_ERR("failed to insert in database\n");
 		} else {
 			(*_c)->state = CS_SYNC;
+			ul_unqueue_sync(*_c);
 		}
 	}
 
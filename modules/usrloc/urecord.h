@@ -99,6 +99,18 @@ void mem_delete_ucontact(urecord_t* _r, ucontact_t* _c);
 int timer_urecord(urecord_t* _r,query_list_t **ins_list);
 
 
+/*
+ * Timer handling of a single expired contact
+ */
+int timer_expire_ucontact(urecord_t* _r, ucontact_t* _c);
+
+
+/*
+ * Timer handling of a single contact not in sync with the DB
+ */
+int timer_flush_ucontact(ucontact_t* _c, query_list_t **ins_list);
+
+
 /*
  * Delete the whole record from database
  */
@@ -27,19 +27,143 @@
 #include "ureplication.h"
 #include "dlist.h"
 #include "../../forward.h"
+#include "../../repl_batch.h"
 
 str repl_module_name = str_init("ul");
 
 /* Skip all DB operations when receiving replicated data */
 int skip_replicated_db_ops;
 
-/* packet sending */
+/**
+ * Coalesced replication: the events are batched by the core replication
+ * batch into frames which are sent to all the destinations when they get
+ * full or when their oldest event exceeds the
+ * 'replicate_contacts_batch_window' delay.
+ *
+ * Frame body: flags, raw length, number of events, the wall clock time
+ * of the oldest event (for the lag statistics) and the (optionally
+ * compressed) events, each one as LEN | TYPE | <event fields>
+ */
 
-void replicate_urecord_insert(urecord_t *r)
+int ul_repl_batch_size = 0;
+int ul_repl_batch_window = 10;
+int ul_repl_compress = 0;
+
+stat_var *repl_frames_sent;
+stat_var *repl_events_sent;
+stat_var *repl_frames_recv;
+stat_var *repl_events_recv;
+
+/* the lag of the last received frame and the highest one, in shm */
+static long *repl_lag_vals;
+
+static struct repl_batch *repl_batch;
+
+static void ul_repl_send_frame(struct repl_frame *f);
+static void ul_repl_send_event(void);
+
+int ul_repl_batch_init(void)
+{
+	repl_lag_vals = shm_malloc(2 * sizeof *repl_lag_vals);
+	if (!repl_lag_vals) {
+		LM_ERR("no more shm memory for the replication lag\n");
+		return -1;
+	}
+	memset(repl_lag_vals, 0, 2 * sizeof *repl_lag_vals);
+
+	if (!replication_dests || ul_repl_batch_size <= 0)
+		return 0;
+
+	repl_batch = repl_batch_new("ul-repl-batch", ul_repl_batch_size,
+		ul_repl_batch_window, ul_repl_compress, ul_repl_send_frame,
+		ul_repl_send_event);
+
+	return repl_batch ? 0 : -1;
+}
+
+unsigned long ul_repl_lag(void *foo)
+{
+	return repl_lag_vals ? repl_lag_vals[0] : 0;
+}
+
+unsigned long ul_repl_max_lag(void *foo)
+{
+	return repl_lag_vals ? repl_lag_vals[1] : 0;
+}
+
+static inline void ul_repl_update_lag(long lag)
+{
+	long max;
+
+	repl_lag_vals[0] = lag;
+
+	max = repl_lag_vals[1];
+	while (lag > max &&
+			!__sync_bool_compare_and_swap(&repl_lag_vals[1], max, lag))
+		max = repl_lag_vals[1];
+}
+
+static void ul_repl_send_frame(struct repl_frame *f)
 {
 	struct replication_dest *d;
-	str send_buffer;
+	str data, st;
+
+	st.s   = (char *)&f->first_ms;
+	st.len = sizeof f->first_ms;
+
+	if (bin_init(&repl_module_name, REPL_BATCH) != 0 ||
+			bin_push_int(f->flags) < 0 || bin_push_int(f->raw_len) < 0 ||
+			bin_push_int(f->events) < 0 || bin_push_str(&st) < 0 ||
+			bin_push_str(&f->data) < 0) {
+		LM_ERR("failed to build replication frame (%d events lost)\n",
+			f->events);
+		return;
+	}
 
+	bin_get_buffer(&data);
+
+	for (d = replication_dests; d; d = d->next)
+		msg_send(0,PROTO_BIN,&d->to,0,data.s,data.len,0);
+
+	update_stat(repl_frames_sent, 1);
+	update_stat(repl_events_sent, f->events);
+}
+
+/* sends the event currently built in the bin buffer, unbatched */
+static void ul_repl_send_event(void)
+{
+	struct replication_dest *d;
+	str ev;
+
+	bin_get_buffer(&ev);
+
+	for (d = replication_dests; d; d = d->next)
+		msg_send(0,PROTO_BIN,&d->to,0,ev.s,ev.len,0);
+
+	update_stat(repl_events_sent, 1);
+}
+
+/**
+ * sends the event currently built in the bin buffer to all the
+ * replication destinations, or queues it in the current batch
+ */
+static void ul_repl_send(int type)
+{
+	if (repl_batch)
+		repl_batch_queue(repl_batch, type);
+	else
+		ul_repl_send_event();
+}
+
+void ul_repl_batch_flush(void)
+{
+	repl_batch_flush(repl_batch);
+}
+
+/* packet sending */
+
+void replicate_urecord_insert(urecord_t *r)
+{
 	if (bin_init(&repl_module_name, REPL_URECORD_INSERT) != 0) {
 		LM_ERR("failed to replicate this event\n");
 		return;
@@ -48,17 +172,11 @@ void replicate_urecord_insert(urecord_t *r)
 	bin_push_str(r->domain);
 	bin_push_str(&r->aor);
 
-	bin_get_buffer(&send_buffer);
-
-	for (d = replication_dests; d; d = d->next)
-		msg_send(0,PROTO_BIN,&d->to,0,send_buffer.s,send_buffer.len,0);
+	ul_repl_send(REPL_URECORD_INSERT);
 }
 
 void replicate_urecord_delete(urecord_t *r)
 {
-	struct replication_dest *d;
-	str send_buffer;
-
 	if (bin_init(&repl_module_name, REPL_URECORD_DELETE) != 0) {
 		LM_ERR("failed to replicate this event\n");
 		return;
@@ -67,16 +185,11 @@ void replicate_urecord_delete(urecord_t *r)
 	bin_push_str(r->domain);
 	bin_push_str(&r->aor);
 
-	bin_get_buffer(&send_buffer);
-
-	for (d = replication_dests; d; d = d->next)
-		msg_send(0,PROTO_BIN,&d->to,0,send_buffer.s,send_buffer.len,0);
+	ul_repl_send(REPL_URECORD_DELETE);
 }
 
 void replicate_ucontact_insert(urecord_t *r, str *contact, ucontact_info_t *ci)
 {
-	struct replication_dest *d;
-	str send_buffer;
 	str st;
 
 	if (bin_init(&repl_module_name, REPL_UCONTACT_INSERT) != 0) {
@@ -112,16 +225,11 @@ void replicate_ucontact_insert(urecord_t *r, str *contact, ucontact_info_t *ci)
 	st.len = sizeof ci->last_modified;
 	bin_push_str(&st);
 
-	bin_get_buffer(&send_buffer);
-
-	for (d = replication_dests; d; d = d->next)
-		msg_send(0,PROTO_BIN,&d->to,0,send_buffer.s,send_buffer.len,0);
+	ul_repl_send(REPL_UCONTACT_INSERT);
 }
 
 void replicate_ucontact_update(urecord_t *r, str *contact, ucontact_info_t *ci)
 {
-	struct replication_dest *d;
-	str send_buffer;
 	str st;
 
 	if (bin_init(&repl_module_name, REPL_UCONTACT_UPDATE) != 0) {
@@ -157,16 +265,11 @@ void replicate_ucontact_update(urecord_t *r, str *contact, ucontact_info_t *ci)
 	st.len = sizeof ci->last_modified;
 	bin_push_str(&st);
 
-	bin_get_buffer(&send_buffer);
-
-	for (d = replication_dests; d; d = d->next)
-		msg_send(0,PROTO_BIN,&d->to,0,send_buffer.s,send_buffer.len,0);
+	ul_repl_send(REPL_UCONTACT_UPDATE);
 }
 
 void replicate_ucontact_delete(urecord_t *r, ucontact_t *c)
 {
-	struct replication_dest *d;
-	str send_buffer;
 
 	if (bin_init(&repl_module_name, REPL_UCONTACT_DELETE) != 0) {
 		LM_ERR("failed to replicate this event\n");
@@ -179,18 +282,28 @@ void replicate_ucontact_delete(urecord_t *r, ucontact_t *c)
 	bin_push_str(&c->callid);
 	bin_push_int(c->cseq);
 
-	bin_get_buffer(&send_buffer);
-
-	for (d = replication_dests; d; d = d->next)
-		msg_send(0,PROTO_BIN,&d->to,0,send_buffer.s,send_buffer.len,0);
+	ul_repl_send(REPL_UCONTACT_DELETE);
 }
 
 /* packet receiving */
 
+/* the events of a frame are applied with their slot already locked */
+static inline void repl_lock_udomain(udomain_t *d, str *aor, int locked)
+{
+	if (!locked)
+		lock_udomain(d, aor);
+}
+
+static inline void repl_unlock_udomain(udomain_t *d, str *aor, int locked)
+{
+	if (!locked)
+		unlock_udomain(d, aor);
+}
+
 /**
  * Note: prevents the creation of any duplicate AoR
  */
-static int receive_urecord_insert(void)
+static int receive_urecord_insert(int locked)
 {
 	str d, aor;
 	urecord_t *r;
@@ -204,18 +317,18 @@ static int receive_urecord_insert(void)
 		goto out_err;
 	}
 
-	lock_udomain(domain, &aor);
+	repl_lock_udomain(domain, &aor, locked);
 
 	if (get_urecord(domain, &aor, &r) == 0)
 		goto out;
 
 	if (insert_urecord(domain, &aor, &r, 1) != 0) {
-		unlock_udomain(domain, &aor);
+		repl_unlock_udomain(domain, &aor, locked);
 		goto out_err;
 	}
 
 out:
-	unlock_udomain(domain, &aor);
+	repl_unlock_udomain(domain, &aor, locked);
 
 	return 0;
 
@@ -225,7 +338,7 @@ out_err:
 	return -1;
 }
 
-static int receive_urecord_delete(void)
+static int receive_urecord_delete(int locked)
 {
 	str d, aor;
 	udomain_t *domain;
@@ -238,14 +351,14 @@ static int receive_urecord_delete(void)
 		goto out_err;
 	}
 
-	lock_udomain(domain, &aor);
+	repl_lock_udomain(domain, &aor, locked);
 
 	if (delete_urecord(domain, &aor, NULL, 1) != 0) {
-		unlock_udomain(domain, &aor);
+		repl_unlock_udomain(domain, &aor, locked);
 		goto out_err;
 	}
 
-	unlock_udomain(domain, &aor);
+	repl_unlock_udomain(domain, &aor, locked);
 
 	return 0;
 
@@ -255,7 +368,7 @@ out_err:
 	return -1;
 }
 
-static int receive_ucontact_insert(void)
+static int receive_ucontact_insert(int locked)
 {
 	static ucontact_info_t ci;
 	static str d, aor, host, contact_str, callid,
@@ -326,7 +439,7 @@ static int receive_ucontact_insert(void)
 	if (skip_replicated_db_ops)
 		ci.flags |= FL_MEM;
 
-	lock_udomain(domain, &aor);
+	repl_lock_udomain(domain, &aor, locked);
 
 	if (get_urecord(domain, &aor, &record) != 0) {
 		LM_INFO("failed to fetch local urecord - creating new one "
@@ -334,18 +447,18 @@ static int receive_ucontact_insert(void)
 
 		if (insert_urecord(domain, &aor, &record, 1) != 0) {
 			LM_ERR("failed to insert new record\n");
-			unlock_udomain(domain, &aor);
+			repl_unlock_udomain(domain, &aor, locked);
 			goto error;
 		}
 	}
 
 	if (insert_ucontact(record, &contact_str, &ci, &contact, 1) != 0) {
 		LM_ERR("failed to insert ucontact (ci: '%.*s')\n", callid.len, callid.s);
-		unlock_udomain(domain, &aor);
+		repl_unlock_udomain(domain, &aor, locked);
 		goto error;
 	}
 
-	unlock_udomain(domain, &aor);
+	repl_unlock_udomain(domain, &aor, locked);
 
 	return 0;
 
@@ -355,7 +468,7 @@ error:
 	return -1;
 }
 
-static int receive_ucontact_update(void)
+static int receive_ucontact_update(int locked)
 {
 	static ucontact_info_t ci;
 	static str d, aor, host, contact_str, callid,
@@ -427,7 +540,7 @@ static int receive_ucontact_update(void)
 	if (skip_replicated_db_ops)
 		ci.flags |= FL_MEM;
 
-	lock_udomain(domain, &aor);
+	repl_lock_udomain(domain, &aor, locked);
 
 	/* failure in retrieving a urecord may be ok, because packet order in UDP
 	 * is not guaranteed, so update commands may arrive before inserts */
@@ -437,13 +550,13 @@ static int receive_ucontact_update(void)
 
 		if (insert_urecord(domain, &aor, &record, 1) != 0) {
 			LM_ERR("failed to insert urecord\n");
-			unlock_udomain(domain, &aor);
+			repl_unlock_udomain(domain, &aor, locked);
 			goto error;
 		}
 
 		if (insert_ucontact(record, &contact_str, &ci, &contact, 1) != 0) {
 			LM_ERR("failed (ci: '%.*s')\n", callid.len, callid.s);
-			unlock_udomain(domain, &aor);
+			repl_unlock_udomain(domain, &aor, locked);
 			goto error;
 		}
 	} else {
@@ -455,20 +568,20 @@ static int receive_ucontact_update(void)
 			if (insert_ucontact(record, &contact_str, &ci, &contact, 1) != 0) {
 				LM_ERR("failed to insert ucontact (ci: '%.*s')\n",
 				        callid.len, callid.s);
-				unlock_udomain(domain, &aor);
+				repl_unlock_udomain(domain, &aor, locked);
 				goto error;
 			}
 		} else {
 			if (update_ucontact(record, contact, &ci, 1) != 0) {
 				LM_ERR("failed to update ucontact '%.*s' (ci: '%.*s')\n",
 				        contact_str.len, contact_str.s, callid.len, callid.s);
-				unlock_udomain(domain, &aor);
+				repl_unlock_udomain(domain, &aor, locked);
 				goto error;
 			}
 		}
 	}
 
-	unlock_udomain(domain, &aor);
+	repl_unlock_udomain(domain, &aor, locked);
 
 	return 0;
 
@@ -478,7 +591,7 @@ error:
 	return -1;
 }
 
-static int receive_ucontact_delete(void)
+static int receive_ucontact_delete(int locked)
 {
 	udomain_t  *domain;
 	urecord_t  *record;
@@ -497,7 +610,7 @@ static int receive_ucontact_delete(void)
 		goto error;
 	}
 
-	lock_udomain(domain, &aor);
+	repl_lock_udomain(domain, &aor, locked);
 
 	/* failure in retrieving a urecord may be ok, because packet order in UDP
 	 * is not guaranteed, so urecord_delete commands may arrive before
@@ -505,7 +618,7 @@ static int receive_ucontact_delete(void)
 	if (get_urecord(domain, &aor, &record) != 0) {
 		LM_INFO("failed to fetch local urecord - ignoring request "
 				"(ci: '%.*s')\n", callid.len, callid.s);
-		unlock_udomain(domain, &aor);
+		repl_unlock_udomain(domain, &aor, locked);
 		return 0;
 	}
 
@@ -514,7 +627,7 @@ static int receive_ucontact_delete(void)
 	if (rc != 0 && rc != 2) {
 		LM_ERR("contact '%.*s' not found: (ci: '%.*s')\n", contact_str.len,
 		        contact_str.s, callid.len, callid.s);
-		unlock_udomain(domain, &aor);
+		repl_unlock_udomain(domain, &aor, locked);
 		goto error;
 	}
 
@@ -524,11 +637,11 @@ static int receive_ucontact_delete(void)
 	if (delete_ucontact(record, contact, 1) != 0) {
 		LM_ERR("failed to delete ucontact '%.*s' (ci: '%.*s')\n",
 		        contact_str.len, contact_str.s, callid.len, callid.s);
-		unlock_udomain(domain, &aor);
+		repl_unlock_udomain(domain, &aor, locked);
 		goto error;
 	}
 
-	unlock_udomain(domain, &aor);
+	repl_unlock_udomain(domain, &aor, locked);
 
 	return 0;
 
@@ -538,31 +651,29 @@ error:
 	return -1;
 }
 
-void receive_binary_packet(int packet_type, struct receive_info *ri)
+static int receive_event(int packet_type, int locked)
 {
 	int rc;
 
-	LM_DBG("received a binary packet [%d]!\n", packet_type);
-
 	switch (packet_type) {
 	case REPL_URECORD_INSERT:
-		rc = receive_urecord_insert();
+		rc = receive_urecord_insert(locked);
 		break;
 
 	case REPL_URECORD_DELETE:
-		rc = receive_urecord_delete();
+		rc = receive_urecord_delete(locked);
 		break;
 
 	case REPL_UCONTACT_INSERT:
-		rc = receive_ucontact_insert();
+		rc = receive_ucontact_insert(locked);
 		break;
 
 	case REPL_UCONTACT_UPDATE:
-		rc = receive_ucontact_update();
+		rc = receive_ucontact_update(locked);
 		break;
 
 	case REPL_UCONTACT_DELETE:
-		rc = receive_ucontact_delete();
+		rc = receive_ucontact_delete(locked);
 		break;
 
 	default:
@@ -570,7 +681,144 @@ void receive_binary_packet(int packet_type, struct receive_info *ri)
 		LM_ERR("invalid usrloc binary packet type: %d\n", packet_type);
 	}
 
+	return rc;
+}
+
+struct repl_frame_event {
+	udomain_t *d;
+	int slot;
+	int idx;        /* position in the frame, to keep the order */
+	char *pos;
+	char *end;
+};
+
+static int repl_frame_event_cmp(const void *a, const void *b)
+{
+	const struct repl_frame_event *ea = a, *eb = b;
+
+	if (ea->d != eb->d)
+		return ea->d < eb->d ? -1 : 1;
+	if (ea->slot != eb->slot)
+		return ea->slot < eb->slot ? -1 : 1;
+	return ea->idx - eb->idx;
+}
+
+/**
+ * applies the events carried by a coalesced frame - they are grouped by
+ * hash slot (keeping their order within each slot), so each slot touched
+ * by the frame is locked only once
+ */
+static int receive_batch(void)
+{
+	static struct repl_frame_event *evs;
+	static int evs_size;
+	struct repl_frame_event *tmp;
+	int flags, raw_len, events, type, n = 0, i, j, k, rc = 0;
+	char *p, *end, *pos, *rcv_end;
+	long long first_ms, lag;
+	str data, st, ev, dom, aor;
+	udomain_t *d;
+
+	if (bin_pop_int(&flags) != 0 || bin_pop_int(&raw_len) != 0 ||
+			bin_pop_int(&events) != 0 || bin_pop_str(&st) != 0 ||
+			st.len != sizeof first_ms || bin_pop_str(&data) != 0) {
+		LM_ERR("malformed usrloc replication frame\n");
+		return -1;
+	}
+	memcpy(&first_ms, st.s, sizeof first_ms);
+
+	if (repl_frame_unpack(flags, raw_len, &data) != 0)
+		return -1;
+
+	LM_DBG("received a frame of %d usrloc events\n", events);
+
+	bin_get_rcv_pos(&pos, &rcv_end);
+
+	/* first pass - find out the slot of each event */
+	for (p = data.s, end = data.s + data.len;
+			(k = repl_frame_next(&p, end, &ev)) != 0;) {
+		if (k < 0) {
+			rc = -1;
+			break;
+		}
+
+		bin_set_rcv_pos(ev.s, ev.s + ev.len);
+		if (bin_pop_int(&type) != 0 || bin_pop_str(&dom) != 0 ||
+				bin_pop_str(&aor) != 0) {
+			LM_ERR("malformed event in replication frame\n");
+			rc = -1;
+			continue;
+		}
+
+		if (find_domain(&dom, &d) != 0) {
+			LM_ERR("domain '%.*s' is not local\n", dom.len, dom.s);
+			rc = -1;
+			continue;
+		}
+
+		if (n == evs_size) {
+			tmp = pkg_realloc(evs, (evs_size ? 2 * evs_size : 64) * sizeof *evs);
+			if (!tmp) {
+				LM_ERR("no more pkg memory (%d events lost)\n", events - n);
+				rc = -1;
+				break;
+			}
+			evs = tmp;
+			evs_size = evs_size ? 2 * evs_size : 64;
+		}
+
+		evs[n].d = d;
+		evs[n].slot = core_hash(&aor, 0, d->size);
+		evs[n].idx = n;
+		evs[n].pos = ev.s;
+		evs[n].end = ev.s + ev.len;
+		n++;
+	}
+
+	qsort(evs, n, sizeof *evs, repl_frame_event_cmp);
+
+	/* second pass - each event is popped as if it was received on its own */
+	for (i = 0; i < n; i = j) {
+		lock_ulslot(evs[i].d, evs[i].slot);
+
+		for (j = i; j < n && evs[j].d == evs[i].d &&
+				evs[j].slot == evs[i].slot; j++) {
+			bin_set_rcv_pos(evs[j].pos, evs[j].end);
+			bin_pop_int(&type);
+			if (receive_event(type, 1) != 0)
+				rc = -1;
+		}
+
+		unlock_ulslot(evs[i].d, evs[i].slot);
+	}
+
+	bin_set_rcv_pos(pos, rcv_end);
+
+	update_stat(repl_frames_recv, 1);
+	update_stat(repl_events_recv, n);
+
+	/* relies on the clocks of the nodes being in sync */
+	lag = repl_now_ms() - first_ms;
+	if (lag < 0)
+		lag = 0;
+	ul_repl_update_lag((long)lag);
+
+	return rc;
+}
+
+void receive_binary_packet(int packet_type, struct receive_info *ri)
+{
+	int rc;
+
+	LM_DBG("received a binary packet [%d]!\n", packet_type);
+
+	if (packet_type == REPL_BATCH) {
+		rc = receive_batch();
+	} else {
+		rc = receive_event(packet_type, 0);
+		update_stat(repl_events_recv, 1);
+	}
+
 	if (rc != 0)
 		LM_ERR("failed to process a binary packet!\n");
 }
-
@@ -32,6 +32,7 @@
 #include "../../socket_info.h"
 #include "../../resolve.h"
 #include "../../timer.h"
+#include "../../statistics.h"
 
 #include "urecord.h"
 
@@ -40,10 +41,19 @@
 #define REPL_UCONTACT_INSERT 3
 #define REPL_UCONTACT_UPDATE 4
 #define REPL_UCONTACT_DELETE 5
+#define REPL_BATCH           6
 
 extern int accept_replicated_udata;
 extern struct replication_dest *replication_dests;
 extern str repl_module_name;
+extern int ul_repl_batch_size;
+extern int ul_repl_batch_window;
+extern int ul_repl_compress;
+
+extern stat_var *repl_frames_sent;
+extern stat_var *repl_events_sent;
+extern stat_var *repl_frames_recv;
+extern stat_var *repl_events_recv;
 
 struct replication_dest {
 	union sockaddr_union to;
@@ -59,5 +69,13 @@ void replicate_ucontact_delete(urecord_t *r, ucontact_t *c);
 
 void receive_binary_packet(int packet_type, struct receive_info *ri);
 
+/* coalescing of the replicated events into frames */
+int ul_repl_batch_init(void);
+void ul_repl_batch_flush(void);
+
+/* lag of the received frames, exported as statistics */
+unsigned long ul_repl_lag(void *foo);
+unsigned long ul_repl_max_lag(void *foo);
+
 #endif /* _USRLOC_REPLICATION_H_ */
 
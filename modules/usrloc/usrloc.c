@@ -55,6 +55,9 @@ int bind_usrloc(usrloc_api_t* api)
 	api->get_next_udomain      = get_next_udomain;
 	api->get_all_ucontacts     = get_all_ucontacts;
 	api->get_domain_ucontacts  = get_domain_ucontacts;
+	api->init_ucontact_cursor  = init_ucontact_cursor;
+	api->next_ucontacts        = next_ucontacts;
+	api->get_partition_slots   = get_partition_slots;
 	api->insert_urecord        = insert_urecord;
 	api->delete_urecord        = delete_urecord;
 	api->get_urecord           = get_urecord;
@@ -36,6 +36,13 @@
 #include "ul_callback.h"
 
 
+/* database modes, as reported by usrloc_api_t.db_mode */
+#define NO_DB         0
+#define WRITE_THROUGH 1
+#define WRITE_BACK    2
+#define DB_ONLY       3
+
+
 typedef struct usrloc_api {
 	int           use_domain;
 	int           db_mode;
@@ -44,6 +51,9 @@ typedef struct usrloc_api {
 	register_udomain_t     register_udomain;
 	get_all_ucontacts_t    get_all_ucontacts;
 	get_domain_ucontacts_t get_domain_ucontacts;
+	init_ucontact_cursor_t init_ucontact_cursor;
+	next_ucontacts_t       next_ucontacts;
+	get_partition_slots_t  get_partition_slots;
 
 	insert_urecord_t       insert_urecord;
 	delete_urecord_t       delete_urecord;
@@ -116,6 +116,9 @@ inline static int handle_io(struct fd_map* fm, int idx,int event_type)
 		case F_TIMER_JOB:
 			handle_timer_job();
 			break;
+		case F_ASYNC_JOB:
+			handle_async_job(fm->fd);
+			break;
 		case F_SCRIPT_ASYNC:
 			async_resume_f( fm->fd, fm->data);
 			return 0;
@@ -302,6 +305,18 @@ void tcp_worker_proc( int unix_sock, int max_fd )
 		goto error;
 	}
 
+	/* start watching for the async jobs */
+	if (reactor_add_reader( async_job_fd_out, F_ASYNC_JOB, RCT_PRIO_ASYNC,
+	NULL)<0){
+		LM_CRIT("failed to add async job pipe_out to reactor\n");
+		goto error;
+	}
+	if (reactor_add_reader( async_job_proc_fd(), F_ASYNC_JOB, RCT_PRIO_ASYNC,
+	NULL)<0){
+		LM_CRIT("failed to add own async job pipe_out to reactor\n");
+		goto error;
+	}
+
 	/* add the unix socket */
 	if (reactor_add_reader( tcpmain_sock, F_TCPMAIN, RCT_PRIO_PROC, NULL)<0) {
 		LM_CRIT("failed to add socket to the fd list\n");
@@ -264,6 +264,9 @@ inline static int handle_io(struct fd_map* fm, int idx,int event_type)
 		case F_TIMER_JOB:
 			handle_timer_job();
 			return 0;
+		case F_ASYNC_JOB:
+			handle_async_job(fm->fd);
+			return 0;
 		case F_SCRIPT_ASYNC:
 			async_resume_f( fm->fd, fm->data);
 			return 0;
@@ -298,6 +301,18 @@ int udp_rcv_loop( struct socket_info *si )
 		goto error;
 	}
 
+	/* start watching for the async jobs */
+	if (reactor_add_reader( async_job_fd_out, F_ASYNC_JOB, RCT_PRIO_ASYNC,
+	NULL)<0){
+		LM_CRIT("failed to add async job pipe_out to reactor\n");
+		goto error;
+	}
+	if (reactor_add_reader( async_job_proc_fd(), F_ASYNC_JOB, RCT_PRIO_ASYNC,
+	NULL)<0){
+		LM_CRIT("failed to add own async job pipe_out to reactor\n");
+		goto error;
+	}
+
 	/* init: start watching the SIP UDP fd */
 	if (reactor_add_reader( si->socket, F_UDP_READ, RCT_PRIO_NET, si)<0) {
 		LM_CRIT("failed to add UDP listen socket to reactor\n");
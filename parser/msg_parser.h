@@ -113,6 +113,9 @@ enum request_method {
 									 * message have been registered) */
 #define FL_TM_FAKE_REQ       (1<<17) /* the SIP request is a fake one, generated based on the transaction, 
 					either in failure route or resume route */	
+#define FL_SHM_COMPACT       (1<<18) /* msg cloned in SHM without the parsed
+                                      * bodies not needed by TM (requires
+                                      * FL_SHM_CLONE) */
 
 /* define the # of unknown URI parameters to parse */
 #define URI_MAX_U_PARAMS 10
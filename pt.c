@@ -33,6 +33,7 @@
 #include "dprint.h"
 #include "pt.h"
 #include "bin_interface.h"
+#include "async.h"
 
 
 /* array with children pids, 0= main proc,
@@ -69,6 +70,9 @@ int init_multi_proc_support(void)
 	/* timer processes */
 	proc_no += 2 /* timer keeper + timer trigger */;
 
+	/* async logger process */
+	proc_no += log_async_count_procs();
+
 	/* count the processes requested by modules */
 	proc_no += count_module_procs();
 
@@ -152,10 +156,12 @@ pid_t internal_fork(char *proc_desc)
 		/* each children need a unique seed */
 		seed_child(seed);
 		init_debug();
+		log_async_attach();
 
 		/* set attributes */
 		set_proc_attrs(proc_desc);
 		tcp_connect_proc_to_tcp_main( process_no, 1);
+		async_jobs_child_init();
 		return 0;
 	}else{
 		/* parent process */
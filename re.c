@@ -36,6 +36,9 @@
 
 #include "dprint.h"
 #include "mem/mem.h"
+#include "config.h"
+#include "hash_func.h"
+#include "core_stats.h"
 #include "re.h"
 
 #include <string.h>
@@ -639,3 +642,122 @@ error:
 	if (count) *count=-1;
 	return 0;
 }
+
+
+
+/*! \brief regexp compiled at runtime (out of a PV pattern), kept in the
+ * per-process LRU cache */
+struct re_cache_entry {
+	str pattern;
+	int cflags;
+	unsigned int hash;
+	regex_t re;
+	struct re_cache_entry *h_next;   /* hash bucket chain */
+	struct re_cache_entry *lru_prev; /* towards the most recently used */
+	struct re_cache_entry *lru_next; /* towards the least recently used */
+};
+
+static struct re_cache_entry *re_cache_hash[RE_CACHE_HASH_SIZE];
+static struct re_cache_entry *re_cache_mru = NULL;
+static struct re_cache_entry *re_cache_lru = NULL;
+static int re_cache_no = 0;
+
+static inline void re_cache_lru_unlink(struct re_cache_entry *e)
+{
+	if (e->lru_prev) e->lru_prev->lru_next = e->lru_next;
+	else re_cache_mru = e->lru_next;
+	if (e->lru_next) e->lru_next->lru_prev = e->lru_prev;
+	else re_cache_lru = e->lru_prev;
+	e->lru_prev = e->lru_next = NULL;
+}
+
+static inline void re_cache_lru_push(struct re_cache_entry *e)
+{
+	e->lru_prev = NULL;
+	e->lru_next = re_cache_mru;
+	if (re_cache_mru) re_cache_mru->lru_prev = e;
+	else re_cache_lru = e;
+	re_cache_mru = e;
+}
+
+static void re_cache_evict(void)
+{
+	struct re_cache_entry *e, **it;
+
+	e = re_cache_lru;
+	re_cache_lru_unlink(e);
+	for (it=&re_cache_hash[e->hash&(RE_CACHE_HASH_SIZE-1)]; *it;
+	it=&(*it)->h_next) {
+		if (*it==e) {
+			*it = e->h_next;
+			break;
+		}
+	}
+	regfree(&e->re);
+	pkg_free(e);
+	re_cache_no--;
+}
+
+
+/*! \brief Returns the compiled form of a regexp built at runtime
+ *
+ * The regexps are compiled on the first use and kept in a bounded,
+ * per-process LRU cache (keyed by pattern and compile flags), so the
+ * script and module functions taking the pattern out of variables do
+ * not compile it over and over again.
+ * The returned regexp belongs to the cache - it must not be freed and it
+ * is valid only until the next call of this function.
+ * \return the compiled regexp or NULL on error (bad regexp, no memory)
+ */
+regex_t* re_cache_get(str *pattern, int cflags)
+{
+	struct re_cache_entry *e;
+	unsigned int hash;
+
+	hash = core_hash(pattern, NULL, 0) ^ cflags;
+
+	for (e=re_cache_hash[hash&(RE_CACHE_HASH_SIZE-1)]; e; e=e->h_next) {
+		if (e->hash==hash && e->cflags==cflags &&
+		e->pattern.len==pattern->len &&
+		memcmp(e->pattern.s, pattern->s, pattern->len)==0) {
+			if (e!=re_cache_mru) {
+				re_cache_lru_unlink(e);
+				re_cache_lru_push(e);
+			}
+			update_stat(re_cache_hits, 1);
+			return &e->re;
+		}
+	}
+
+	update_stat(re_cache_misses, 1);
+
+	e = (struct re_cache_entry*)pkg_malloc(sizeof(struct re_cache_entry) +
+		pattern->len + 1);
+	if (e==NULL) {
+		LM_ERR("no more pkg memory\n");
+		return NULL;
+	}
+	memset(e, 0, sizeof(struct re_cache_entry));
+	e->pattern.s = (char*)(e+1);
+	e->pattern.len = pattern->len;
+	memcpy(e->pattern.s, pattern->s, pattern->len);
+	e->pattern.s[pattern->len] = 0;
+	e->cflags = cflags;
+	e->hash = hash;
+
+	if (regcomp(&e->re, e->pattern.s, cflags)!=0) {
+		LM_ERR("bad regexp '%s'\n", e->pattern.s);
+		pkg_free(e);
+		return NULL;
+	}
+
+	if (re_cache_no>=RE_CACHE_SIZE)
+		re_cache_evict();
+
+	e->h_next = re_cache_hash[hash&(RE_CACHE_HASH_SIZE-1)];
+	re_cache_hash[hash&(RE_CACHE_HASH_SIZE-1)] = e;
+	re_cache_lru_push(e);
+	re_cache_no++;
+
+	return &e->re;
+}
@@ -82,6 +82,8 @@ struct replace_lst* subst_run( struct subst_expr* se, const char* input,
 str* subst_str(const char* input, struct sip_msg* msg,
 				struct subst_expr* se, int* count);
 
+regex_t* re_cache_get(str *pattern, int cflags);
+
 
 
 #endif
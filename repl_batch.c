@@ -0,0 +1,265 @@
+/*
+ * Coalescing of the replicated events into frames
+ *
+ * Copyright (C) 2013 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <string.h>
+#include <sys/time.h>
+
+#include "repl_batch.h"
+#include "bin_interface.h"
+#include "mem/mem.h"
+#include "mem/shm_mem.h"
+#include "dprint.h"
+#include "lz.h"
+
+static void repl_batch_utimer(utime_t ticks, void *param);
+
+struct repl_batch *repl_batch_new(char *label, int size, int window,
+		int compress, repl_frame_send_f *send, repl_event_send_f *send_event)
+{
+	struct repl_batch *b;
+
+	if (size > REPL_BATCH_MAX) {
+		LM_WARN("%s: batch size %d too big, using %d\n",
+				label, size, REPL_BATCH_MAX);
+		size = REPL_BATCH_MAX;
+	}
+
+	if (window <= 0) {
+		LM_ERR("%s: invalid batch window %d\n", label, window);
+		return NULL;
+	}
+
+	b = shm_malloc(sizeof *b + size);
+	if (!b) {
+		LM_ERR("no more shm memory for the replication batch\n");
+		return NULL;
+	}
+	memset(b, 0, sizeof *b);
+	lock_init(&b->lock);
+
+	b->size = size;
+	b->window = window;
+	b->compress = compress;
+	b->send = send;
+	b->send_event = send_event;
+
+	if (register_utimer(label, repl_batch_utimer, b, window * 1000,
+			TIMER_FLAG_DELAY_ON_DELAY) < 0) {
+		LM_ERR("failed to register the %s utimer\n", label);
+		shm_free(b);
+		return NULL;
+	}
+
+	return b;
+}
+
+long long repl_now_ms(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (long long)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static void repl_frame_send(struct repl_batch *b, struct repl_frame *f)
+{
+	static unsigned char *lz_buf;
+	int rc;
+
+	f->flags = 0;
+	f->raw_len = f->data.len;
+
+	if (b->compress) {
+		if (!lz_buf && !(lz_buf = pkg_malloc(REPL_BATCH_MAX))) {
+			LM_ERR("no more pkg memory for the compression buffer\n");
+		} else {
+			/* only use it if it is worth it */
+			rc = lz_compress((unsigned char *)f->data.s, f->data.len,
+					lz_buf, f->data.len);
+			if (rc > 0) {
+				f->data.s = (char *)lz_buf;
+				f->data.len = rc;
+				f->flags |= REPL_FRAME_LZ;
+			}
+		}
+	}
+
+	b->send(f);
+}
+
+/* sends the queued events as a frame - must be called under lock, so
+ * the frames leave in the order their events were queued */
+static void repl_batch_send(struct repl_batch *b)
+{
+	struct repl_frame f;
+
+	if (!b->len)
+		return;
+
+	f.data.s = b->buf;
+	f.data.len = b->len;
+	f.events = b->events;
+	f.first = b->first;
+	f.first_ms = b->first_ms;
+
+	repl_frame_send(b, &f);
+
+	b->len = 0;
+	b->events = 0;
+}
+
+/* writes an event record (LEN | TYPE | fields) and returns its length */
+static inline int repl_put_event(char *p, int type, str *ev)
+{
+	int len = CMD_FIELD_SIZE + ev->len;
+
+	memcpy(p, &len, LEN_FIELD_SIZE);
+	memcpy(p + LEN_FIELD_SIZE, &type, CMD_FIELD_SIZE);
+	memcpy(p + LEN_FIELD_SIZE + CMD_FIELD_SIZE, ev->s, ev->len);
+
+	return LEN_FIELD_SIZE + len;
+}
+
+void repl_batch_queue(struct repl_batch *b, int type)
+{
+	static char *single;
+	struct repl_frame f;
+	int skip, rec_len;
+	str ev;
+
+	/* skip the header, the module name and the command */
+	bin_get_buffer(&ev);
+	skip = HEADER_SIZE + LEN_FIELD_SIZE + *(int *)(ev.s + HEADER_SIZE) +
+		CMD_FIELD_SIZE;
+	ev.s += skip;
+	ev.len -= skip;
+	rec_len = LEN_FIELD_SIZE + CMD_FIELD_SIZE + ev.len;
+
+	lock_get(&b->lock);
+
+	if (rec_len > b->size) {
+		/* too big to be batched - send it on its own, but only after
+		 * the already queued events, to keep them ordered */
+		repl_batch_send(b);
+
+		if (rec_len > REPL_BATCH_MAX ||
+		(!single && !(single = pkg_malloc(REPL_BATCH_MAX)))) {
+			/* does not fit in a frame (or no buffer for it) - the bin
+			 * buffer still holds it as a regular replication packet */
+			b->send_event();
+		} else {
+			f.data.s = single;
+			f.data.len = repl_put_event(single, type, &ev);
+			f.events = 1;
+			f.first = get_uticks();
+			f.first_ms = repl_now_ms();
+			repl_frame_send(b, &f);
+		}
+
+		lock_release(&b->lock);
+		return;
+	}
+
+	/* no more room - send the queued events first */
+	if (b->len + rec_len > b->size)
+		repl_batch_send(b);
+
+	if (!b->events) {
+		b->first = get_uticks();
+		b->first_ms = repl_now_ms();
+	}
+
+	b->len += repl_put_event(b->buf + b->len, type, &ev);
+	b->events++;
+
+	lock_release(&b->lock);
+}
+
+void repl_batch_flush(struct repl_batch *b)
+{
+	if (!b)
+		return;
+
+	lock_get(&b->lock);
+	repl_batch_send(b);
+	lock_release(&b->lock);
+}
+
+static void repl_batch_utimer(utime_t ticks, void *param)
+{
+	struct repl_batch *b = (struct repl_batch *)param;
+
+	/* unlocked peek - nothing to do most of the time */
+	if (!b->events)
+		return;
+
+	lock_get(&b->lock);
+	if (b->events && get_uticks() - b->first >= (utime_t)b->window * 1000)
+		repl_batch_send(b);
+	lock_release(&b->lock);
+}
+
+int repl_frame_unpack(int flags, int raw_len, str *data)
+{
+	static char *raw;
+
+	if (!(flags & REPL_FRAME_LZ))
+		return 0;
+
+	if (raw_len <= 0 || raw_len > BUF_SIZE) {
+		LM_ERR("bad raw length %d of replication frame\n", raw_len);
+		return -1;
+	}
+	if (!raw && !(raw = pkg_malloc(BUF_SIZE))) {
+		LM_ERR("no more pkg memory for the decompression buffer\n");
+		return -1;
+	}
+	if (lz_decompress((unsigned char *)data->s, data->len,
+			(unsigned char *)raw, BUF_SIZE) != raw_len) {
+		LM_ERR("failed to decompress replication frame\n");
+		return -1;
+	}
+
+	data->s = raw;
+	data->len = raw_len;
+	return 0;
+}
+
+int repl_frame_next(char **p, char *end, str *ev)
+{
+	int len;
+
+	if (*p + LEN_FIELD_SIZE > end)
+		return 0;
+
+	memcpy(&len, *p, LEN_FIELD_SIZE);
+	if (len < (int)CMD_FIELD_SIZE || *p + LEN_FIELD_SIZE + len > end) {
+		LM_ERR("truncated event in replication frame\n");
+		return -1;
+	}
+
+	ev->s = *p + LEN_FIELD_SIZE;
+	ev->len = len;
+	*p = ev->s + len;
+
+	return 1;
+}
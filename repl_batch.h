@@ -0,0 +1,98 @@
+/*
+ * Coalescing of the replicated events into frames
+ *
+ * Copyright (C) 2013 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _REPL_BATCH_H_
+#define _REPL_BATCH_H_
+
+#include "str.h"
+#include "config.h"
+#include "timer.h"
+#include "locking.h"
+
+/*
+ * Instead of sending a datagram for each replicated event, the events
+ * built by all the processes are appended (in shared memory) to a batch
+ * which is handed as a frame to the owner module when it gets full or
+ * when its oldest event exceeds the batch window. The frames are sent
+ * under the lock of the batch, so they leave in the order their events
+ * were queued, whichever process sends them.
+ *
+ * The frame holds the events, each one as LEN | TYPE | <event fields>,
+ * optionally LZ compressed - how it is wrapped into a bin packet and
+ * sent is up to the module.
+ */
+
+/* flags of a frame */
+#define REPL_FRAME_LZ		(1<<0)
+
+/* leave room for the bin header and the frame fields */
+#define REPL_BATCH_MAX		(BUF_SIZE - 1024)
+
+struct repl_frame {
+	str data;             /* the events, compressed if REPL_FRAME_LZ */
+	int flags;
+	int raw_len;          /* length of the uncompressed events */
+	int events;
+	utime_t first;        /* uticks of the oldest event */
+	long long first_ms;   /* wall clock of the oldest event (ms) */
+};
+
+typedef void (repl_frame_send_f)(struct repl_frame *frame);
+
+/* sends, unbatched, the event currently built in the bin buffer */
+typedef void (repl_event_send_f)(void);
+
+struct repl_batch {
+	gen_lock_t lock;
+	int size;
+	int window;           /* in milliseconds */
+	int compress;
+	repl_frame_send_f *send;
+	repl_event_send_f *send_event;
+
+	int len;
+	int events;
+	utime_t first;
+	long long first_ms;
+	char buf[0];
+};
+
+/* allocates the batch and registers its utimer - call it from mod_init */
+struct repl_batch *repl_batch_new(char *label, int size, int window,
+		int compress, repl_frame_send_f *send, repl_event_send_f *send_event);
+
+/* queues the event currently built in the bin buffer; an event too big
+ * for a frame is handed to send_event() once the queued ones are sent */
+void repl_batch_queue(struct repl_batch *b, int type);
+
+void repl_batch_flush(struct repl_batch *b);
+
+/* decompresses, if needed, the events of a received frame */
+int repl_frame_unpack(int flags, int raw_len, str *data);
+
+/* returns 1 and the event at @p (advancing it), 0 at the end of the
+ * frame or -1 if the frame is truncated */
+int repl_frame_next(char **p, char *end, str *ev);
+
+long long repl_now_ms(void);
+
+#endif /* _REPL_BATCH_H_ */
@@ -72,6 +72,8 @@
 #include "parser/parse_to.h"
 #include "mem/mem.h"
 #include "xlog.h"
+#include "hash_func.h"
+#include "re.h"
 #include "evi/evi_modules.h"
 
 
@@ -99,6 +101,9 @@ int route_type = REQUEST_ROUTE;
 
 static int fix_actions(struct action* a); /*fwd declaration*/
 
+/* switch() statements with fewer case labels are evaluated sequentially */
+#define SWITCH_JT_MIN_CASES 4
+
 extern int return_code;
 
 /*!
@@ -238,6 +243,171 @@ static int fix_expr(struct expr* exp)
 
 
 
+static int switch_int_case_cmp(const void *a, const void *b)
+{
+	const struct switch_int_case *ca = (const struct switch_int_case *)a;
+	const struct switch_int_case *cb = (const struct switch_int_case *)b;
+
+	if (ca->n != cb->n)
+		return (ca->n < cb->n) ? -1 : 1;
+	return ca->pos - cb->pos;
+}
+
+
+/*! \brief Builds the jump table of a switch() statement
+ *
+ * The string labels are indexed in an open addressing hash (case
+ * insensitive, as the switch() matching) and the integer labels in a
+ * sorted array. Duplicated labels keep the first case, as the sequential
+ * evaluation does. If the switch contains anything else than constant
+ * case labels, no table is built and the switch is evaluated sequentially.
+ * \return 0 if ok (table built or not needed), <0 on error
+ */
+static int fix_switch(struct action *sw)
+{
+	struct switch_jmp_table *jt;
+	struct switch_str_case *sc;
+	struct action *aitem, *def;
+	unsigned int n_str, n_int, size, h, i, k;
+	int pos;
+
+	n_str = n_int = 0;
+	def = NULL;
+	for (aitem=(struct action*)sw->elem[1].u.data; aitem; aitem=aitem->next) {
+		if (aitem->type==DEFAULT_T) {
+			def = aitem;
+		} else if (aitem->type!=CASE_T) {
+			return 0;
+		} else if (aitem->elem[0].type==STR_ST) {
+			n_str++;
+		} else if (aitem->elem[0].type==NUMBER_ST) {
+			n_int++;
+		} else {
+			/* non-constant label - keep the sequential evaluation */
+			return 0;
+		}
+	}
+
+	if (n_str + n_int < SWITCH_JT_MIN_CASES)
+		return 0;
+
+	for (size=0; n_str && size<2*n_str; size=size?size<<1:1);
+
+	jt = (struct switch_jmp_table*)pkg_malloc(sizeof(struct switch_jmp_table)
+		+ size*sizeof(struct switch_str_case)
+		+ n_int*sizeof(struct switch_int_case));
+	if (jt==NULL) {
+		LM_ERR("no more pkg mem for switch table\n");
+		return E_OUT_OF_MEM;
+	}
+	memset(jt, 0, sizeof(struct switch_jmp_table)
+		+ size*sizeof(struct switch_str_case));
+	jt->str_cases = (struct switch_str_case*)(jt+1);
+	jt->str_size = size;
+	jt->int_cases = (struct switch_int_case*)(jt->str_cases+size);
+	jt->def = def;
+
+	pos = 0;
+	for (aitem=(struct action*)sw->elem[1].u.data; aitem;
+	aitem=aitem->next, pos++) {
+		if (aitem->type!=CASE_T)
+			continue;
+
+		if (aitem->elem[0].type==NUMBER_ST) {
+			jt->int_cases[jt->int_no].n = aitem->elem[0].u.number;
+			jt->int_cases[jt->int_no].pos = pos;
+			jt->int_cases[jt->int_no].a = aitem;
+			jt->int_no++;
+			continue;
+		}
+
+		h = core_case_hash(&aitem->elem[0].u.s, NULL, 0);
+		for (i=h&(size-1); (sc=&jt->str_cases[i])->a; i=(i+1)&(size-1)) {
+			if (sc->hash==h && sc->s.len==aitem->elem[0].u.s.len &&
+			strncasecmp(sc->s.s, aitem->elem[0].u.s.s, sc->s.len)==0)
+				break;
+		}
+		if (sc->a) {
+			LM_WARN("duplicated case \"%.*s\" in switch at %s:%d\n",
+				sc->s.len, sc->s.s, aitem->file, aitem->line);
+			continue;
+		}
+		sc->s = aitem->elem[0].u.s;
+		sc->hash = h;
+		sc->pos = pos;
+		sc->a = aitem;
+	}
+
+	if (jt->int_no) {
+		qsort(jt->int_cases, jt->int_no, sizeof(struct switch_int_case),
+			switch_int_case_cmp);
+		/* drop the duplicated labels, the first case wins */
+		for (i=1, k=0; i<jt->int_no; i++) {
+			if (jt->int_cases[i].n==jt->int_cases[k].n) {
+				LM_WARN("duplicated case %ld in switch at %s:%d\n",
+					jt->int_cases[i].n, jt->int_cases[i].a->file,
+					jt->int_cases[i].a->line);
+				continue;
+			}
+			jt->int_cases[++k] = jt->int_cases[i];
+		}
+		jt->int_no = k+1;
+	}
+
+	LM_DBG("switch at %s:%d compiled into a jump table (%u str, %u int)\n",
+		sw->file, sw->line, n_str, jt->int_no);
+
+	sw->elem[2].type = SWITCH_JT_ST;
+	sw->elem[2].u.data = (void*)jt;
+	return 0;
+}
+
+
+/*! \brief Looks up the case to jump to for the given switch() value
+ * \return the matching CASE_T action or NULL if no case matches
+ */
+struct action *switch_jt_lookup(struct switch_jmp_table *jt, pv_value_t *val)
+{
+	struct switch_str_case *sc, *str_hit = NULL;
+	struct switch_int_case *ic = NULL;
+	unsigned int h, i;
+	int l, r, m;
+
+	if ((val->flags&PV_VAL_STR) && jt->str_size) {
+		h = core_case_hash(&val->rs, NULL, 0);
+		for (i=h&(jt->str_size-1); (sc=&jt->str_cases[i])->a;
+		i=(i+1)&(jt->str_size-1)) {
+			if (sc->hash==h && sc->s.len==val->rs.len &&
+			strncasecmp(sc->s.s, val->rs.s, val->rs.len)==0) {
+				str_hit = sc;
+				break;
+			}
+		}
+	}
+
+	if ((val->flags&PV_VAL_INT) && jt->int_no) {
+		l = 0;
+		r = jt->int_no - 1;
+		while (l<=r) {
+			m = (l+r)>>1;
+			if (jt->int_cases[m].n==val->ri) {
+				ic = &jt->int_cases[m];
+				break;
+			}
+			if (jt->int_cases[m].n < val->ri)
+				l = m+1;
+			else
+				r = m-1;
+		}
+	}
+
+	/* a value may be both string and integer - the first case wins */
+	if (str_hit && (ic==NULL || str_hit->pos < ic->pos))
+		return str_hit->a;
+	return ic ? ic->a : NULL;
+}
+
+
 /*! \brief Adds the proxies in the proxy list & resolves the hostnames
  * \return 0 if ok, <0 on error */
 static int fix_actions(struct action* a)
@@ -430,6 +600,8 @@ static int fix_actions(struct action* a)
 				if ( (t->elem[1].type==ACTIONS_ST)&&(t->elem[1].u.data) ){
 					if ((ret=fix_actions((struct action*)t->elem[1].u.data))<0)
 						return ret;
+					if ((ret=fix_switch(t))<0)
+						return ret;
 				}
 				break;
 			case CASE_T:
@@ -753,7 +925,8 @@ static int fix_actions(struct action* a)
 						return E_CFG;
 					}
 
-					if(pv_parse_format(&s ,&model) || model==NULL)
+					if(pv_parse_format(&s ,&model) || model==NULL
+					|| xl_fix_format(model)!=0)
 					{
 						LM_ERR("wrong format [%s] for value param!\n", s.s);
 						ret=E_BUG;
@@ -811,7 +984,8 @@ static int fix_actions(struct action* a)
 
 					s.s = t->elem[1].u.data;
 					s.len = strlen(s.s);
-					if (pv_parse_format(&s, &model) || model == NULL)
+					if (pv_parse_format(&s, &model) || model == NULL
+					|| xl_fix_format(model)!=0)
 					{
 						LM_ERR("wrong format [%s] for value param\n",s.s);
 						ret=E_BUG;
@@ -938,7 +1112,6 @@ inline static int comp_strval(struct sip_msg *msg, int op, str* ival,
 	int ret;
 	regex_t* re;
 	char backup;
-	char backup2;
 	str res;
 	pv_value_t value;
 
@@ -987,23 +1160,12 @@ inline static int comp_strval(struct sip_msg *msg, int op, str* ival,
 			backup=ival->s[ival->len];ival->s[ival->len]='\0';
 
 			if(opd->type == SCRIPTVAR_ST) {
-				re=(regex_t*)pkg_malloc(sizeof(regex_t));
-				if (re==0){
-					LM_CRIT("pkg memory allocation failure\n");
-					ival->s[ival->len]=backup;
-					goto error;
-				}
-				backup2 = res.s[res.len];res.s[res.len] = '\0';
-				if (regcomp(re, res.s, REG_EXTENDED|REG_NOSUB|REG_ICASE)) {
-					pkg_free(re);
-					res.s[res.len] = backup2;
+				re = re_cache_get(&res, REG_EXTENDED|REG_NOSUB|REG_ICASE);
+				if (re==NULL) {
 					ival->s[ival->len]=backup;
 					goto error;
 				}
 				ret=(regexec(re, ival->s, 0, 0, 0)==0);
-				regfree(re);
-				pkg_free(re);
-				res.s[res.len] = backup2;
 			} else {
 				ret=(regexec((regex_t*)opd->v.data, ival->s, 0, 0, 0)==0);
 			}
@@ -1183,7 +1345,6 @@ error_op:
 inline static int comp_s2s(int op, str *s1, str *s2)
 {
 	char backup;
-	char backup2;
 	int n;
 	int rt;
 	int ret;
@@ -1261,28 +1422,15 @@ inline static int comp_s2s(int op, str *s1, str *s2)
 		case MATCHD_OP:
 		case NOTMATCHD_OP:
 			if ( s2->s==NULL || s1->len == 0 ) return 0;
-			re=(regex_t*)pkg_malloc(sizeof(regex_t));
-			if (re==0) {
-				LM_CRIT("pkg memory allocation failure\n");
+			re = re_cache_get(s2, REG_EXTENDED|REG_NOSUB|REG_ICASE);
+			if (re==NULL)
 				return -1;
-			}
 
 			backup  = s1->s[s1->len];  s1->s[s1->len] = '\0';
-			backup2 = s2->s[s2->len];  s2->s[s2->len] = '\0';
-
-			if (regcomp(re, s2->s, REG_EXTENDED|REG_NOSUB|REG_ICASE)) {
-				pkg_free(re);
-				s2->s[s2->len] = backup2;
-				s1->s[s1->len] = backup;
-				return -1;
-			}
 			if(op==MATCHD_OP)
 				ret=(regexec(re, s1->s, 0, 0, 0)==0);
 			else
 				ret=(regexec(re, s1->s, 0, 0, 0)!=0);
-			regfree(re);
-			pkg_free(re);
-			s2->s[s2->len] = backup2;
 			s1->s[s1->len] = backup;
 			break;
 		default:
@@ -114,6 +114,8 @@ int check_rls();
 
 int eval_expr(struct expr* e, struct sip_msg* msg, pv_value_t *val);
 
+struct action *switch_jt_lookup(struct switch_jmp_table *jt, pv_value_t *val);
+
 int run_startup_route(void);
 
 int is_script_func_used( char *name, int param_no);
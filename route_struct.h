@@ -96,7 +96,7 @@ enum { FORWARD_T=1, SEND_T, ASSERT_T, DROP_T, LOG_T, ERROR_T, ROUTE_T, EXEC_T,
 enum { NOSUBTYPE=0, STRING_ST, NET_ST, NUMBER_ST, IP_ST, RE_ST, PROXY_ST,
 		EXPR_ST, ACTIONS_ST, CMD_ST, ACMD_ST, MODFIXUP_ST,
 		MYSELF_ST, STR_ST, SOCKID_ST, SOCKETINFO_ST, SCRIPTVAR_ST, NULLV_ST,
-		BLACKLIST_ST, SCRIPTVAR_ELEM_ST};
+		BLACKLIST_ST, SCRIPTVAR_ELEM_ST, SWITCH_JT_ST};
 
 struct expr;
 #include "pvar.h"
@@ -145,6 +145,32 @@ struct action{
 };
 
 
+/*! \brief string case label of a switch() jump table */
+struct switch_str_case {
+	str s;
+	unsigned int hash;
+	int pos;               /* position of the case inside the switch */
+	struct action *a;      /* the CASE_T action to jump to */
+};
+
+/*! \brief integer case label of a switch() jump table */
+struct switch_int_case {
+	long n;
+	int pos;
+	struct action *a;
+};
+
+/*! \brief jump table pre-computed at fixup time for switch() statements
+ * with constant case labels only (attached as SWITCH_JT_ST in elem[2]) */
+struct switch_jmp_table {
+	struct switch_str_case *str_cases; /* open addressing, str_size slots */
+	unsigned int str_size;             /* power of 2, 0 if no string cases */
+	struct switch_int_case *int_cases; /* sorted by value */
+	unsigned int int_no;
+	struct action *def;                /* the DEFAULT_T action, if any */
+};
+
+
 
 struct expr* mk_exp(int op, struct expr* left, struct expr* right);
 struct expr* mk_elem(int op, int leftt, void *leftd, int rightt, void *rightd);
@@ -0,0 +1,54 @@
+#!/bin/bash
+# check the expansion of the compact Via headers of a compact cloned request
+
+# Copyright (C) 2013 OpenSIPS Solutions
+#
+# This file is part of opensips, a free SIP server.
+#
+# opensips is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version
+#
+# opensips is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+source include/require
+
+CFG=36.cfg
+LOG=36.log
+
+if ! (check_netcat && check_opensips && check_module "tm" && check_module "sl"); then
+	exit 0
+fi ;
+
+../opensips -w . -f $CFG > $LOG 2>&1
+ret=$?
+
+sleep 1
+
+if [ "$ret" -eq 0 ] ; then
+	# the 503 is only built if failure_route ran on the faked request
+	cat compact_via.sip | nc -q 3 -u -p 5071 127.0.0.1 5060 | \
+		grep "^SIP/2.0 503 Compact Via Expanded" > /dev/null
+	ret=$?
+fi ;
+
+if [ "$ret" -eq 0 ] ; then
+	grep "failed to parse Via" $LOG > /dev/null
+	if [ "$?" -eq 0 ] ; then
+		ret=1
+	fi ;
+fi ;
+
+killall -9 opensips
+
+rm -f $LOG
+
+exit $ret
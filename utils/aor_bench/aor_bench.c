@@ -0,0 +1,301 @@
+/*
+ * Benchmark of the usrloc record lookups: AVL map vs the aor_index
+ *
+ * Copyright (C) 2013 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Standalone program - it links the core map.c and core_hash(), while
+ * the index code is a copy of the one in modules/usrloc/hslot.c (keep
+ * them in sync). It spreads N AoRs over 2^hash_size slots, then looks
+ * all of them up in random order, and as many unknown AoRs (which only
+ * differ by the domain), through the map and through the index.
+ *
+ * The memory is the one requested from the allocator (the shm allocator
+ * adds its own fragment header to each chunk), split between the map
+ * (one node per record, the AoR is not copied) and the index (the entry
+ * arrays).
+ *
+ *   make
+ *   ./aor_bench 10000000 9
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* replace the opensips allocators with counting wrappers around malloc */
+#define mem_h
+#define shm_mem_h
+
+static unsigned long mem_bytes;
+static unsigned long mem_chunks;
+
+static inline void *bench_malloc(size_t size)
+{
+	mem_bytes += size;
+	mem_chunks++;
+	return malloc(size);
+}
+
+#define pkg_malloc(_s)  bench_malloc(_s)
+#define shm_malloc(_s)  bench_malloc(_s)
+#define pkg_free(_p)    free(_p)
+#define shm_free(_p)    free(_p)
+
+#include "../../map.c"
+#include "../../hash_func.h"
+
+/* ---- copy of the modules/usrloc/hslot.c index ---- */
+
+struct urecord {
+	str aor;
+	unsigned int aorhash;
+};
+
+typedef struct ul_aor_entry {
+	unsigned int aorhash;
+	struct urecord* r;
+} ul_aor_entry_t;
+
+#define UL_AOR_DELETED ((struct urecord*)-1)
+#define AOR_IDX_INIT_SIZE 16
+
+#define aor_idx_pos(_h, _size) \
+	((((_h) ^ ((_h) >> 16)) * 0x45d9f3bu) & ((_size) - 1))
+
+typedef struct hslot {
+	map_t records;
+	ul_aor_entry_t *aor_idx;
+	unsigned int aor_idx_size;
+	unsigned int aor_idx_used;
+} hslot_t;
+
+static inline ul_aor_entry_t* aor_idx_lookup(hslot_t* _s, str* _aor,
+													unsigned int _h)
+{
+	ul_aor_entry_t* e;
+	unsigned int i;
+
+	for (i = aor_idx_pos(_h, _s->aor_idx_size); ;
+	i = (i + 1) & (_s->aor_idx_size - 1)) {
+		e = &_s->aor_idx[i];
+		if (e->r == NULL)
+			return NULL;
+		if (e->r != UL_AOR_DELETED && e->aorhash == _h &&
+		e->r->aor.len == _aor->len &&
+		memcmp(e->r->aor.s, _aor->s, _aor->len) == 0)
+			return e;
+	}
+}
+
+static inline void aor_idx_put(ul_aor_entry_t* idx, unsigned int size,
+		struct urecord* _r)
+{
+	unsigned int i;
+
+	for (i = aor_idx_pos(_r->aorhash, size);
+	idx[i].r != NULL && idx[i].r != UL_AOR_DELETED; i = (i + 1) & (size - 1));
+
+	idx[i].aorhash = _r->aorhash;
+	idx[i].r = _r;
+}
+
+static int aor_idx_resize(hslot_t* _s, unsigned int size)
+{
+	ul_aor_entry_t* idx;
+	unsigned int i, used = 0;
+
+	idx = shm_malloc(size * sizeof *idx);
+	if (!idx)
+		return -1;
+	memset(idx, 0, size * sizeof *idx);
+
+	for (i = 0; i < _s->aor_idx_size; i++)
+		if (_s->aor_idx[i].r && _s->aor_idx[i].r != UL_AOR_DELETED) {
+			aor_idx_put(idx, size, _s->aor_idx[i].r);
+			used++;
+		}
+
+	if (_s->aor_idx) {
+		/* only the live arrays are accounted */
+		mem_bytes -= _s->aor_idx_size * sizeof *idx;
+		mem_chunks--;
+		shm_free(_s->aor_idx);
+	}
+	_s->aor_idx = idx;
+	_s->aor_idx_size = size;
+	_s->aor_idx_used = used;
+	return 0;
+}
+
+static int aor_idx_add(hslot_t* _s, struct urecord* _r)
+{
+	unsigned int size, live;
+
+	if ((_s->aor_idx_used + 1) * 4 > _s->aor_idx_size * 3) {
+		live = map_size(_s->records);
+		size = _s->aor_idx_size ? _s->aor_idx_size : AOR_IDX_INIT_SIZE;
+		while ((live + 1) * 2 > size)
+			size *= 2;
+		if (aor_idx_resize(_s, size) < 0)
+			return -1;
+	}
+
+	aor_idx_put(_s->aor_idx, _s->aor_idx_size, _r);
+	_s->aor_idx_used++;
+	return 0;
+}
+
+/* ---- end of copy ---- */
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+	struct urecord *recs, *r;
+	hslot_t *slots, *s;
+	int *order;
+	int n, hbits, nslots, i, j, k, found;
+	unsigned long map_bytes, map_chunks, idx_bytes, idx_chunks;
+	unsigned int h;
+	double t0, hit_map, hit_idx, miss_map, miss_idx;
+	char buf[64];
+	str miss;
+
+	if (argc != 3 || (n = atoi(argv[1])) <= 0 ||
+	(hbits = atoi(argv[2])) < 1 || hbits > 20) {
+		fprintf(stderr, "usage: %s <aors> <hash_size>\n", argv[0]);
+		return 1;
+	}
+	nslots = 1 << hbits;
+
+	recs = malloc(n * sizeof *recs);
+	order = malloc(n * sizeof *order);
+	slots = calloc(nslots, sizeof *slots);
+	if (!recs || !order || !slots) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	srand(42);
+
+	/* the map first, alone, to account its memory */
+	for (i = 0; i < nslots; i++)
+		slots[i].records = map_create(AVLMAP_SHARED | AVLMAP_NO_DUPLICATE);
+	for (i = 0; i < n; i++) {
+		r = &recs[i];
+		r->aor.len = sprintf(buf, "4071%07u%02d@sip.example.com",
+			(unsigned)i, rand() % 100);
+		r->aor.s = strdup(buf);
+		r->aorhash = core_hash(&r->aor, 0, 0);
+		*map_get(slots[r->aorhash & (nslots - 1)].records, r->aor) = r;
+		order[i] = i;
+	}
+	map_bytes = mem_bytes;
+	map_chunks = mem_chunks;
+
+	for (i = 0; i < n; i++) {
+		r = &recs[i];
+		if (aor_idx_add(&slots[r->aorhash & (nslots - 1)], r) < 0) {
+			fprintf(stderr, "out of memory\n");
+			return 1;
+		}
+	}
+	idx_bytes = mem_bytes - map_bytes;
+	idx_chunks = mem_chunks - map_chunks;
+
+	for (i = n - 1; i > 0; i--) {
+		j = rand() % (i + 1);
+		k = order[i]; order[i] = order[j]; order[j] = k;
+	}
+
+	/* the map lookups also compute the hash, to select the slot */
+	found = 0;
+	t0 = now();
+	for (i = 0; i < n; i++) {
+		r = &recs[order[i]];
+		h = core_hash(&r->aor, 0, 0);
+		found += map_find(slots[h & (nslots - 1)].records, r->aor) != NULL;
+	}
+	hit_map = now() - t0;
+	if (found != n) {
+		fprintf(stderr, "map lookups failed\n");
+		return 1;
+	}
+
+	found = 0;
+	t0 = now();
+	for (i = 0; i < n; i++) {
+		r = &recs[order[i]];
+		h = core_hash(&r->aor, 0, 0);
+		s = &slots[h & (nslots - 1)];
+		found += aor_idx_lookup(s, &r->aor, h) != NULL;
+	}
+	hit_idx = now() - t0;
+	if (found != n) {
+		fprintf(stderr, "index lookups failed\n");
+		return 1;
+	}
+
+	found = 0;
+	t0 = now();
+	for (i = 0; i < n; i++) {
+		miss.len = sprintf(buf, "4071%07u%02d@sip.example.org",
+			(unsigned)order[i], 0);
+		miss.s = buf;
+		h = core_hash(&miss, 0, 0);
+		found += map_find(slots[h & (nslots - 1)].records, miss) != NULL;
+	}
+	miss_map = now() - t0;
+
+	t0 = now();
+	for (i = 0; i < n; i++) {
+		miss.len = sprintf(buf, "4071%07u%02d@sip.example.org",
+			(unsigned)order[i], 0);
+		miss.s = buf;
+		h = core_hash(&miss, 0, 0);
+		s = &slots[h & (nslots - 1)];
+		found += aor_idx_lookup(s, &miss, h) != NULL;
+	}
+	miss_idx = now() - t0;
+	if (found != 0) {
+		fprintf(stderr, "unknown AoRs found\n");
+		return 1;
+	}
+
+	printf("%d AoRs, hash_size %d\n", n, hbits);
+	printf("  hit:  map %6.0f ns  index %6.0f ns\n",
+		hit_map / n * 1e9, hit_idx / n * 1e9);
+	printf("  miss: map %6.0f ns  index %6.0f ns\n",
+		miss_map / n * 1e9, miss_idx / n * 1e9);
+	printf("  memory per record: map %.1f bytes (%.1f chunks), "
+		"index %.1f bytes (%.4f chunks)\n",
+		(double)map_bytes / n, (double)map_chunks / n,
+		(double)idx_bytes / n, (double)idx_chunks / n);
+
+	return 0;
+}
@@ -0,0 +1,366 @@
+/*
+ * Test and benchmark of the dialplan regexp prefilter
+ *
+ * Copyright (C) 2013 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Standalone program (needs pcre) - it links the prefilter code of the
+ * dialplan module and checks it against a linear scan of the rules:
+ *
+ *   ./dp_bench               runs the edge case tests: for each input,
+ *                            every rule matching it must be a candidate
+ *                            and the first matching rule must be the same
+ *   ./dp_bench <rules> <n>   times <n> translations over a generated set
+ *                            of <rules> rules, with and without prefilter
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* replace the opensips allocators and logging */
+#define mem_h
+#define shm_mem_h
+#define dprint_h
+
+#define pkg_malloc(_s)        malloc(_s)
+#define pkg_realloc(_p, _s)   realloc(_p, _s)
+#define pkg_free(_p)          free(_p)
+#define shm_malloc(_s)        malloc(_s)
+#define shm_free(_p)          free(_p)
+
+#define LM_ERR(fmt, args...)  fprintf(stderr, "ERROR: " fmt, ##args)
+#define LM_WARN(fmt, args...) fprintf(stderr, "WARNING: " fmt, ##args)
+#define LM_CRIT(fmt, args...) fprintf(stderr, "CRITICAL: " fmt, ##args)
+#define LM_INFO(fmt, args...)   do { if (0) printf(fmt, ##args); } while (0)
+#define LM_NOTICE(fmt, args...) do { if (0) printf(fmt, ##args); } while (0)
+#define LM_DBG(fmt, args...)    do { if (0) printf(fmt, ##args); } while (0)
+
+#include "../../modules/dialplan/dp_prefilter.c"
+
+static dpl_node_t *add_rule(dpl_id_t *idp, char *exp, int flags)
+{
+	dpl_index_t *regex = &idp->rule_hash[DP_INDEX_HASH_SIZE];
+	dpl_node_t *rule;
+	const char *err;
+	int off;
+
+	rule = calloc(1, sizeof *rule);
+	if (!rule) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	rule->match_exp.s = exp;
+	rule->match_exp.len = strlen(exp);
+	rule->match_flags = flags;
+	rule->matchop = REGEX_OP;
+	rule->match_comp = pcre_compile(exp,
+		(flags & DP_CASE_INSENSITIVE) ? PCRE_CASELESS : 0, &err, &off, NULL);
+	if (!rule->match_comp) {
+		fprintf(stderr, "bad regexp <%s>: %s at %d\n", exp, err, off);
+		exit(1);
+	}
+
+	if (regex->last_rule)
+		regex->last_rule->next = rule;
+	else
+		regex->first_rule = rule;
+	regex->last_rule = rule;
+
+	return rule;
+}
+
+static dpl_id_t *new_dpid(void)
+{
+	dpl_id_t *idp;
+
+	idp = calloc(1, sizeof *idp);
+	if (!idp || !(idp->rule_hash =
+	calloc(DP_INDEX_HASH_SIZE + 1, sizeof *idp->rule_hash))) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	return idp;
+}
+
+static inline int rule_matches(dpl_node_t *rule, str *in)
+{
+	int ovector[30];
+
+	return pcre_exec(rule->match_comp, NULL, in->s, in->len, 0, 0,
+		ovector, 30) >= 0;
+}
+
+/* first matching rule, testing all of them as translate() did */
+static dpl_node_t *linear_match(dpl_id_t *idp, str *in)
+{
+	dpl_node_t *rule;
+
+	for (rule = idp->rule_hash[DP_INDEX_HASH_SIZE].first_rule; rule;
+	rule = rule->next)
+		if (rule_matches(rule, in))
+			return rule;
+
+	return NULL;
+}
+
+/* first matching rule, testing only the candidates */
+static dpl_node_t *prefilter_match(dpl_id_t *idp, str *in)
+{
+	dpl_regex_iter_t it;
+	dpl_node_t *rule;
+
+	dp_regex_iter_init(idp->regex_pf, in, &it);
+	while ((rule = dp_regex_iter_next(&it)))
+		if (rule_matches(rule, in))
+			return rule;
+
+	return NULL;
+}
+
+/* position of a rule in the priority order */
+static int rule_idx(dpl_id_t *idp, dpl_node_t *rule)
+{
+	dpl_node_t *r;
+	int i;
+
+	for (i = 0, r = idp->rule_hash[DP_INDEX_HASH_SIZE].first_rule; r != rule;
+	i++, r = r->next);
+
+	return i;
+}
+
+static struct {
+	char *exp;
+	int flags;
+} test_rules[] = {
+	{"^0049(.*)$", 0},
+	{"^0049", 0},
+	{"^004(9|3)", 0},
+	{"^00\\.49", 0},          /* escaped punctuation - a literal */
+	{"^\\+49", 0},
+	{"^\\d+x$", 0},           /* escaped alnum - a class */
+	{"^a\\|b", 0},            /* escaped bar - not an alternation */
+	{"^1?23", 0},             /* optional first char */
+	{"^12*3", 0},
+	{"^12{2}3", 0},
+	{"^12{0,1}4", 0},
+	{"^12+5", 0},             /* '+' - the char is still required */
+	{"^ab|^cd", 0},           /* top level alternation */
+	{"^x|y", 0},
+	{"^(ab|cd)x", 0},         /* alternation in a group */
+	{"^[|]z", 0},             /* bar in a class */
+	{"^9[]]", 0},             /* bracket first in a class */
+	{"^[^]a]q", 0},
+	{"^\\(w", 0},
+	{"^a.b", 0},
+	{"^ab(?i)c", 0},          /* inline option after the prefix */
+	{"(?i)^abc", 0},          /* inline option before the anchor */
+	{"^abc", DP_CASE_INSENSITIVE},
+	{"^1A", DP_CASE_INSENSITIVE},
+	{"0049", 0},              /* not anchored */
+	{"7$", 0},
+	{"^x$", 0},
+	{"^", 0},
+	{"^0049123456789012345678901234567890123456789012345678901234567890"
+		"12345", 0},          /* longer than the prefix limit */
+};
+
+static char *test_inputs[] = {
+	"00491234", "0049", "0043", "0044", "00.49", "00x49", "+49123", "49",
+	"123x", "a|b", "ab", "a", "123", "23", "13", "1223", "12223", "124",
+	"1224", "12224", "125", "1225", "15", "ab", "cd", "abx", "cdx", "x",
+	"xy", "y", "zy", "|z", "9]", "9", "bq", "]q", "(w", "axb", "a\nb",
+	"abc", "abC", "ABC", "Abcd", "aBc", "1a", "1A", "1ax", "55500495",
+	"007", "x7", "004912345678901234567890123456789012345678901234567890"
+	"1234567890123456", "0049123456789012345678901234567890123456789012"
+	"34567890123456789012345", "",
+};
+
+static int run_tests(void)
+{
+	dpl_id_t *idp;
+	dpl_node_t *rule, *lin, *pf, *cand[64];
+	dpl_regex_iter_t it;
+	int i, k, n, rules_no, errors = 0, checked = 0;
+	str in;
+
+	idp = new_dpid();
+	rules_no = sizeof test_rules / sizeof *test_rules;
+	for (i = 0; i < rules_no; i++)
+		add_rule(idp, test_rules[i].exp, test_rules[i].flags);
+
+	if (dp_build_prefilter(idp) != 0 || !idp->regex_pf) {
+		fprintf(stderr, "failed to build the prefilter\n");
+		return 1;
+	}
+
+	for (i = 0; i < (int)(sizeof test_inputs / sizeof *test_inputs); i++) {
+		in.s = test_inputs[i];
+		in.len = strlen(in.s);
+
+		/* each rule matching the input must be a candidate */
+		dp_regex_iter_init(idp->regex_pf, &in, &it);
+		for (n = 0; n < rules_no && (cand[n] = dp_regex_iter_next(&it)); n++);
+		for (rule = idp->rule_hash[DP_INDEX_HASH_SIZE].first_rule; rule;
+		rule = rule->next) {
+			if (!rule_matches(rule, &in))
+				continue;
+			for (k = 0; k < n && cand[k] != rule; k++);
+			if (k == n) {
+				printf("FAIL: <%s> matches <%s> which is not a candidate\n",
+					rule->match_exp.s, in.s);
+				errors++;
+			}
+			checked++;
+		}
+
+		/* the candidates must be in priority order */
+		for (k = 1; k < n; k++)
+			if (rule_idx(idp, cand[k]) <= rule_idx(idp, cand[k-1])) {
+				printf("FAIL: candidates of <%s> out of order\n", in.s);
+				errors++;
+				break;
+			}
+
+		lin = linear_match(idp, &in);
+		pf = prefilter_match(idp, &in);
+		if (lin != pf) {
+			printf("FAIL: <%s> matched <%s> instead of <%s>\n", in.s,
+				pf ? pf->match_exp.s : "-", lin ? lin->match_exp.s : "-");
+			errors++;
+		}
+	}
+
+	printf("%d inputs, %d rules, %d matches checked, %d errors\n", i,
+		rules_no, checked, errors);
+
+	return errors ? 1 : 0;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* a numbering plan: rules with the prefixes of random lengths (1 to 6
+ * digits after the international prefix), plus a few unanchored ones,
+ * and numbers mostly starting with one of the prefixes */
+static int run_bench(int rules_no, int n)
+{
+	dpl_id_t *idp;
+	dpl_node_t *lin, *pf;
+	char **prefixes, **inputs, buf[64];
+	int i, j, len, found = 0;
+	double t0, t_lin, t_pf;
+	str in;
+
+	prefixes = malloc(rules_no * sizeof *prefixes);
+	inputs = malloc(n * sizeof *inputs);
+	if (!prefixes || !inputs) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	srand(42);
+	idp = new_dpid();
+	for (i = 0; i < rules_no; i++) {
+		len = 1 + rand() % 6;
+		for (j = 0; j < len; j++)
+			buf[j] = '0' + rand() % 10;
+		buf[j] = 0;
+		prefixes[i] = strdup(buf);
+
+		if (i % 20 == 19)
+			sprintf(buf, "%s$", prefixes[i]);
+		else
+			sprintf(buf, "^00%s(\\d+)$", prefixes[i]);
+		add_rule(idp, strdup(buf), 0);
+	}
+
+	for (i = 0; i < n; i++) {
+		len = sprintf(buf, "00%s", prefixes[rand() % rules_no]);
+		while (len < 14)
+			buf[len++] = '0' + rand() % 10;
+		buf[len] = 0;
+		inputs[i] = strdup(buf);
+	}
+
+	t0 = now();
+	if (dp_build_prefilter(idp) != 0 || !idp->regex_pf) {
+		fprintf(stderr, "failed to build the prefilter\n");
+		return 1;
+	}
+	printf("%d rules: prefilter built in %.1f ms, %d trie nodes\n",
+		rules_no, (now() - t0) * 1e3, idp->regex_pf->nodes_no);
+
+	t0 = now();
+	for (i = 0; i < n; i++) {
+		in.s = inputs[i];
+		in.len = strlen(in.s);
+		found += linear_match(idp, &in) != NULL;
+	}
+	t_lin = now() - t0;
+
+	t0 = now();
+	for (i = 0; i < n; i++) {
+		in.s = inputs[i];
+		in.len = strlen(in.s);
+		found -= prefilter_match(idp, &in) != NULL;
+	}
+	t_pf = now() - t0;
+
+	/* the results must be the same */
+	for (i = 0; i < n; i += 97) {
+		in.s = inputs[i];
+		in.len = strlen(in.s);
+		lin = linear_match(idp, &in);
+		pf = prefilter_match(idp, &in);
+		if (lin != pf)
+			found = 1;
+	}
+	if (found) {
+		fprintf(stderr, "prefiltered results differ from the linear ones\n");
+		return 1;
+	}
+
+	printf("  per translation: linear %.2f us, prefiltered %.2f us\n",
+		t_lin / n * 1e6, t_pf / n * 1e6);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc == 1)
+		return run_tests();
+
+	if (argc != 3 || atoi(argv[1]) <= 0 || atoi(argv[2]) <= 0) {
+		fprintf(stderr, "usage: %s [<rules> <translations>]\n", argv[0]);
+		return 1;
+	}
+
+	return run_bench(atoi(argv[1]), atoi(argv[2]));
+}
@@ -31,7 +31,10 @@
 #include "sr_module.h"
 #include "dprint.h"
 #include "error.h"
+#include "ut.h"
+#include "ip_addr.h"
 #include "mem/mem.h"
+#include "parser/parse_cseq.h"
 #include "xlog.h"
 
 #include "pvar.h"
@@ -39,6 +42,8 @@
 
 char *log_buf = NULL;
 
+static str xl_null = str_init("<null>");
+
 int xlog_buf_size = 4096;
 int xlog_force_color = 0;
 int xlog_default_level = L_ERR;
@@ -55,6 +60,104 @@ static int buf_init(void)
 	return 0;
 }
 
+#define xl_append(_s, _len) \
+	do { \
+		if (n+(_len) >= *len) { \
+			LM_ERR("buffer overflow -- increase the buffer size from " \
+				"[%d]...\n", *len); \
+			return -1; \
+		} \
+		memcpy(cur, (_s), (_len)); \
+		n += (_len); \
+		cur += (_len); \
+	} while(0)
+
+/*! \brief renders an xlog format - same output as pv_printf(), but the
+ * most used specs (with no transformations or context) are rendered
+ * directly out of the message, without going through a pv_value_t */
+static int xl_printf(struct sip_msg* msg, pv_elem_p list, char *buf,
+																	int *len)
+{
+	pv_elem_p it;
+	pv_value_t tok;
+	char *cur, *p;
+	int n, l;
+
+	if(msg==NULL || list==NULL || *len<=0)
+		return -1;
+
+	cur = buf;
+	n = 0;
+	for (it=list; it; it=it->next) {
+		if (it->text.len>0)
+			xl_append(it->text.s, it->text.len);
+
+		if (it->spec.type==PVT_NONE)
+			continue;
+
+		if (it->spec.trans==NULL && it->spec.pvc==NULL) {
+			switch (it->spec.type) {
+			case PVT_CALLID:
+				if (msg->callid==NULL && (parse_headers(msg,HDR_CALLID_F,0)<0
+				|| msg->callid==NULL)) {
+					LM_ERR("cannot parse Call-Id header\n");
+					xl_append(xl_null.s, xl_null.len);
+				} else {
+					xl_append(msg->callid->body.s, msg->callid->body.len);
+				}
+				continue;
+			case PVT_METHOD:
+				if (msg->first_line.type==SIP_REQUEST) {
+					xl_append(msg->first_line.u.request.method.s,
+						msg->first_line.u.request.method.len);
+				} else if (msg->cseq==NULL && (parse_headers(msg,HDR_CSEQ_F,0)<0
+				|| msg->cseq==NULL)) {
+					LM_ERR("no CSEQ header\n");
+					xl_append(xl_null.s, xl_null.len);
+				} else {
+					xl_append(get_cseq(msg)->method.s,
+						get_cseq(msg)->method.len);
+				}
+				continue;
+			case PVT_SRCIP:
+				p = ip_addr2a(&msg->rcv.src_ip);
+				l = strlen(p);
+				xl_append(p, l);
+				continue;
+			case PVT_TIMES:
+				p = int2str((unsigned long)time(NULL), &l);
+				xl_append(p, l);
+				continue;
+			default:
+				break;
+			}
+		}
+
+		/* generic spec */
+		if (pv_get_spec_value(msg, &it->spec, &tok)!=0)
+			continue;
+		if (tok.flags&PV_VAL_NULL)
+			tok.rs = xl_null;
+		if (tok.flags&(PV_VAL_STR|PV_VAL_NULL)) {
+			if (tok.rs.len>0)
+				xl_append(tok.rs.s, tok.rs.len);
+		} else if (tok.flags&(PV_VAL_INT|PV_TYPE_INT)) {
+			p = int2str(tok.ri, &l);
+			xl_append(p, l);
+		} else {
+			LM_ERR("unkown type %x\n", tok.flags);
+			return -1;
+		}
+	}
+
+	*cur = '\0';
+	*len = n;
+	return 0;
+}
+
+#undef xl_append
+
+
 int xl_print_log(struct sip_msg* msg, pv_elem_p list, int *len)
 {
 	if (log_buf == NULL)
@@ -63,7 +166,72 @@ int xl_print_log(struct sip_msg* msg, pv_elem_p list, int *len)
 			LM_ERR("Cannot print message\n");
 			return -1;
 		}
-	return pv_printf(msg, list, log_buf, len);
+	return xl_printf(msg, list, log_buf, len);
+}
+
+
+/*! \brief pre-compiles an xlog format at fixup time
+ *
+ * The specs with a constant value (colors) are rendered once, here, and
+ * folded into the text of their element; then the consecutive constant
+ * segments are merged, so they are copied with a single memcpy() per
+ * call.
+ */
+int xl_fix_format(pv_elem_p model)
+{
+	pv_elem_p e, next;
+	pv_value_t v;
+	str t1, t2;
+	char *p, *merged = NULL;
+
+	/* the original texts point inside the format string; only the
+	 * buffer built by the merges of the current element is ours */
+	for (e=model; e; ) {
+		t2.len = 0;
+		next = NULL;
+
+		if (e->spec.type==PVT_COLOR && e->spec.trans==NULL &&
+		e->spec.pvc==NULL) {
+			memset(&v, 0, sizeof(v));
+			if (e->spec.getf(NULL, &e->spec.pvp, &v)!=0 ||
+			!(v.flags&PV_VAL_STR))
+				return -1;
+			t2 = v.rs;
+			memset(&e->spec, 0, sizeof(pv_spec_t));
+			e->spec.type = PVT_NONE;
+		} else if (e->spec.type==PVT_NONE && e->next) {
+			next = e->next;
+			t2 = next->text;
+		} else {
+			e = e->next;
+			merged = NULL;
+			continue;
+		}
+
+		if (t2.len) {
+			t1 = e->text;
+			p = pkg_malloc(t1.len + t2.len);
+			if (p==NULL) {
+				LM_ERR("no more pkg mem\n");
+				return -1;
+			}
+			memcpy(p, t1.s, t1.len);
+			memcpy(p+t1.len, t2.s, t2.len);
+			if (merged)
+				pkg_free(merged);
+			merged = e->text.s = p;
+			e->text.len = t1.len + t2.len;
+		}
+
+		if (next) {
+			e->spec = next->spec;
+			e->next = next->next;
+			pkg_free(next);
+		}
+		/* look again at the same element, it may merge further */
+	}
+
+	return 0;
 }
 
 
@@ -107,7 +275,7 @@ int xlog_1(struct sip_msg* msg, char* frm, char* str2)
 {
 	int log_len;
 
-	if(!is_printable(L_ERR))
+	if(!is_printable(xlog_default_level))
 		return 1;
 
 	log_len = xlog_buf_size;
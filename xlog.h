@@ -40,6 +40,8 @@ int xlog_1(struct sip_msg*, char*, char*);
 int xlog_2(struct sip_msg*, char*, char*);
 int xdbg(struct sip_msg*, char*, char*);
 
+int xl_fix_format(pv_elem_p model);
+
 int pv_parse_color_name(pv_spec_p sp, str *in);
 int pv_get_color(struct sip_msg *msg, pv_param_t *param,
 		pv_value_t *res);